@@ -0,0 +1,76 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// RGBA32F running sums of the samples of every pixel, with their count and
+// the running mean and squared deviations of their luminance (Welford) for
+// the variance : a sum of squares cancels in float once it dwarfs the
+// variance. The color mean is only computed on resolve.
+class AccumulationBuffer {
+public:
+  AccumulationBuffer(size_t width = 0, size_t height = 0)
+      : _width(width), _heigth(height), _sum(width * height, Color(0)),
+        _lumMean(width * height, 0), _lumM2(width * height, 0),
+        _count(width * height, 0) {}
+
+  AccumulationBuffer(AccumulationBuffer &&other) = default;
+  AccumulationBuffer &operator=(AccumulationBuffer &&other) = default;
+
+  NO_COPY(AccumulationBuffer);
+
+  // -- Methods
+  void add_sample(size_t px, size_t py, Color color) {
+    size_t pos = px + _width * py;
+    float lum = luminance(color);
+    _sum[pos] += color;
+    _count[pos]++;
+    float delta = lum - _lumMean[pos];
+    _lumMean[pos] += delta / static_cast<float>(_count[pos]);
+    _lumM2[pos] += delta * (lum - _lumMean[pos]);
+  }
+
+  Color get_mean(size_t px, size_t py) const {
+    size_t pos = px + _width * py;
+    return _count[pos] == 0 ? Color(0)
+                            : _sum[pos] / static_cast<float>(_count[pos]);
+  }
+
+  // Relative standard error of the luminance mean, infinite under 2 samples
+  float get_error(size_t px, size_t py) const {
+    size_t pos = px + _width * py;
+    if (_count[pos] < 2)
+      return INFINITY;
+
+    float n = static_cast<float>(_count[pos]);
+    float mean = _lumMean[pos];
+    float variance = _lumM2[pos] / (n - 1);
+    // dark pixels are compared to an absolute error instead
+    return std::sqrt(variance / n) / std::max(mean, MIN_LUMINANCE);
+  }
+
+  void clear() {
+    std::fill(_sum.begin(), _sum.end(), Color(0));
+    std::fill(_lumMean.begin(), _lumMean.end(), 0.f);
+    std::fill(_lumM2.begin(), _lumM2.end(), 0.f);
+    std::fill(_count.begin(), _count.end(), 0);
+  }
+
+  // -- Getters
+  size_t get_width() const { return _width; }
+  size_t get_height() const { return _heigth; }
+  uint32_t get_sample_count(size_t px, size_t py) const {
+    return _count[px + _width * py];
+  }
+
+private:
+  static constexpr float MIN_LUMINANCE = 1e-2f;
+
+  size_t _width, _heigth;
+  std::vector<Color> _sum;
+  std::vector<float> _lumMean, _lumM2;
+  std::vector<uint32_t> _count;
+};
@@ -0,0 +1,107 @@
+#include "Background.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+// -- EnvironmentMap impl --
+
+// -- Constructors
+
+EnvironmentMap::EnvironmentMap(size_t width, size_t height,
+                               std::vector<Color> &&texels,
+                               float scale /* = 1 */)
+    : _width(width), _height(height), _texels(std::move(texels)) {
+  if (_width == 0 || _height == 0 || _texels.size() != _width * _height) {
+    LOGWARN("environment map of {}x{} with {} texels, replaced by a black "
+            "texel",
+            _width, _height, _texels.size());
+    _width = _height = 1;
+    _texels.assign(1, Color(0));
+  }
+
+  std::vector<float> luminances(_texels.size());
+  for (size_t i = 0; i < _texels.size(); i++) {
+    _texels[i] = Color(glm::vec3(_texels[i]) * scale, 1);
+    luminances[i] = std::max(luminance(_texels[i]), 0.f);
+  }
+
+  // The lookups blend a texel with its 8 neighbours (wrapping around the
+  // azimuth, clamped at the poles) : their max keeps the pdf above 0 where
+  // a black texel borders a bright one.
+  std::vector<float> weights(_texels.size());
+  for (size_t y = 0; y < _height; y++) {
+    float sin_theta = std::sin((static_cast<float>(y) + 0.5f) /
+                               static_cast<float>(_height) *
+                               static_cast<float>(M_PI));
+    size_t y0 = y == 0 ? 0 : y - 1;
+    size_t y1 = std::min(y + 1, _height - 1);
+    for (size_t x = 0; x < _width; x++) {
+      float footprint = 0;
+      for (size_t ny = y0; ny <= y1; ny++)
+        for (size_t nx : {x + _width - 1, x, x + 1})
+          footprint =
+              std::max(footprint, luminances[ny * _width + nx % _width]);
+      weights[y * _width + x] = footprint * sin_theta;
+    }
+  }
+  _distribution = AliasTable(weights);
+}
+
+std::optional<EnvironmentMap>
+EnvironmentMap::load(const std::filesystem::path &path,
+                     float scale /* = 1 */) {
+  int width, height, channels;
+  float *data =
+      stbi_loadf(path.string().c_str(), &width, &height, &channels, 3);
+  if (!data) {
+    LOGWARN("Could not load the environment map {} : {}", path.string(),
+            stbi_failure_reason());
+    return std::nullopt;
+  }
+
+  std::vector<Color> texels(static_cast<size_t>(width) * height);
+  for (size_t i = 0; i < texels.size(); i++)
+    texels[i] = Color(data[3 * i], data[3 * i + 1], data[3 * i + 2], 1);
+  stbi_image_free(data);
+
+  LOG(FINE, "environment map {} loaded : {}x{}", path.string(), width,
+      height);
+  return EnvironmentMap(width, height, std::move(texels), scale);
+}
+
+// -- Methods
+
+std::optional<EnvironmentSample>
+EnvironmentMap::sample(float u_pick, glm::vec2 u_texel) const {
+  if (_distribution.empty())
+    return std::nullopt;
+
+  float pmf;
+  uint32_t texel = _distribution.sample(u_pick, &pmf);
+  glm::vec2 uv = {(static_cast<float>(texel % _width) + u_texel.x) /
+                      static_cast<float>(_width),
+                  (static_cast<float>(texel / _width) + u_texel.y) /
+                      static_cast<float>(_height)};
+
+  // uniform in the texel : pdf over uv is pmf * texel count, then mapped to
+  // the sphere by the 2 pi^2 sin(theta) jacobian
+  float sin_theta = std::sin(uv.y * static_cast<float>(M_PI));
+  if (sin_theta <= 0)
+    return std::nullopt;
+  float pdf = pmf * static_cast<float>(_width * _height) /
+              (2 * static_cast<float>(M_PI * M_PI) * sin_theta);
+  return EnvironmentSample{from_uv(uv), lookup(uv), pdf};
+}
+
+float EnvironmentMap::pdf(glm::vec3 direction) const {
+  glm::vec2 uv = to_uv(direction);
+  float sin_theta = std::sin(uv.y * static_cast<float>(M_PI));
+  if (_distribution.empty() || sin_theta <= 0)
+    return 0;
+
+  size_t x = std::min(static_cast<size_t>(uv.x * _width), _width - 1);
+  size_t y = std::min(static_cast<size_t>(uv.y * _height), _height - 1);
+  return _distribution.pmf(static_cast<uint32_t>(y * _width + x)) *
+         static_cast<float>(_width * _height) /
+         (2 * static_cast<float>(M_PI * M_PI) * sin_theta);
+}
@@ -1,13 +1,42 @@
 #pragma once
 
 #include "types.h"
+#include "utils/AliasTable.h"
 
-class IBackground {
+#include <filesystem>
+#include <variant>
+
+// Radiance coming from the direction of the missed rays. The backgrounds are
+// concrete types gathered in the Background variant : Scene::get_background
+// dispatches on its index, and each get_value is a direct call that can be
+// inlined, without virtual call or std::function for the built-in ones.
+
+class SolidBackground {
+public:
+  SolidBackground(Color color = BLACK) : _color(color) {}
+
+  Color get_value(Ray ray) const { return _color; }
+
+private:
+  Color _color;
+};
+
+// Vertical blend, from `bottom` (looking down) to `top` (looking up)
+class GradientBackground {
 public:
-  virtual Color get_value(Ray ray) = 0;
+  GradientBackground(Color bottom, Color top) : _bottom(bottom), _top(top) {}
+
+  Color get_value(Ray ray) const {
+    float a = 0.5f * (glm::normalize(ray.direction).y + 1);
+    return _bottom + a * (_top - _bottom);
+  }
+
+private:
+  Color _bottom, _top;
 };
 
-class FuncBackground : public IBackground {
+// Any function of the ray, through a std::function
+class FuncBackground {
   using ColorFunc = std::function<Color(Ray)>;
 
 public:
@@ -15,9 +44,105 @@ public:
       : _backgroudFunction(std::move(backgroud_function)) {}
   FuncBackground() : FuncBackground(BlackBackground) {}
 
+  Color get_value(Ray ray) const { return _backgroudFunction(ray); }
+
 private:
   ColorFunc _backgroudFunction;
 
   // constants func
   static Color BlackBackground(Ray r) { return BLACK; };
-};
\ No newline at end of file
+};
+
+// Direction toward the environment map, drawn by importance
+struct EnvironmentSample {
+  glm::vec3 direction; // unit
+  Color radiance;
+  float pdf; // solid angle
+};
+
+// HDR latitude-longitude (equirectangular) image around the scene : +y is
+// up, the image top row, and u turns around y starting from -z. Lookups are
+// bilinear, wrapping around the azimuth and clamped at the poles.
+//
+// A precomputed alias table over the texels, weighted by the luminance of
+// their bilinear footprint times sin(theta) (their solid angle), importance
+// samples the bright regions in O(1) for next event estimation. Every
+// direction of non zero radiance has a non zero pdf.
+class EnvironmentMap {
+public:
+  // -- Constructors
+  // texels : width * height, row major from the top
+  EnvironmentMap(size_t width, size_t height, std::vector<Color> &&texels,
+                 float scale = 1);
+
+  // .hdr (or any stb_image format), nullopt (and a warning) on errors
+  static std::optional<EnvironmentMap>
+  load(const std::filesystem::path &path, float scale = 1);
+
+  NO_COPY(EnvironmentMap);
+
+  EnvironmentMap(EnvironmentMap &&other) = default;
+  EnvironmentMap &operator=(EnvironmentMap &&other) = default;
+
+  // -- Methods
+  Color get_value(Ray ray) const { return lookup(to_uv(ray.direction)); }
+
+  // Texel picked with u_pick, then a uniform point in it with u_texel.
+  // nullopt for a black map.
+  std::optional<EnvironmentSample> sample(float u_pick,
+                                          glm::vec2 u_texel) const;
+  // solid angle pdf of sample() for a direction
+  float pdf(glm::vec3 direction) const;
+
+  // bilinear, uv in [0, 1]^2
+  Color lookup(glm::vec2 uv) const {
+    float x = uv.x * static_cast<float>(_width) - 0.5f;
+    float y = uv.y * static_cast<float>(_height) - 0.5f;
+    float x_floor = std::floor(x);
+    float y_floor = std::floor(y);
+    float tx = x - x_floor;
+    float ty = y - y_floor;
+
+    // x_floor >= -1 : one width added keeps the modulo positive
+    int width = static_cast<int>(_width);
+    int height = static_cast<int>(_height);
+    int x0 = (static_cast<int>(x_floor) + width) % width;
+    int x1 = (x0 + 1) % width;
+    int y0 = std::clamp(static_cast<int>(y_floor), 0, height - 1);
+    int y1 = std::clamp(static_cast<int>(y_floor) + 1, 0, height - 1);
+
+    const Color *row0 = &_texels[static_cast<size_t>(y0) * _width];
+    const Color *row1 = &_texels[static_cast<size_t>(y1) * _width];
+    Color top = row0[x0] + tx * (row0[x1] - row0[x0]);
+    Color bottom = row1[x0] + tx * (row1[x1] - row1[x0]);
+    return top + ty * (bottom - top);
+  }
+
+  static glm::vec2 to_uv(glm::vec3 direction) {
+    glm::vec3 d = glm::normalize(direction);
+    float u = 0.5f + std::atan2(d.x, -d.z) * (0.5f / static_cast<float>(M_PI));
+    float v = std::acos(std::clamp(d.y, -1.f, 1.f)) / static_cast<float>(M_PI);
+    return {u, v};
+  }
+
+  static glm::vec3 from_uv(glm::vec2 uv) {
+    float phi = (uv.x - 0.5f) * 2 * static_cast<float>(M_PI);
+    float theta = uv.y * static_cast<float>(M_PI);
+    float sin_theta = std::sin(theta);
+    return {sin_theta * std::sin(phi), std::cos(theta),
+            -sin_theta * std::cos(phi)};
+  }
+
+  // -- Getters
+  size_t get_width() const { return _width; }
+  size_t get_height() const { return _height; }
+
+private:
+  // -- Members
+  size_t _width, _height;
+  std::vector<Color> _texels;
+  AliasTable _distribution;
+};
+
+using Background = std::variant<SolidBackground, GradientBackground,
+                                EnvironmentMap, FuncBackground>;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.h"
+#include "utils/Sampler.h"
 
 struct Camera {
   float aspectRatio = 1.0;
@@ -22,8 +23,9 @@ struct Camera {
     glm::vec3 viewport_uper_left;
     glm::vec3 px00_loc;
 
-    glm::vec3 defocus_disk_sample() const {
-      glm::vec2 p = random_in_unit_disk();
+    // u : uniform sample in [0, 1)^2
+    glm::vec3 defocus_disk_sample(glm::vec2 u) const {
+      glm::vec2 p = sample_unit_disk(u);
       return center + (p.x * defocus_disk_u) + (p.y * defocus_disk_v);
     }
   };
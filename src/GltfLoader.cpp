@@ -0,0 +1,209 @@
+#include "GltfLoader.h"
+
+#include <fastgltf/core.hpp>
+#include <fastgltf/glm_element_traits.hpp>
+#include <fastgltf/tools.hpp>
+
+namespace {
+
+glm::mat4 to_glm(const fastgltf::math::fmat4x4 &matrix) {
+  glm::mat4 result;
+  for (int col = 0; col < 4; col++)
+    for (int row = 0; row < 4; row++)
+      result[col][row] = matrix[col][row];
+  return result;
+}
+
+// POSITION accessor of a triangle primitive, nullptr for the others
+const fastgltf::Accessor *triangle_positions(const fastgltf::Asset &asset,
+                                             const fastgltf::Primitive &prim) {
+  auto position = prim.findAttribute("POSITION");
+  if (prim.type != fastgltf::PrimitiveType::Triangles ||
+      position == prim.attributes.end())
+    return nullptr;
+  return &asset.accessors[position->accessorIndex];
+}
+
+size_t triangle_count(const fastgltf::Asset &asset,
+                      const fastgltf::Primitive &prim,
+                      const fastgltf::Accessor &positions) {
+  size_t index_count = prim.indicesAccessor
+                           ? asset.accessors[*prim.indicesAccessor].count
+                           : positions.count;
+  return index_count / 3;
+}
+
+// The arrays are sized from the accessors first, then every accessor is
+// copied once, in place. nullopt (and a warning) for the meshes without
+// triangles, or with indices past their vertices.
+std::optional<TriangleMesh> load_mesh(fastgltf::Asset &asset,
+                                      size_t mesh_index,
+                                      BvhBuildOptions options,
+                                      const MeshCache *cache) {
+  const fastgltf::Mesh &mesh = asset.meshes[mesh_index];
+  size_t vertex_count = 0;
+  size_t tri_count = 0;
+  bool has_normals = true;
+  for (const fastgltf::Primitive &prim : mesh.primitives) {
+    const fastgltf::Accessor *positions = triangle_positions(asset, prim);
+    if (!positions)
+      continue;
+    vertex_count += positions->count;
+    tri_count += triangle_count(asset, prim, *positions);
+    has_normals &= prim.findAttribute("NORMAL") != prim.attributes.end();
+  }
+  // an empty mesh has no bounding box to build a bvh on
+  if (tri_count == 0) {
+    LOGWARN("glTF mesh {} has no triangles, skipped", mesh_index);
+    return std::nullopt;
+  }
+
+  std::vector<glm::vec3> positions(vertex_count);
+  std::vector<glm::vec3> normals(has_normals ? vertex_count : 0);
+  std::vector<TriangleMesh::Triangle> triangles(tri_count);
+
+  size_t vertex_base = 0;
+  size_t tri_base = 0;
+  for (const fastgltf::Primitive &prim : mesh.primitives) {
+    const fastgltf::Accessor *prim_positions = triangle_positions(asset, prim);
+    if (!prim_positions)
+      continue;
+
+    fastgltf::copyFromAccessor<glm::vec3>(asset, *prim_positions,
+                                          positions.data() + vertex_base);
+    if (has_normals) {
+      auto normal = prim.findAttribute("NORMAL");
+      fastgltf::copyFromAccessor<glm::vec3>(
+          asset, asset.accessors[normal->accessorIndex],
+          normals.data() + vertex_base);
+    }
+
+    TriangleMesh::Triangle *prim_triangles = triangles.data() + tri_base;
+    size_t prim_tri_count = triangle_count(asset, prim, *prim_positions);
+    uint32_t base = static_cast<uint32_t>(vertex_base);
+    if (prim.indicesAccessor) {
+      // u8 / u16 / u32 indices, rebased on the merged vertices
+      bool indices_valid = true;
+      fastgltf::iterateAccessorWithIndex<uint32_t>(
+          asset, asset.accessors[*prim.indicesAccessor],
+          [&](uint32_t index, size_t i) {
+            indices_valid &= index < prim_positions->count;
+            if (i < prim_tri_count * 3)
+              prim_triangles[i / 3][i % 3] = base + index;
+          });
+      if (!indices_valid) {
+        LOGWARN("glTF mesh {} has indices past its vertices, skipped",
+                mesh_index);
+        return std::nullopt;
+      }
+    } else {
+      for (uint32_t i = 0; i < prim_tri_count * 3; i++)
+        prim_triangles[i / 3][i % 3] = base + i;
+    }
+
+    vertex_base += prim_positions->count;
+    tri_base += prim_tri_count;
+  }
+
+  if (cache)
+    return cache->get_or_build(std::move(positions), std::move(triangles),
+                               std::move(normals), options);
+  return TriangleMesh(std::move(positions), std::move(triangles),
+                      std::move(normals), options);
+}
+
+} // namespace
+
+std::optional<GltfScene> load_gltf(const std::filesystem::path &path,
+                                   BvhBuildOptions options /* = {} */,
+                                   const MeshCache *cache /* = nullptr */) {
+  auto data = fastgltf::GltfDataBuffer::FromPath(path);
+  if (data.error() != fastgltf::Error::None) {
+    LOGWARN("Could not read {} : {}", path.string(),
+            fastgltf::getErrorMessage(data.error()));
+    return std::nullopt;
+  }
+
+  fastgltf::Parser parser;
+  auto asset = parser.loadGltf(data.get(), path.parent_path(),
+                               fastgltf::Options::LoadExternalBuffers);
+  if (asset.error() != fastgltf::Error::None) {
+    LOGWARN("Could not parse {} : {}", path.string(),
+            fastgltf::getErrorMessage(asset.error()));
+    return std::nullopt;
+  }
+
+  // the skipped meshes are left out, with their instances
+  GltfScene scene;
+  std::vector<std::optional<uint32_t>> scene_meshes;
+  scene.meshes.reserve(asset->meshes.size());
+  for (size_t i = 0; i < asset->meshes.size(); i++) {
+    std::optional<TriangleMesh> mesh =
+        load_mesh(asset.get(), i, options, cache);
+    scene_meshes.push_back(std::nullopt);
+    if (!mesh)
+      continue;
+    scene_meshes.back() = static_cast<uint32_t>(scene.meshes.size());
+    scene.meshes.push_back(std::move(*mesh));
+  }
+
+  if (asset->scenes.empty()) {
+    // no node hierarchy : every mesh once, untransformed
+    for (uint32_t i = 0; i < scene.meshes.size(); i++)
+      scene.instances.push_back({i, glm::mat4(1.f)});
+  } else {
+    size_t scene_index = asset->defaultScene.value_or(0);
+    fastgltf::iterateSceneNodes(
+        asset.get(), scene_index, fastgltf::math::fmat4x4(),
+        [&](fastgltf::Node &node, fastgltf::math::fmat4x4 matrix) {
+          if (node.meshIndex && scene_meshes[*node.meshIndex])
+            scene.instances.push_back(
+                {*scene_meshes[*node.meshIndex], to_glm(matrix)});
+        });
+  }
+
+  LOG(FINE, "{} loaded : {} meshes, {} instances", path.string(),
+      scene.meshes.size(), scene.instances.size());
+  return scene;
+}
+
+std::vector<TriangleMesh> flatten_gltf(const GltfScene &scene,
+                                       BvhBuildOptions options /* = {} */) {
+  std::vector<TriangleMesh> result;
+  result.reserve(scene.instances.size());
+  for (const GltfMeshInstance &instance : scene.instances) {
+    const TriangleMesh &mesh = scene.meshes[instance.mesh];
+    glm::mat3 normal_matrix =
+        glm::transpose(glm::inverse(glm::mat3(instance.transform)));
+
+    std::vector<glm::vec3> positions;
+    positions.reserve(mesh.get_vertex_count());
+    for (glm::vec3 position : mesh.get_positions())
+      positions.push_back(
+          glm::vec3(instance.transform * glm::vec4(position, 1.f)));
+
+    std::vector<glm::vec3> normals;
+    normals.reserve(mesh.get_normals().size());
+    for (glm::vec3 normal : mesh.get_normals())
+      normals.push_back(glm::normalize(normal_matrix * normal));
+
+    std::vector<TriangleMesh::Triangle> triangles(
+        mesh.get_triangles().begin(), mesh.get_triangles().end());
+    result.emplace_back(std::move(positions), std::move(triangles),
+                        std::move(normals), options);
+  }
+  return result;
+}
+
+std::vector<MeshInstance> instance_gltf(GltfScene &&scene) {
+  std::vector<std::shared_ptr<const TriangleMesh>> meshes;
+  meshes.reserve(scene.meshes.size());
+  for (TriangleMesh &mesh : scene.meshes)
+    meshes.push_back(std::make_shared<const TriangleMesh>(std::move(mesh)));
+
+  std::vector<MeshInstance> result;
+  result.reserve(scene.instances.size());
+  for (const GltfMeshInstance &instance : scene.instances)
+    result.emplace_back(meshes[instance.mesh], instance.transform);
+  return result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "hittables/MeshCache.h"
+#include "hittables/MeshInstance.h"
+#include "hittables/TriangleMesh.h"
+#include "types.h"
+
+#include <filesystem>
+#include <glm/glm.hpp>
+
+struct GltfMeshInstance {
+  uint32_t mesh; // index in GltfScene::meshes
+  glm::mat4 transform; // object to world
+};
+
+// Triangles of a glTF file : one TriangleMesh per glTF mesh (its triangle
+// primitives merged), in its object space, and the nodes of the default
+// scene that use them.
+struct GltfScene {
+  std::vector<TriangleMesh> meshes;
+  std::vector<GltfMeshInstance> instances;
+};
+
+// .gltf or .glb, with external buffers. The accessors are read straight in
+// the TriangleMesh arrays. With a cache, the meshes built by a previous run
+// are mapped instead of rebuilt. The meshes without triangles, or with
+// indices past their vertices, are skipped with their instances (and a
+// warning). Returns nullopt (and a warning) on reading or parsing errors.
+std::optional<GltfScene> load_gltf(const std::filesystem::path &path,
+                                   BvhBuildOptions options = {},
+                                   const MeshCache *cache = nullptr);
+
+// One world space mesh per instance, for the acceleration structures that
+// don't handle transforms
+std::vector<TriangleMesh> flatten_gltf(const GltfScene &scene,
+                                       BvhBuildOptions options = {});
+
+// One MeshInstance per instance, sharing the scene meshes (moved out of it),
+// for an InstanceBvh
+std::vector<MeshInstance> instance_gltf(GltfScene &&scene);
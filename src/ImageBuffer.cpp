@@ -2,8 +2,17 @@
 #include "graphics/Buffer.h"
 #include "graphics/Image.h"
 #include "graphics/vulkan_context.h"
+#include "utils/ThreadPool.h"
+#include "utils/curves.h"
+#include "utils/half.h"
+#include "utils/png.h"
+#include "utils/simd.h"
+#include <array>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <volk.h>
 
 #ifdef NDEBUG
@@ -18,37 +27,190 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
-constexpr size_t MAX_COLOR_SIZE = 4;
-
 uint8_t floatnorm_to_unorm(float t) {
   if (std::isnan(t) || t < 0.)
     t = 0;
   return static_cast<uint8_t>(std::min(t, 1.f) * 255);
 }
 
-size_t color_to_format(Color color, ImgFormat format,
-                       std::array<uint8_t, MAX_COLOR_SIZE> *written_color) {
+// writes format_size(format) bytes at dst
+void color_to_format(Color color, ImgFormat format, uint8_t *dst) {
   switch (format) {
+  case RGBA32F: /* = VK_FORMAT_R32G32B32A32_SFLOAT */
+    std::memcpy(dst, &color[0], sizeof(Color));
+    break;
+  case RGBA16F: { /* = VK_FORMAT_R16G16B16A16_SFLOAT */
+    std::array<uint16_t, 4> half = {
+        float_to_half(color[0]), float_to_half(color[1]),
+        float_to_half(color[2]), float_to_half(color[3])};
+    std::memcpy(dst, half.data(), sizeof(half));
+    break;
+  }
   case RGBA: /*  = VK_FORMAT_R8G8B8A8_UNORM */
-    written_color->at(0) = floatnorm_to_unorm(color[0]);
-    written_color->at(1) = floatnorm_to_unorm(color[1]);
-    written_color->at(2) = floatnorm_to_unorm(color[2]);
-    written_color->at(3) = floatnorm_to_unorm(color[3]);
+    dst[0] = floatnorm_to_unorm(color[0]);
+    dst[1] = floatnorm_to_unorm(color[1]);
+    dst[2] = floatnorm_to_unorm(color[2]);
+    dst[3] = floatnorm_to_unorm(color[3]);
     break;
   case RGB: /*  = VK_FORMAT_R8G8B8_UNORM */
-    written_color->at(0) = floatnorm_to_unorm(color[0] * color[3]);
-    written_color->at(1) = floatnorm_to_unorm(color[1] * color[3]);
-    written_color->at(2) = floatnorm_to_unorm(color[2] * color[3]);
+    dst[0] = floatnorm_to_unorm(color[0] * color[3]);
+    dst[1] = floatnorm_to_unorm(color[1] * color[3]);
+    dst[2] = floatnorm_to_unorm(color[2] * color[3]);
     break;
 
   case R:     /*  = VK_FORMAT_R8_UNORM */
   case DEPTH: /* = VK_FORMAT_D32_SFLOAT */
   default:
-    written_color->at(0) =
+    dst[0] =
         floatnorm_to_unorm(((color[0] + color[1] + color[2]) / 3.f) * color[3]);
     break;
   }
-  return format_size(format);
+}
+
+// Shared by the parallel encoders of every image, its threads sleep between
+// two writes
+ThreadPool &encoding_pool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+// -- Bulk conversions --
+
+// The kernels give the same bytes as color_to_format : truncated UNORM,
+// NaN and negatives to 0, half floats rounded to the nearest even (the NaN
+// payloads aside).
+
+static void floats_to_unorm_scalar(const float *src, size_t count,
+                                   uint8_t *dst) {
+  for (size_t i = 0; i < count; i++)
+    dst[i] = floatnorm_to_unorm(src[i]);
+}
+
+static void floats_to_half_scalar(const float *src, size_t count,
+                                  uint8_t *dst) {
+  for (size_t i = 0; i < count; i++) {
+    uint16_t half = float_to_half(src[i]);
+    std::memcpy(dst + i * sizeof(uint16_t), &half, sizeof(uint16_t));
+  }
+}
+
+#ifdef RTVK_X86
+
+// 32 floats per iteration, packed down to bytes in 3 instructions
+RTVK_TARGET("avx2,fma")
+static void floats_to_unorm_avx2(const float *src, size_t count,
+                                 uint8_t *dst) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1);
+  const __m256 scale = _mm256_set1_ps(255);
+  // the packs work per 128 bits lane, this puts the dwords back in order
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    __m256i unorm[4];
+    for (int k = 0; k < 4; k++) {
+      __m256 value = _mm256_loadu_ps(src + i + 8 * k);
+      // max returns its second operand on NaN
+      value = _mm256_min_ps(_mm256_max_ps(value, zero), one);
+      unorm[k] = _mm256_cvttps_epi32(_mm256_mul_ps(value, scale));
+    }
+    __m256i words01 = _mm256_packus_epi32(unorm[0], unorm[1]);
+    __m256i words23 = _mm256_packus_epi32(unorm[2], unorm[3]);
+    __m256i bytes = _mm256_permutevar8x32_epi32(
+        _mm256_packus_epi16(words01, words23), order);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), bytes);
+  }
+  floats_to_unorm_scalar(src + i, count - i, dst + i);
+}
+
+// F16C comes with every AVX2 cpu
+RTVK_TARGET("avx2,fma,f16c")
+static void floats_to_half_avx2(const float *src, size_t count,
+                                uint8_t *dst) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * sizeof(uint16_t)),
+                     _mm256_cvtps_ph(_mm256_loadu_ps(src + i),
+                                     _MM_FROUND_TO_NEAREST_INT));
+  floats_to_half_scalar(src + i, count - i, dst + i * sizeof(uint16_t));
+}
+
+#endif
+
+void colors_to_format(std::span<const Color> colors, ImgFormat format,
+                      uint8_t *dst) {
+  if (colors.empty())
+    return;
+  const float *src = &colors[0][0];
+  size_t count = colors.size() * 4;
+  [[maybe_unused]] bool avx2 = cpu_supports(SimdLevel::Avx2);
+
+  switch (format) {
+  case RGBA32F:
+    std::memcpy(dst, src, colors.size_bytes());
+    return;
+  case RGBA16F:
+#ifdef RTVK_X86
+    if (avx2)
+      return floats_to_half_avx2(src, count, dst);
+#endif
+    return floats_to_half_scalar(src, count, dst);
+  case RGBA:
+#ifdef RTVK_X86
+    if (avx2)
+      return floats_to_unorm_avx2(src, count, dst);
+#endif
+    return floats_to_unorm_scalar(src, count, dst);
+  default: // channels mixed with alpha, pixel by pixel
+    size_t pixel_size = format_size(format);
+    for (Color color : colors) {
+      color_to_format(color, format, dst);
+      dst += pixel_size;
+    }
+    return;
+  }
+}
+
+Color format_to_color(const uint8_t *data, ImgFormat format) {
+  switch (format) {
+  case RGBA32F: {
+    Color color;
+    std::memcpy(&color[0], data, sizeof(Color));
+    return color;
+  }
+  case RGBA16F: {
+    std::array<uint16_t, 4> half;
+    std::memcpy(half.data(), data, sizeof(half));
+    return {half_to_float(half[0]), half_to_float(half[1]),
+            half_to_float(half[2]), half_to_float(half[3])};
+  }
+  case RGBA:
+    return Color(data[0], data[1], data[2], data[3]) / 255.f;
+  case RGB:
+    return {data[0] / 255.f, data[1] / 255.f, data[2] / 255.f, 1};
+  case R:
+  case DEPTH:
+  default:
+    return {data[0] / 255.f, data[0] / 255.f, data[0] / 255.f, 1};
+  }
+}
+
+// Portable float map : text header, then the rows bottom first. A negative
+// scale tells little endian floats.
+int write_pfm(const char *filename, size_t width, size_t height,
+              std::span<const float> rgb) {
+  std::FILE *file = std::fopen(filename, "wb");
+  if (!file)
+    return 0;
+
+  const char *scale =
+      std::endian::native == std::endian::little ? "-1.0" : "1.0";
+  bool ok = std::fprintf(file, "PF\n%zu %zu\n%s\n", width, height, scale) > 0;
+  for (size_t y = height; ok && y-- > 0;)
+    ok = std::fwrite(rgb.data() + y * width * 3, sizeof(float), width * 3,
+                     file) == width * 3;
+  return std::fclose(file) == 0 && ok;
 }
 
 // -- Image buffer impl --
@@ -56,10 +218,16 @@ size_t color_to_format(Color color, ImgFormat format,
 // -- Constructors
 
 ImageBuffer::ImageBuffer(size_t width, size_t height,
-                         ImgFormat format /*= ColorFormat::RGBA */)
-    : _width(width), _heigth(height), _format(format) {
+                         ImgFormat format /*= ColorFormat::RGBA */,
+                         PixelLayout layout /* = PixelLayout::Linear */)
+    : _width(width), _heigth(height), _format(format), _layout(layout),
+      _tilesX((width + TILE_SIZE - 1) / TILE_SIZE) {
   size_t pixel_size = format_size(format);
   size_t buffer_size = pixel_size * width * height;
+  // the tiled layouts are padded to whole tiles
+  if (layout != PixelLayout::Linear)
+    buffer_size = pixel_size * _tilesX * TILE_SIZE *
+                  ((height + TILE_SIZE - 1) / TILE_SIZE) * TILE_SIZE;
 
   _imgData.resize(buffer_size);
 }
@@ -67,44 +235,180 @@ ImageBuffer::ImageBuffer(size_t width, size_t height,
 // -- Methods
 
 void ImageBuffer::write_pixel(size_t px, size_t py, Color color) {
-  size_t buffer_pos = (px + _width * py) * format_size(_format);
-  std::array<uint8_t, MAX_COLOR_SIZE> formated_color;
-  size_t format_size = color_to_format(color, _format, &formated_color);
+  size_t buffer_pos = pixel_index(px, py) * format_size(_format);
+  color_to_format(color, _format, _imgData.data() + buffer_pos);
+}
 
-  for (size_t i = 0; i < format_size; i++)
-    _imgData[buffer_pos + i] = formated_color[i];
+void ImageBuffer::write_row(size_t px, size_t py,
+                            std::span<const Color> colors) {
+  if (py >= _heigth || px + colors.size() > _width)
+    LOGERR("row of {} pixels at ({}, {}) out of the {}x{} image",
+           colors.size(), px, py, _width, _heigth);
+
+  size_t pixel_size = format_size(_format);
+  if (_layout == PixelLayout::Linear) {
+    size_t buffer_pos = (px + _width * py) * pixel_size;
+    return colors_to_format(colors, _format, _imgData.data() + buffer_pos);
+  }
+
+  // converted by runs of pixels in the same tile row, the Morton ones are
+  // then scattered
+  std::array<uint8_t, TILE_SIZE * sizeof(Color)> run;
+  for (size_t x = px; x < px + colors.size();) {
+    size_t count = std::min(TILE_SIZE - x % TILE_SIZE, px + colors.size() - x);
+    std::span<const Color> run_colors = colors.subspan(x - px, count);
+    if (_layout == PixelLayout::Tiled) {
+      colors_to_format(run_colors, _format,
+                       _imgData.data() + pixel_index(x, py) * pixel_size);
+    } else {
+      colors_to_format(run_colors, _format, run.data());
+      for (size_t i = 0; i < count; i++)
+        std::memcpy(_imgData.data() + pixel_index(x + i, py) * pixel_size,
+                    run.data() + i * pixel_size, pixel_size);
+    }
+    x += count;
+  }
+}
+
+void ImageBuffer::write_tile(size_t px, size_t py, size_t tile_width,
+                             std::span<const Color> colors) {
+  if (tile_width == 0)
+    return;
+  size_t tile_height = colors.size() / tile_width;
+  if (colors.size() % tile_width != 0 || px + tile_width > _width ||
+      py + tile_height > _heigth)
+    LOGERR("tile of {} pixels, {} wide, at ({}, {}) doesn't fit the {}x{} "
+           "image",
+           colors.size(), tile_width, px, py, _width, _heigth);
+
+  // full rows are contiguous
+  if (tile_width == _width && _layout == PixelLayout::Linear) {
+    size_t buffer_pos = _width * py * format_size(_format);
+    return colors_to_format(colors, _format, _imgData.data() + buffer_pos);
+  }
+  for (size_t y = 0; y < tile_height; y++)
+    write_row(px, py + y, colors.subspan(y * tile_width, tile_width));
+}
+
+Color ImageBuffer::read_pixel(size_t px, size_t py) const {
+  size_t buffer_pos = pixel_index(px, py) * format_size(_format);
+  return format_to_color(_imgData.data() + buffer_pos, _format);
 }
 
 int ImageBuffer::write_on_disk(const char *filename, ImageFormat img_format,
                                uint8_t jpg_quality /* = 8 */) const {
   int iwidth = static_cast<int>(_width);
   int iheigth = static_cast<int>(_heigth);
-  int iformat_size = static_cast<int>(format_size(_format));
+  if (img_format == HDR) {
+    // RGBE has no sign (nor NaN)
+    std::vector<float> rgb = to_rgb_float();
+    for (float &value : rgb)
+      value = value > 0 ? value : 0;
+    return stbi_write_hdr(filename, iwidth, iheigth, 3, rgb.data());
+  }
+  if (img_format == PFM)
+    return write_pfm(filename, _width, _heigth, to_rgb_float());
+
+  // the 8 bits writers take RGBA rows for the HDR formats
+  std::vector<uint8_t> storage;
+  if (is_hdr_format(_format))
+    storage = to_unorm();
+  const uint8_t *data = is_hdr_format(_format) ? storage.data()
+                                               : linear_data(storage).data();
+  int iformat_size =
+      is_hdr_format(_format) ? 4 : static_cast<int>(format_size(_format));
 
   switch (img_format) {
   case PNG:
-    return stbi_write_png(filename, iwidth, iheigth, iformat_size,
-                          _imgData.data(), 0);
+    return write_png(filename, {data, _width * _heigth * iformat_size},
+                     _width, _heigth, iformat_size, &encoding_pool());
   case BMP:
-    return stbi_write_bmp(filename, iwidth, iheigth, iformat_size,
-                          _imgData.data());
+    return stbi_write_bmp(filename, iwidth, iheigth, iformat_size, data);
   case TGA:
-    return stbi_write_tga(filename, iwidth, iheigth, iformat_size,
-                          _imgData.data());
-  // case HDR:
-  // todo
+    return stbi_write_tga(filename, iwidth, iheigth, iformat_size, data);
   case JPG:
   default:
-    return stbi_write_jpg(filename, iwidth, iheigth, iformat_size,
-                          _imgData.data(), jpg_quality);
+    return stbi_write_jpg(filename, iwidth, iheigth, iformat_size, data,
+                          jpg_quality);
   }
 }
 
+std::vector<uint8_t> ImageBuffer::to_linear() const {
+  std::vector<uint8_t> linear;
+  std::span<const uint8_t> data = linear_data(linear);
+  if (linear.empty())
+    linear.assign(data.begin(), data.end());
+  return linear;
+}
+
+size_t ImageBuffer::pixel_index(size_t px, size_t py) const {
+  if (_layout == PixelLayout::Linear)
+    return px + _width * py;
+
+  size_t tile = (py / TILE_SIZE) * _tilesX + px / TILE_SIZE;
+  uint32_t x = static_cast<uint32_t>(px % TILE_SIZE);
+  uint32_t y = static_cast<uint32_t>(py % TILE_SIZE);
+  size_t in_tile =
+      _layout == PixelLayout::Tiled ? y * TILE_SIZE + x : morton_encode(x, y);
+  return tile * TILE_SIZE * TILE_SIZE + in_tile;
+}
+
+void ImageBuffer::for_each_run(
+    const std::function<void(size_t, size_t, size_t)> &func) const {
+  size_t pixel_size = format_size(_format);
+  // the tile rows of the Tiled layout are contiguous, Morton goes pixel by
+  // pixel
+  size_t run_size = _layout == PixelLayout::Morton ? 1 : TILE_SIZE;
+  for (size_t y = 0; y < _heigth; y++)
+    for (size_t x = 0; x < _width; x += run_size) {
+      size_t count = std::min(run_size, _width - x);
+      func((x + y * _width) * pixel_size, pixel_index(x, y) * pixel_size,
+           count * pixel_size);
+    }
+}
+
+std::span<const uint8_t>
+ImageBuffer::linear_data(std::vector<uint8_t> &storage) const {
+  if (_layout == PixelLayout::Linear)
+    return _imgData;
+
+  storage.resize(_width * _heigth * format_size(_format));
+  for_each_run([&](size_t linear, size_t stored, size_t bytes) {
+    std::memcpy(storage.data() + linear, _imgData.data() + stored, bytes);
+  });
+  return storage;
+}
+
+std::vector<float> ImageBuffer::to_rgb_float() const {
+  std::vector<float> rgb;
+  rgb.reserve(_width * _heigth * 3);
+  for (size_t y = 0; y < _heigth; y++)
+    for (size_t x = 0; x < _width; x++) {
+      Color color = read_pixel(x, y);
+      rgb.insert(rgb.end(), {color.x, color.y, color.z});
+    }
+  return rgb;
+}
+
+std::vector<uint8_t> ImageBuffer::to_unorm() const {
+  std::vector<uint8_t> unorm;
+  unorm.reserve(_width * _heigth * 4);
+  for (size_t y = 0; y < _heigth; y++)
+    for (size_t x = 0; x < _width; x++) {
+      Color color = read_pixel(x, y);
+      for (int c = 0; c < 4; c++)
+        unorm.push_back(floatnorm_to_unorm(color[c]));
+    }
+  return unorm;
+}
+
+// The HDR formats are uploaded as they are stored, as half or float images
 Image ImageBuffer::write_to_gpu(VulkanContext &ctx) const {
   VkExtent3D extent = {.width = static_cast<uint32_t>(_width),
                        .height = static_cast<uint32_t>(_heigth),
                        .depth = 1};
-  return Image(ctx, _imgData.data(), extent, _format,
+  std::vector<uint8_t> storage;
+  return Image(ctx, linear_data(storage).data(), extent, _format,
                VK_IMAGE_USAGE_SAMPLED_BIT, ImgLayout::General);
 }
 
@@ -151,5 +455,12 @@ void ImageBuffer::read_from_gpu(VulkanContext &ctx, Image &src_image) {
     vkCmdCopyImageToBuffer2(cmd, &copy_info);
   });
 
-  dst_buffer.read(buffer_size, _imgData.data());
+  if (_layout == PixelLayout::Linear)
+    return dst_buffer.read(buffer_size, _imgData.data());
+
+  std::vector<uint8_t> linear(buffer_size);
+  dst_buffer.read(buffer_size, linear.data());
+  for_each_run([&](size_t linear_pos, size_t stored, size_t bytes) {
+    std::memcpy(_imgData.data() + stored, linear.data() + linear_pos, bytes);
+  });
 }
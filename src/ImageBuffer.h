@@ -4,24 +4,48 @@
 #include "types.h"
 
 #include <cstddef>
+#include <functional>
 #include "graphics/Image.h"
 
 enum ImageFormat {
   PNG,
   BMP,
   TGA,
-  // HDR, TODO
+  HDR, // Radiance RGBE
   JPG,
+  PFM, // Portable float map, little endian RGB floats
 };
 
+// Order of the pixels in memory. The tiled layouts store 8x8 pixel tiles
+// contiguously (the image padded to whole tiles), so a tile traversal of the
+// image stays in a few cache lines.
+enum class PixelLayout {
+  Linear, // rows, top first
+  Tiled,  // 8x8 tiles, rows of pixels in the tiles
+  Morton, // 8x8 tiles, Z order in the tiles
+};
+
+// -- Pixel conversions --
+
+// colors.size() pixels of format written contiguously at dst, SIMD for RGBA,
+// RGBA16F and RGBA32F
+void colors_to_format(std::span<const Color> colors, ImgFormat format,
+                      uint8_t *dst);
+// pixel of format stored at data, the UNORM values scaled back to [0, 1]
+Color format_to_color(const uint8_t *data, ImgFormat format);
+
 class ImageBuffer {
 public:
+  static constexpr size_t TILE_SIZE = 8; // of the tiled layouts
+
   ImageBuffer(size_t width, size_t height,
-              ImgFormat format = ImgFormat::RGBA);
+              ImgFormat format = ImgFormat::RGBA,
+              PixelLayout layout = PixelLayout::Linear);
 
   // move constructors
   ImageBuffer(ImageBuffer &&other)
       : _width(other._width), _heigth(other._heigth), _format(other._format),
+        _layout(other._layout), _tilesX(other._tilesX),
         _imgData(std::move(other._imgData)) {}
 
   ImageBuffer &operator=(ImageBuffer &&other) {
@@ -29,6 +53,8 @@ public:
       _width = other._width;
       _heigth = other._heigth;
       _format = other._format;
+      _layout = other._layout;
+      _tilesX = other._tilesX;
       _imgData = std::move(other._imgData);
     }
 
@@ -38,7 +64,20 @@ public:
   NO_COPY(ImageBuffer);
 
   void write_pixel(size_t px, size_t py, Color color);
+  // colors.size() pixels of the row py, from px. Converted in bulk, SIMD for
+  // RGBA, RGBA16F and RGBA32F, to the bytes write_pixel gives.
+  void write_row(size_t px, size_t py, std::span<const Color> colors);
+  // row major tile, tile_width pixels wide, from its top left pixel (px, py)
+  void write_tile(size_t px, size_t py, size_t tile_width,
+                  std::span<const Color> colors);
+  // stored color, the UNORM values scaled back to [0, 1]
+  Color read_pixel(size_t px, size_t py) const;
+
+  // Rows of the image, top first, whatever the layout
+  std::vector<uint8_t> to_linear() const;
 
+  // The 8 bits formats (PNG, BMP, TGA, JPG) clamp the HDR storages, HDR and
+  // PFM keep their values (RGB only). Non zero on success.
   int write_on_disk(const char *filename, ImageFormat format,
                     uint8_t jpg_quality = 8) const;
 
@@ -50,9 +89,29 @@ public:
   size_t get_width() const { return _width; }
   size_t get_height() const { return _heigth; }
   ImgFormat get_format() const {return _format;}
+  PixelLayout get_layout() const { return _layout; }
+  // stored bytes, in the layout order (to_linear gives the rows)
+  std::span<const uint8_t> get_data() const { return _imgData; }
+
+private:
+  // index of the pixel in the storage
+  size_t pixel_index(size_t px, size_t py) const;
+  // contiguous runs of pixels, row after row : func(linear offset, stored
+  // offset, bytes)
+  void for_each_run(
+      const std::function<void(size_t, size_t, size_t)> &func) const;
+  // the data itself for the linear layout, else linearized in storage
+  std::span<const uint8_t> linear_data(std::vector<uint8_t> &storage) const;
+  // RGB floats, top row first
+  std::vector<float> to_rgb_float() const;
+  // 8 bits per channel data of the image, converted from the HDR formats
+  std::vector<uint8_t> to_unorm() const;
 
+  // -- Members
 private:
   size_t _width, _heigth;
   ImgFormat _format;
+  PixelLayout _layout;
+  size_t _tilesX; // tiles per row, for the tiled layouts
   std::vector<uint8_t> _imgData;
 };
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "ImageWriter.h"
+
+// -- ImageWriter impl --
+
+// -- Constructors
+
+ImageWriter::ImageWriter(ImageWriterOptions options /* = {} */)
+    : _options(options) {
+  _options.threadCount = std::max<size_t>(_options.threadCount, 1);
+  _options.maxQueued = std::max<size_t>(_options.maxQueued, 1);
+
+  _workers.reserve(_options.threadCount);
+  for (size_t i = 0; i < _options.threadCount; i++)
+    _workers.emplace_back([this]() { worker_loop(); });
+}
+
+ImageWriter::~ImageWriter() {
+  {
+    std::lock_guard lock(_mutex);
+    _stop = true;
+  }
+  _jobReady.notify_all();
+
+  // the workers empty the queue before leaving
+  for (auto &worker : _workers)
+    worker.join();
+}
+
+// -- Methods
+
+void ImageWriter::write(ImageBuffer &&image, std::string path,
+                        ImageFormat format, uint8_t jpg_quality /* = 8 */) {
+  {
+    std::unique_lock lock(_mutex);
+    _jobTaken.wait(lock,
+                   [this]() { return _queue.size() < _options.maxQueued; });
+    _queue.push_back({std::move(image), std::move(path), format, jpg_quality});
+  }
+  _jobReady.notify_one();
+}
+
+void ImageWriter::flush() {
+  std::unique_lock lock(_mutex);
+  _idle.wait(lock, [this]() { return _queue.empty() && _inFlight == 0; });
+}
+
+size_t ImageWriter::get_queued_count() const {
+  std::lock_guard lock(_mutex);
+  return _queue.size();
+}
+
+size_t ImageWriter::get_written_count() const {
+  std::lock_guard lock(_mutex);
+  return _writtenCount;
+}
+
+size_t ImageWriter::get_failed_count() const {
+  std::lock_guard lock(_mutex);
+  return _failedCount;
+}
+
+// -- private
+
+void ImageWriter::worker_loop() {
+  std::unique_lock lock(_mutex);
+  while (true) {
+    _jobReady.wait(lock, [this]() { return _stop || !_queue.empty(); });
+    if (_queue.empty())
+      return; // stopped, and nothing left to write
+
+    Job job = std::move(_queue.front());
+    _queue.pop_front();
+    _inFlight++;
+    lock.unlock();
+    _jobTaken.notify_one();
+
+    bool written = write_job(std::move(job));
+
+    lock.lock();
+    _inFlight--;
+    written ? _writtenCount++ : _failedCount++;
+    if (_queue.empty() && _inFlight == 0)
+      _idle.notify_all();
+  }
+}
+
+// the image is freed on return, out of the lock
+bool ImageWriter::write_job(Job job) {
+  try {
+    if (job.image.write_on_disk(job.path.c_str(), job.format,
+                                job.jpgQuality) != 0)
+      return true;
+    LOGWARN("Could not write {}", job.path);
+  } catch (const std::exception &error) {
+    LOGWARN("Could not write {} : {}", job.path, error.what());
+  }
+  return false;
+}
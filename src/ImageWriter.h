@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ImageBuffer.h"
+#include "types.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ImageWriterOptions {
+  size_t threadCount = 1; // encoding threads
+  // images waiting for a worker, write() blocks past it
+  size_t maxQueued = 2;
+};
+
+// Encodes and writes images on its own threads, so the render thread can go
+// on with the next frame. The buffers are moved in, and freed once written.
+// A full queue blocks the producer : the frames can't pile up in memory
+// faster than they are encoded.
+class ImageWriter {
+public:
+  ImageWriter(ImageWriterOptions options = {});
+
+  NO_COPY(ImageWriter);
+
+  // writes every queued image first
+  ~ImageWriter();
+
+  // -- Methods
+  // Queues the image for ImageBuffer::write_on_disk, waits while maxQueued
+  // images are already queued. Failures are logged and counted.
+  void write(ImageBuffer &&image, std::string path, ImageFormat format,
+             uint8_t jpg_quality = 8);
+
+  // Waits until every image queued so far is written
+  void flush();
+
+  // -- Getters
+  size_t get_queued_count() const;
+  size_t get_written_count() const;
+  size_t get_failed_count() const;
+
+private:
+  struct Job {
+    ImageBuffer image;
+    std::string path;
+    ImageFormat format;
+    uint8_t jpgQuality;
+  };
+
+  void worker_loop();
+  static bool write_job(Job job);
+
+  // -- Members
+private:
+  ImageWriterOptions _options;
+  std::vector<std::thread> _workers;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _jobReady; // workers wait for a job
+  std::condition_variable _jobTaken; // producers wait for a free slot
+  std::condition_variable _idle;     // flush waits for the last write
+  std::deque<Job> _queue;
+  size_t _inFlight = 0;
+  size_t _writtenCount = 0;
+  size_t _failedCount = 0;
+  bool _stop = false;
+};
@@ -0,0 +1,300 @@
+#include "LightBvh.h"
+
+#include "utils/Sampler.h"
+
+namespace {
+
+constexpr float PI = static_cast<float>(M_PI);
+constexpr float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+// relative to the light radius, and to the bboxes extent
+constexpr float ON_LIGHT_TOLERANCE = 1e-4f;
+
+float safe_sqrt(float x) { return std::sqrt(std::max(x, 0.f)); }
+float safe_acos(float x) { return std::acos(std::clamp(x, -1.f, 1.f)); }
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the angles cos and sin
+float cos_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+  return cos_a > cos_b ? 1 : cos_a * cos_b + sin_a * sin_b;
+}
+float sin_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) {
+  return cos_a > cos_b ? 0 : sin_a * cos_b - cos_a * sin_b;
+}
+
+struct DirectionCone {
+  glm::vec3 w;
+  float cosTheta;
+};
+
+// smallest cone holding both
+DirectionCone cone_union(DirectionCone a, DirectionCone b) {
+  float theta_a = safe_acos(a.cosTheta);
+  float theta_b = safe_acos(b.cosTheta);
+  float theta_d = safe_acos(glm::dot(a.w, b.w));
+  if (std::min(theta_d + theta_b, PI) <= theta_a)
+    return a;
+  if (std::min(theta_d + theta_a, PI) <= theta_b)
+    return b;
+
+  float theta_o = (theta_a + theta_d + theta_b) / 2;
+  glm::vec3 axis = glm::cross(a.w, b.w);
+  if (theta_o >= PI || lenght_sq(axis) == 0)
+    return {a.w, -1}; // every direction
+
+  // a.w rotated by theta_o - theta_a toward b.w (Rodrigues, axis orthogonal
+  // to a.w)
+  float theta_r = theta_o - theta_a;
+  axis = glm::normalize(axis);
+  glm::vec3 w = a.w * std::cos(theta_r) +
+                glm::cross(axis, a.w) * std::sin(theta_r);
+  return {glm::normalize(w), std::cos(theta_o)};
+}
+
+} // namespace
+
+// -- LightBounds impl --
+
+LightBounds LightBounds::from(const SphereLight &light) {
+  // every normal, each one emitting in its hemisphere
+  return {BBox(light.center - light.radius, light.center + light.radius),
+          light.power(), glm::vec3(0, 0, 1), -1, 0};
+}
+
+LightBounds LightBounds::merge(const LightBounds &other) const {
+  if (phi == 0)
+    return other;
+  if (other.phi == 0)
+    return *this;
+
+  DirectionCone cone = cone_union({w, cosThetaO}, {other.w, other.cosThetaO});
+  return {bbox.merge(other.bbox), phi + other.phi, cone.w, cone.cosTheta,
+          std::min(cosThetaE, other.cosThetaE)};
+}
+
+float LightBounds::importance(glm::vec3 p, glm::vec3 n) const {
+  if (phi <= 0)
+    return 0;
+
+  glm::vec3 center = bbox.center();
+  glm::vec3 to_p = p - center;
+  float dist2 = lenght_sq(to_p);
+  float radius2 = lenght_sq(bbox.get_max() - bbox.get_min()) / 4;
+  // inside or close to the bounds : no more growth
+  float clamped_dist2 = std::max(dist2, std::sqrt(radius2));
+
+  glm::vec3 wi = dist2 > 0 ? to_p / std::sqrt(dist2) : w;
+  float cos_w = glm::dot(w, wi);
+  float sin_w = safe_sqrt(1 - cos_w * cos_w);
+
+  // half angle of the bounds bounding sphere, seen from p
+  float cos_b = dist2 < radius2 ? -1 : safe_sqrt(1 - radius2 / dist2);
+  float sin_b = safe_sqrt(1 - cos_b * cos_b);
+
+  // smallest angle between wi and a normal of the cone, widened by the
+  // bounds size
+  float sin_o = safe_sqrt(1 - cosThetaO * cosThetaO);
+  float cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, cosThetaO);
+  float sin_x = sin_sub_clamped(sin_w, cos_w, sin_o, cosThetaO);
+  float cos_p = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+  if (cos_p <= cosThetaE)
+    return 0;
+
+  float importance = phi * cos_p / clamped_dist2;
+  if (n != glm::vec3(0)) {
+    float cos_i = std::abs(glm::dot(wi, n));
+    float sin_i = safe_sqrt(1 - cos_i * cos_i);
+    importance *= cos_sub_clamped(sin_i, cos_i, sin_b, cos_b);
+  }
+  return std::max(importance, 0.f);
+}
+
+// -- LightBvh impl --
+
+// -- Constructors
+
+LightBvh::LightBvh(std::vector<SphereLight> &&lights,
+                   BvhBuildOptions options /* = {} */) {
+  if (lights.empty())
+    return;
+
+  std::vector<BBox> bboxes;
+  bboxes.reserve(lights.size());
+  for (const SphereLight &light : lights)
+    bboxes.emplace_back(light.center - light.radius,
+                        light.center + light.radius);
+
+  // one light per leaf, so a walk down the tree ends on a single light
+  options.maxLeafSize = 1;
+  std::vector<uint32_t> order;
+  _buildStats = BvhBuilder(options).build(bboxes, &_nodes, &order);
+
+  _lights.reserve(lights.size());
+  for (uint32_t index : order)
+    _lights.push_back(lights[index]);
+
+  // children are stored after their parent
+  _bounds.resize(_nodes.size());
+  for (size_t i = _nodes.size(); i-- > 0;) {
+    const BvhNode &node = _nodes[i];
+    _bounds[i] = node.is_leaf() ? LightBounds::from(_lights[node.first])
+                                : _bounds[node.first].merge(
+                                      _bounds[node.first + 1]);
+  }
+
+  _trails.resize(_lights.size());
+  struct Entry {
+    uint32_t node;
+    uint64_t trail;
+    uint32_t depth;
+  };
+  std::vector<Entry> stack = {{0, 0, 0}};
+  while (!stack.empty()) {
+    Entry entry = stack.back();
+    stack.pop_back();
+    const BvhNode &node = _nodes[entry.node];
+    if (node.is_leaf()) {
+      _trails[node.first] = entry.trail;
+      continue;
+    }
+    stack.push_back({node.first, entry.trail, entry.depth + 1});
+    stack.push_back({node.first + 1, entry.trail | (1ull << entry.depth),
+                     entry.depth + 1});
+  }
+
+  LOG(FINE, "light bvh built : {} lights, {} nodes, depth {}", _lights.size(),
+      _nodes.size(), _buildStats.maxDepth);
+}
+
+LightBvh LightBvh::from_spheres(std::span<const Sphere> spheres,
+                                std::span<const Material> materials) {
+  std::vector<SphereLight> lights;
+  for (const Sphere &sphere : spheres) {
+    uint32_t index = sphere.get_material();
+    const Material &material =
+        index < materials.size() ? materials[index] : DEFAULT_MATERIAL;
+    if (material.is_emissive())
+      lights.push_back(
+          {sphere.get_center(), sphere.get_radius(), material.emission});
+  }
+  return LightBvh(std::move(lights));
+}
+
+// -- Methods
+
+std::optional<std::pair<uint32_t, float>>
+LightBvh::pick(glm::vec3 p, glm::vec3 n, float u) const {
+  if (_nodes.empty() || _bounds[0].importance(p, n) <= 0)
+    return std::nullopt;
+
+  uint32_t index = 0;
+  float pmf = 1;
+  while (!_nodes[index].is_leaf()) {
+    const BvhNode &node = _nodes[index];
+    float left = left_probability(node, p, n);
+    if (left < 0)
+      return std::nullopt;
+
+    // u is rescaled to [0, 1) to pick in the child
+    if (u < left) {
+      index = node.first;
+      pmf *= left;
+      u = std::min(u / left, ONE_MINUS_EPSILON);
+    } else {
+      index = node.first + 1;
+      pmf *= 1 - left;
+      u = std::min((u - left) / (1 - left), ONE_MINUS_EPSILON);
+    }
+  }
+  return std::make_pair(_nodes[index].first, pmf);
+}
+
+float LightBvh::pmf(glm::vec3 p, glm::vec3 n, uint32_t light) const {
+  if (light >= _lights.size() || _bounds[0].importance(p, n) <= 0)
+    return 0;
+
+  uint64_t trail = _trails[light];
+  uint32_t index = 0;
+  float pmf = 1;
+  while (!_nodes[index].is_leaf()) {
+    const BvhNode &node = _nodes[index];
+    float left = left_probability(node, p, n);
+    if (left < 0)
+      return 0;
+
+    bool right = trail & 1;
+    trail >>= 1;
+    pmf *= right ? 1 - left : left;
+    index = node.first + right;
+  }
+  return pmf;
+}
+
+std::optional<LightSample> LightBvh::sample(glm::vec3 p, glm::vec3 n,
+                                            float u_pick,
+                                            glm::vec2 u_dir) const {
+  auto picked = pick(p, n, u_pick);
+  if (!picked)
+    return std::nullopt;
+
+  const SphereLight &light = _lights[picked->first];
+  glm::vec3 to_center = light.center - p;
+  float dist2 = lenght_sq(to_center);
+  float radius2 = light.radius * light.radius;
+  if (dist2 <= radius2)
+    return std::nullopt;
+
+  // uniform direction in the cone subtended by the sphere, 1 - cos computed
+  // without cancellation for the small and far lights
+  float dist = std::sqrt(dist2);
+  float sin2_max = radius2 / dist2;
+  float one_minus_cos_max = sin2_max / (1 + safe_sqrt(1 - sin2_max));
+  float one_minus_cos = u_dir.x * one_minus_cos_max;
+  float cos_theta = 1 - one_minus_cos;
+  float sin_theta = safe_sqrt(one_minus_cos * (2 - one_minus_cos));
+  float phi = 2 * PI * u_dir.y;
+  glm::vec3 direction =
+      orthonormal_basis(to_center / dist) *
+      glm::vec3(sin_theta * std::cos(phi), sin_theta * std::sin(phi),
+                cos_theta);
+
+  // nearest intersection with the sphere
+  float h = cos_theta * dist;
+  float distance = h - safe_sqrt(h * h - (dist2 - radius2));
+
+  float pdf = picked->second / (2 * PI * one_minus_cos_max);
+  return LightSample{picked->first, direction, distance, light.emission, pdf};
+}
+
+bool LightBvh::on_light(glm::vec3 p) const {
+  if (_nodes.empty())
+    return false;
+
+  auto near_bbox = [&](const BBox &bbox) {
+    for (size_t axis = 0; axis < 3; axis++) {
+      const Interval &ax = bbox.axis_interval(axis);
+      float tolerance = ON_LIGHT_TOLERANCE * (ax.max - ax.min);
+      if (p[axis] < ax.min - tolerance || p[axis] > ax.max + tolerance)
+        return false;
+    }
+    return true;
+  };
+
+  std::array<uint32_t, BvhBuilder::MAX_DEPTH> stack;
+  size_t stack_size = 0;
+  stack[stack_size++] = 0;
+  while (stack_size != 0) {
+    uint32_t index = stack[--stack_size];
+    if (!near_bbox(_bounds[index].bbox))
+      continue;
+    const BvhNode &node = _nodes[index];
+    if (node.is_leaf()) {
+      const SphereLight &light = _lights[node.first];
+      if (std::abs(glm::length(p - light.center) - light.radius) <=
+          ON_LIGHT_TOLERANCE * light.radius)
+        return true;
+      continue;
+    }
+    stack[stack_size++] = node.first;
+    stack[stack_size++] = node.first + 1;
+  }
+  return false;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Material.h"
+#include "hittables/BvhBuilder.h"
+#include "hittables/Sphere.h"
+#include "types.h"
+
+#include <span>
+
+// Emitting sphere, radiating `emission` from every point of its surface
+struct SphereLight {
+  glm::vec3 center;
+  float radius;
+  Color emission;
+
+  // total emitted power, in luminance
+  float power() const {
+    float area = 4 * static_cast<float>(M_PI) * radius * radius;
+    return luminance(emission) * static_cast<float>(M_PI) * area;
+  }
+};
+
+// Spatial and directional bounds of the lights below a node : their bbox,
+// their power, the cone of their normals (axis w, half angle theta_o) and
+// how far past the normals they emit (theta_e). From Conty Estevez and
+// Kulla (2018), "Importance Sampling of Many Lights with Adaptive Tree
+// Splitting", in the pbrt-v4 formulation.
+struct LightBounds {
+  BBox bbox = BBOX_EMPTY;
+  float phi = 0;
+  glm::vec3 w = {0, 0, 1};
+  float cosThetaO = 1;
+  float cosThetaE = 1;
+
+  static LightBounds from(const SphereLight &light);
+  LightBounds merge(const LightBounds &other) const;
+
+  // Conservative estimate of the light reaching p, on a surface of normal n
+  // (zero vector for none), 0 when no light of the bounds can reach it
+  float importance(glm::vec3 p, glm::vec3 n) const;
+};
+
+// A light picked from a shaded point, and the direction toward it
+struct LightSample {
+  uint32_t light;
+  glm::vec3 direction; // unit
+  float distance;      // to the light surface along direction
+  Color radiance;
+  float pdf; // solid angle pdf, the light choice included
+};
+
+// Bvh over the scene lights, one light per leaf, sampled top down : at each
+// node the child is picked proportionally to the importance of its bounds
+// from the shaded point. Picking a light costs one walk down the tree, so
+// it grows with log(light count) instead of with the light count, and the
+// close and bright lights are favored.
+class LightBvh {
+public:
+  LightBvh(std::vector<SphereLight> &&lights, BvhBuildOptions options = {});
+
+  // every sphere with an emissive material
+  static LightBvh from_spheres(std::span<const Sphere> spheres,
+                               std::span<const Material> materials);
+
+  NO_COPY(LightBvh);
+
+  LightBvh(LightBvh &&other) = default;
+  LightBvh &operator=(LightBvh &&other) = default;
+
+  // -- Methods
+  // Light picked by importance from p, with its probability. u in [0, 1),
+  // nullopt when no light can reach p.
+  std::optional<std::pair<uint32_t, float>> pick(glm::vec3 p, glm::vec3 n,
+                                                 float u) const;
+  // Probability for pick to return `light` from p
+  float pmf(glm::vec3 p, glm::vec3 n, uint32_t light) const;
+
+  // Light picked with u_pick, then a direction uniformly in the cone it
+  // subtends from p, with u_dir. nullopt when p is inside the light.
+  std::optional<LightSample> sample(glm::vec3 p, glm::vec3 n, float u_pick,
+                                    glm::vec2 u_dir) const;
+
+  // True when p is on the surface of a light, up to the hit points rounding :
+  // tells the lights apart from the other emissive surfaces
+  bool on_light(glm::vec3 p) const;
+
+  // -- Getters
+  size_t size() const { return _lights.size(); }
+  bool empty() const { return _lights.empty(); }
+  // in the leaves order, the indices used by pick / pmf / sample
+  std::span<const SphereLight> get_lights() const { return _lights; }
+  const BvhBuildStats &get_build_stats() const { return _buildStats; }
+
+private:
+  // probability to go down the left child of the inner node, -1 when no
+  // child can reach p
+  float left_probability(const BvhNode &node, glm::vec3 p,
+                         glm::vec3 n) const {
+    float left = _bounds[node.first].importance(p, n);
+    float right = _bounds[node.first + 1].importance(p, n);
+    return left + right > 0 ? left / (left + right) : -1;
+  }
+
+  // -- Members
+private:
+  std::vector<SphereLight> _lights;
+  std::vector<BvhNode> _nodes;
+  std::vector<LightBounds> _bounds; // per node
+  // per light, the children taken from the root : bit d set when the right
+  // child is taken at depth d
+  std::vector<uint64_t> _trails;
+  BvhBuildStats _buildStats;
+};
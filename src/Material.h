@@ -0,0 +1,95 @@
+#pragma once
+
+#include "hittables/Hittable.h"
+#include "types.h"
+#include "utils/Sampler.h"
+
+#include <glm/geometric.hpp>
+
+// Outgoing direction of a bounce and the throughput factor of the path, the
+// sampling pdf already divided out
+struct Scatter {
+  glm::vec3 direction;
+  Color attenuation;
+};
+
+// Surface of the path tracer, a small tagged struct so the scene keeps them
+// in one array indexed by HitRecord::material.
+struct Material {
+  enum class Type : uint8_t {
+    DIFFUSE,    // lambertian
+    METAL,      // mirror, blurred by fuzz
+    DIELECTRIC, // glass : reflection or refraction, by the Fresnel term
+  };
+
+  Type type = Type::DIFFUSE;
+  Color albedo = {0.5f, 0.5f, 0.5f, 1};
+  Color emission = {0, 0, 0, 0}; // radiance added when hit
+  float fuzz = 0;                // metal, radius of the reflection jitter
+  float ior = 1.5f;              // dielectric, index of refraction
+
+  // -- Factories
+  static constexpr Material diffuse(Color albedo) {
+    return {.type = Type::DIFFUSE, .albedo = albedo};
+  }
+  static constexpr Material metal(Color albedo, float fuzz = 0) {
+    return {.type = Type::METAL, .albedo = albedo, .fuzz = fuzz};
+  }
+  static constexpr Material dielectric(float ior) {
+    return {.type = Type::DIELECTRIC, .albedo = WHITE, .ior = ior};
+  }
+  // black diffuse surface
+  static constexpr Material light(Color emission) {
+    return {.type = Type::DIFFUSE, .albedo = BLACK, .emission = emission};
+  }
+
+  // -- Methods
+  bool is_emissive() const {
+    return emission.x > 0 || emission.y > 0 || emission.z > 0;
+  }
+
+  // Bounce of a ray coming along in_dir on the hit, u : uniform sample in
+  // [0, 1)^2. nullopt when the path is absorbed.
+  std::optional<Scatter> scatter(glm::vec3 in_dir, const HitRecord &rec,
+                                 glm::vec2 u) const {
+    switch (type) {
+    case Type::DIFFUSE: {
+      glm::vec3 local = sample_cosine_hemisphere(u);
+      return Scatter{orthonormal_basis(rec.normal) * local, albedo};
+    }
+    case Type::METAL: {
+      glm::vec3 reflected = glm::reflect(glm::normalize(in_dir), rec.normal) +
+                            fuzz * sample_unit_sphere(u);
+      if (glm::dot(reflected, rec.normal) <= 0)
+        return std::nullopt; // jittered below the surface
+      return Scatter{glm::normalize(reflected), albedo};
+    }
+    case Type::DIELECTRIC: {
+      float eta = rec.front_face ? 1.f / ior : ior;
+      glm::vec3 unit_dir = glm::normalize(in_dir);
+      float cos_theta = std::min(glm::dot(-unit_dir, rec.normal), 1.f);
+      float sin_theta = std::sqrt(std::max(0.f, 1 - cos_theta * cos_theta));
+
+      // total internal reflection, or reflection picked with the Fresnel
+      // probability : the attenuation stays 1
+      bool reflects = eta * sin_theta > 1 || u.x < schlick(cos_theta, eta);
+      glm::vec3 direction = reflects
+                                ? glm::reflect(unit_dir, rec.normal)
+                                : glm::refract(unit_dir, rec.normal, eta);
+      return Scatter{direction, albedo};
+    }
+    }
+    return std::nullopt;
+  }
+
+private:
+  // Schlick's approximation of the Fresnel reflectance
+  static float schlick(float cosine, float eta) {
+    float r0 = (1 - eta) / (1 + eta);
+    r0 = r0 * r0;
+    float x = 1 - cosine;
+    return r0 + (1 - r0) * x * x * x * x * x;
+  }
+};
+
+inline constexpr Material DEFAULT_MATERIAL = {};
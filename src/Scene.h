@@ -1,15 +1,38 @@
 #pragma once
 
+#include "Background.h"
 #include "Camera.h"
+#include "LightBvh.h"
+#include "Material.h"
 #include "graphics/Buffer.h"
 #include "graphics/vulkan_context.h"
 #include "hittables/Hittable.h"
 #include "types.h"
 
 struct Scene {
-  // - Backgrouds
-  // - Materials
-
   Camera camera;
   std::unique_ptr<IAccStruct> _accStruct;
+
+  // indexed by HitRecord::material, DEFAULT_MATERIAL for the missing ones
+  std::vector<Material> materials;
+  // black by default, an EnvironmentMap is also sampled by next event
+  // estimation
+  Background background;
+  // sampled by next event estimation when not null. The emissive surfaces
+  // left out of it (the meshes) are still found by the bounces.
+  std::unique_ptr<LightBvh> lights;
+
+  const Material &get_material(uint32_t index) const {
+    return index < materials.size() ? materials[index] : DEFAULT_MATERIAL;
+  }
+
+  Color get_background(Ray r) const {
+    return std::visit([r](const auto &bg) { return bg.get_value(r); },
+                      background);
+  }
+
+  // null for the other backgrounds
+  const EnvironmentMap *get_environment() const {
+    return std::get_if<EnvironmentMap>(&background);
+  }
 };
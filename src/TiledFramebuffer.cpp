@@ -0,0 +1,107 @@
+#include "TiledFramebuffer.h"
+#include "utils/png.h"
+
+#include <cstring>
+#include <vector>
+
+// -- TiledFramebuffer impl --
+
+// -- Constructors
+
+std::optional<TiledFramebuffer>
+TiledFramebuffer::create(const std::filesystem::path &directory, size_t width,
+                         size_t height, ImgFormat format /* = RGBA */,
+                         size_t tile_size /* = 64 */) {
+  if (width == 0 || height == 0) {
+    LOGWARN("Empty tiled framebuffer {}x{}", width, height);
+    return std::nullopt;
+  }
+  // 64x64 pixels of at least a byte : every tile starts on a 4 KB page
+  tile_size = std::max<size_t>((tile_size + 63) / 64 * 64, 64);
+  size_t tiles_x = (width + tile_size - 1) / tile_size;
+  size_t tiles_y = (height + tile_size - 1) / tile_size;
+  size_t size = tiles_x * tiles_y * tile_size * tile_size * format_size(format);
+
+  std::optional<MappedFile> file =
+      MappedFile::create_temporary(directory, size);
+  if (!file)
+    return std::nullopt;
+
+  return TiledFramebuffer(std::move(*file), width, height, format, tile_size);
+}
+
+TiledFramebuffer::TiledFramebuffer(MappedFile &&file, size_t width,
+                                   size_t height, ImgFormat format,
+                                   size_t tile_size)
+    : _file(std::move(file)), _width(width), _height(height), _format(format),
+      _tileSize(tile_size), _tilesX((width + tile_size - 1) / tile_size),
+      _tilesY((height + tile_size - 1) / tile_size) {}
+
+// -- Methods
+
+void TiledFramebuffer::write_tile(size_t tx, size_t ty,
+                                  std::span<const Color> colors) {
+  if (tx >= _tilesX || ty >= _tilesY)
+    LOGERR("Tile ({}, {}) outside of the {}x{} tiles", tx, ty, _tilesX,
+           _tilesY);
+  size_t tile_width = get_tile_width(tx);
+  size_t tile_height = get_tile_height(ty);
+  if (colors.size() != tile_width * tile_height)
+    LOGERR("Tile ({}, {}) of {} pixels instead of {}x{}", tx, ty,
+           colors.size(), tile_width, tile_height);
+
+  size_t row_bytes = _tileSize * format_size(_format);
+  uint8_t *tile = reinterpret_cast<uint8_t *>(
+      _file.get_writable_data().data() + tile_offset(tx, ty));
+  for (size_t y = 0; y < tile_height; y++)
+    colors_to_format(colors.subspan(y * tile_width, tile_width), _format,
+                     tile + y * row_bytes);
+
+  _file.evict(tile_offset(tx, ty), tile_bytes());
+}
+
+void TiledFramebuffer::for_each_row(
+    const std::function<void(size_t, std::span<const uint8_t>)> &func) const {
+  size_t pixel_size = format_size(_format);
+  size_t row_bytes = _tileSize * pixel_size;
+  const uint8_t *data =
+      reinterpret_cast<const uint8_t *>(_file.get_data().data());
+  std::vector<uint8_t> row(_width * pixel_size);
+
+  for (size_t ty = 0; ty < _tilesY; ty++) {
+    for (size_t y = 0; y < get_tile_height(ty); y++) {
+      for (size_t tx = 0; tx < _tilesX; tx++)
+        std::memcpy(row.data() + tx * row_bytes,
+                    data + tile_offset(tx, ty) + y * row_bytes,
+                    get_tile_width(tx) * pixel_size);
+      func(ty * _tileSize + y, row);
+    }
+    // the band of tiles is contiguous in the file
+    _file.evict(tile_offset(0, ty), _tilesX * tile_bytes());
+  }
+}
+
+bool TiledFramebuffer::write_png(const char *filename) const {
+  bool hdr = is_hdr_format(_format);
+  size_t channels = hdr ? 4 : format_size(_format);
+  std::optional<PngStreamWriter> writer =
+      PngStreamWriter::open(filename, _width, _height, channels);
+  if (!writer)
+    return false;
+
+  // the HDR rows are clamped to RGBA8 as ImageBuffer::write_on_disk does
+  std::vector<Color> colors(hdr ? _width : 0);
+  std::vector<uint8_t> converted(hdr ? _width * 4 : 0);
+  size_t pixel_size = format_size(_format);
+  for_each_row([&](size_t, std::span<const uint8_t> row) {
+    if (!hdr) {
+      writer->write_rows(row);
+      return;
+    }
+    for (size_t x = 0; x < _width; x++)
+      colors[x] = format_to_color(row.data() + x * pixel_size, _format);
+    colors_to_format(colors, ImgFormat::RGBA, converted.data());
+    writer->write_rows(converted);
+  });
+  return writer->close();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ImageBuffer.h"
+#include "types.h"
+#include "utils/MappedFile.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <span>
+
+// Framebuffer of the images that don't fit in memory, stored in a mapped
+// scratch file : the tiles are dropped from memory once written (the kernel
+// writes them to the file), and the image is read back one band of tiles at
+// a time to be streamed out row by row. Only the tiles being written and the
+// band being read are resident.
+//
+// The file is tile major, every tile padded to tile_size x tile_size pixels
+// so it starts on a page. It is an anonymous temporary file : nothing is
+// left behind, even after a crash, and no existing file is touched.
+class TiledFramebuffer {
+public:
+  // -- Constructors
+  // Scratch file in directory, tile_size is rounded up to a multiple of 64.
+  // nullopt (and a warning) if the file can't be created.
+  static std::optional<TiledFramebuffer>
+  create(const std::filesystem::path &directory, size_t width, size_t height,
+         ImgFormat format = ImgFormat::RGBA, size_t tile_size = 64);
+
+  NO_COPY(TiledFramebuffer);
+
+  TiledFramebuffer(TiledFramebuffer &&other) = default;
+  TiledFramebuffer &operator=(TiledFramebuffer &&other) = default;
+
+  // -- Methods
+  // Pixels of the tile (tx, ty), clipped to the image, row major. They are
+  // evicted once converted : distinct tiles can be written from any thread.
+  void write_tile(size_t tx, size_t ty, std::span<const Color> colors);
+
+  // func(y, row) for every row, top first, in the storage format
+  void for_each_row(
+      const std::function<void(size_t, std::span<const uint8_t>)> &func) const;
+
+  // streamed PNG, RGBA for the HDR formats. False if it can't be written.
+  bool write_png(const char *filename) const;
+
+  // -- Getters
+  size_t get_width() const { return _width; }
+  size_t get_height() const { return _height; }
+  ImgFormat get_format() const { return _format; }
+  size_t get_tile_size() const { return _tileSize; }
+  size_t get_tiles_x() const { return _tilesX; }
+  size_t get_tiles_y() const { return _tilesY; }
+  // size of the tiles once clipped to the image
+  size_t get_tile_width(size_t tx) const {
+    return std::min(_tileSize, _width - tx * _tileSize);
+  }
+  size_t get_tile_height(size_t ty) const {
+    return std::min(_tileSize, _height - ty * _tileSize);
+  }
+
+private:
+  TiledFramebuffer(MappedFile &&file, size_t width, size_t height,
+                   ImgFormat format, size_t tile_size);
+
+  size_t tile_bytes() const {
+    return _tileSize * _tileSize * format_size(_format);
+  }
+  size_t tile_offset(size_t tx, size_t ty) const {
+    return (ty * _tilesX + tx) * tile_bytes();
+  }
+
+  // -- Members
+private:
+  MappedFile _file;
+  size_t _width, _height;
+  ImgFormat _format;
+  size_t _tileSize, _tilesX, _tilesY;
+};
@@ -6,7 +6,9 @@
 #include "graphics/vulkan_context.h"
 #include "types.h"
 #include <cstdint>
+#include <glm/mat4x4.hpp>
 #include <optional>
+#include <span>
 
 #include <volk.h>
 #include <vulkan/vulkan_core.h>
@@ -149,26 +151,37 @@ public:
   VkAccelerationStructureKHR _blas = VK_NULL_HANDLE;
 };
 
+// A Blas placed in a Tlas, several instances can share the same Blas
+struct TlasInstance {
+  uint32_t blas;                        // index in the Tlas blas_vec
+  glm::mat4 transform = glm::mat4(1.f); // object to world, affine
+};
+
 class Tlas {
 public:
   NO_COPY(Tlas);
   Tlas() = delete;
 
+  // one untransformed instance per Blas
   Tlas(VulkanContext &ctx, std::vector<Blas> &&blas_vec)
+      : Tlas(ctx, std::move(blas_vec), identity_instances(blas_vec.size())) {}
+
+  Tlas(VulkanContext &ctx, std::vector<Blas> &&blas_vec,
+       std::span<const TlasInstance> tlas_instances)
       : _ctxDevice(ctx._device), _blasVec(std::move(blas_vec)),
         _instanceBuffer(
-            ctx, _blasVec.size(),
+            ctx, tlas_instances.size(),
             VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
                 VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
             VMA_MEMORY_USAGE_CPU_TO_GPU),
         _tlasBuffer(std::nullopt) {
 
     std::vector<VkAccelerationStructureInstanceKHR> instances;
-    instances.reserve(_blasVec.size());
-    for (size_t i = 0; i < _blasVec.size(); i++) {
-      Blas &blas = _blasVec[i];
+    instances.reserve(tlas_instances.size());
+    for (size_t i = 0; i < tlas_instances.size(); i++) {
+      Blas &blas = _blasVec[tlas_instances[i].blas];
       instances.emplace_back(VkAccelerationStructureInstanceKHR{
-          .transform = IDENTITY_TRANSFORM,
+          .transform = to_vk_transform(tlas_instances[i].transform),
           .instanceCustomIndex = static_cast<uint32_t>(i), // InstanceId() call
           .mask = 0xff,
           .instanceShaderBindingTableRecordOffset = 0, // hit group 0
@@ -270,11 +283,21 @@ public:
   VkAccelerationStructureKHR get_tlas() const { return _tlas; }
 
 private:
-  static constexpr VkTransformMatrixKHR IDENTITY_TRANSFORM = {
-      1, 0, 0, 0, //
-      0, 1, 0, 0, //
-      0, 0, 1, 0, //
-  };
+  static std::vector<TlasInstance> identity_instances(size_t blas_count) {
+    std::vector<TlasInstance> instances(blas_count);
+    for (size_t i = 0; i < blas_count; i++)
+      instances[i].blas = static_cast<uint32_t>(i);
+    return instances;
+  }
+
+  // 3 first rows of the column major glm matrix, row major
+  static VkTransformMatrixKHR to_vk_transform(const glm::mat4 &transform) {
+    VkTransformMatrixKHR result;
+    for (int row = 0; row < 3; row++)
+      for (int col = 0; col < 4; col++)
+        result.matrix[row][col] = transform[col][row];
+    return result;
+  }
 
   // -- Attributs
 private:
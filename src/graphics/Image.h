@@ -13,6 +13,9 @@ enum ImgFormat {
   RGBA = VK_FORMAT_R8G8B8A8_UNORM,
   RGB = VK_FORMAT_R8G8B8_UNORM,
   R = VK_FORMAT_R8_UNORM,
+  // HDR color format, unclamped linear values
+  RGBA16F = VK_FORMAT_R16G16B16A16_SFLOAT,
+  RGBA32F = VK_FORMAT_R32G32B32A32_SFLOAT,
 
   // Depth format
   DEPTH = VK_FORMAT_D32_SFLOAT,
@@ -29,6 +32,10 @@ enum ImgLayout {
 
 inline size_t format_size(ImgFormat format) {
   switch (format) {
+  case RGBA32F: /* = VK_FORMAT_R32G32B32A32_SFLOAT */
+    return 16;
+  case RGBA16F: /* = VK_FORMAT_R16G16B16A16_SFLOAT */
+    return 8;
   case RGBA:  /*  = VK_FORMAT_R8G8B8A8_UNORM */
   case DEPTH: /* VK_FORMAT_D32_SFLOAT */
     return 4;
@@ -40,6 +47,11 @@ inline size_t format_size(ImgFormat format) {
   }
 }
 
+// float color storage, the other color formats are 8 bits UNORM
+inline bool is_hdr_format(ImgFormat format) {
+  return format == RGBA16F || format == RGBA32F;
+}
+
 class Image {
 public:
   Image() = delete;
@@ -0,0 +1,500 @@
+#pragma once
+
+#include "hittables/BvhBuilder.h"
+#include "hittables/Hittable.h"
+#include "types.h"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+// Bounding volume hierarchy over the objects bboxes, built with the binned
+// surface area heuristic of BvhBuilder.
+template <Hittable T> class BvhAccStruct : public IAccStruct {
+public:
+  using Node = BvhNode;
+
+  static constexpr size_t MAX_DEPTH = BvhBuilder::MAX_DEPTH;
+  static constexpr float DEFAULT_REBUILD_THRESHOLD = 1.5f;
+
+  // -- Constructors
+  BvhAccStruct() = default;
+
+  BvhAccStruct(std::vector<T> &&objects, BvhBuildOptions options = {})
+      : _objects(std::move(objects)) {
+    build(options);
+  }
+
+  NO_COPY(BvhAccStruct);
+
+  ~BvhAccStruct() {}
+
+  // move constructors
+  BvhAccStruct(BvhAccStruct &&other)
+      : _objects(std::move(other._objects)), _nodes(std::move(other._nodes)),
+        _buildStats(other._buildStats), _ids(std::move(other._ids)),
+        _slots(std::move(other._slots)),
+        _buildAreas(std::move(other._buildAreas)),
+        _buildCost(other._buildCost) {}
+
+  BvhAccStruct &operator=(BvhAccStruct &&other) {
+    if (this != &other) {
+      _objects = std::move(other._objects);
+      _nodes = std::move(other._nodes);
+      _buildStats = other._buildStats;
+      _ids = std::move(other._ids);
+      _slots = std::move(other._slots);
+      _buildAreas = std::move(other._buildAreas);
+      _buildCost = other._buildCost;
+    }
+    return *this;
+  }
+
+  // -- Getters
+  const std::vector<Node> &get_nodes() const { return _nodes; }
+  size_t get_object_count() const { return _objects.size(); }
+  std::span<const T> get_objects() const { return _objects; }
+  const BvhBuildStats &get_build_stats() const { return _buildStats; }
+
+  // -- Animation
+
+  // Object given at index `id` to the constructor, the builds move them.
+  // Call refit() or update() once the moved objects are written.
+  T &get_object(uint32_t id) { return _objects[_slots[id]]; }
+
+  // Bounds recomputed bottom up, the tree is kept as is
+  void refit() {
+    std::vector<BBox> bboxes = object_bboxes();
+    BvhBuilder::refit(_nodes, bboxes);
+  }
+
+  // Refit, then if the SAH cost grew past `threshold` times the one of the
+  // last build, rebuild the subtrees spoiled by the moves : the topmost nodes
+  // with a child whose area grew past `threshold`. Their own bounds held, so
+  // the moved objects can be regrouped inside them. Falls back to a full
+  // build when the root grew, the subtrees hold half of the objects, or a
+  // rebuilt subtree would not fit in the traversal stack depth.
+  // Returns true if anything was rebuilt.
+  bool update(float threshold = DEFAULT_REBUILD_THRESHOLD,
+              BvhBuildOptions options = {}) {
+    if (_nodes.empty())
+      return false;
+
+    std::vector<BBox> bboxes = object_bboxes();
+    BvhBuilder::refit(_nodes, bboxes);
+    float ratio = BvhBuilder::sah_cost(_nodes) / _buildCost;
+    if (!(ratio > threshold))
+      return false;
+
+    auto grew = [&](uint32_t index) {
+      return _nodes[index].bbox.surface_area() > threshold * _buildAreas[index];
+    };
+
+    // (node index, depth)
+    std::vector<std::pair<uint32_t, size_t>> roots;
+    size_t rebuilt_count = 0;
+    std::vector<std::pair<uint32_t, size_t>> stack;
+    if (!grew(0))
+      stack.push_back({0, 0});
+    while (!stack.empty()) {
+      auto [index, depth] = stack.back();
+      stack.pop_back();
+      const Node &node = _nodes[index];
+      if (node.is_leaf())
+        continue;
+
+      if (grew(node.first) || grew(node.first + 1)) {
+        auto [begin, end] = subtree_range(index);
+        roots.push_back({index, depth});
+        rebuilt_count += end - begin;
+      } else {
+        stack.push_back({node.first, depth + 1});
+        stack.push_back({node.first + 1, depth + 1});
+      }
+    }
+
+    if (grew(0) || roots.empty() || 2 * rebuilt_count > _objects.size()) {
+      LOG(FINE, "bvh sah cost x{:.2f}, full rebuild", ratio);
+      build(options);
+      return true;
+    }
+
+    for (auto [root, depth] : roots) {
+      if (!rebuild_subtree(root, depth, bboxes, options)) {
+        LOG(FINE, "bvh sah cost x{:.2f}, subtree too deep, full rebuild",
+            ratio);
+        build(options);
+        return true;
+      }
+    }
+    _buildStats.nodeCount = _nodes.size();
+    record_build_cost();
+    LOG(FINE, "bvh sah cost x{:.2f}, {} subtrees rebuilt ({} objects)",
+        ratio, roots.size(), rebuilt_count);
+    return true;
+  }
+
+  float get_sah_cost() const { return BvhBuilder::sah_cost(_nodes); }
+
+  // -- IAccStruct impl
+  uint32_t hit(Ray r, Interval ray_t, HitRecord *records) const override {
+    if (_nodes.empty())
+      return MISS_INDEX;
+
+    const glm::vec3 inv_dir = 1.f / r.direction;
+    float closest_so_far = ray_t.max;
+    uint32_t closest_index = MISS_INDEX;
+    HitRecord temp_rec;
+
+    if (!_nodes[0].bbox.hit(r.origin, inv_dir, ray_t))
+      return MISS_INDEX;
+
+    std::array<uint32_t, MAX_DEPTH> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size != 0) {
+      const Node &node = _nodes[stack[--stack_size]];
+
+      if (node.is_leaf()) {
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+          const T &object = _objects[i];
+          if (object.T::hit(r, Interval(ray_t.min, closest_so_far),
+                            &temp_rec)) {
+            closest_index = i;
+            closest_so_far = temp_rec.t;
+            *records = temp_rec;
+          }
+        }
+        continue;
+      }
+
+      // test both children here, and visit the nearest one first
+      Interval search_t = {ray_t.min, closest_so_far};
+      float left_t, right_t;
+      bool left_hit =
+          _nodes[node.first].bbox.hit(r.origin, inv_dir, search_t, &left_t);
+      bool right_hit = _nodes[node.first + 1].bbox.hit(r.origin, inv_dir,
+                                                       search_t, &right_t);
+
+      if (left_hit && right_hit) {
+        bool left_first = left_t <= right_t;
+        stack[stack_size++] = node.first + (left_first ? 1 : 0);
+        stack[stack_size++] = node.first + (left_first ? 0 : 1);
+      } else if (left_hit) {
+        stack[stack_size++] = node.first;
+      } else if (right_hit) {
+        stack[stack_size++] = node.first + 1;
+      }
+    }
+
+    return closest_index;
+  }
+
+  // Same walk without the closest search : children in storage order, and
+  // out on the first occluding object
+  bool occluded(Ray r, Interval ray_t) const override {
+    if (_nodes.empty())
+      return false;
+
+    const glm::vec3 inv_dir = 1.f / r.direction;
+    std::array<uint32_t, MAX_DEPTH> stack;
+    size_t stack_size = 0;
+    if (_nodes[0].bbox.hit(r.origin, inv_dir, ray_t))
+      stack[stack_size++] = 0;
+
+    while (stack_size != 0) {
+      const Node &node = _nodes[stack[--stack_size]];
+
+      if (node.is_leaf()) {
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+          const T &object = _objects[i];
+          if (object.T::occluded(r, ray_t))
+            return true;
+        }
+        continue;
+      }
+
+      if (_nodes[node.first + 1].bbox.hit(r.origin, inv_dir, ray_t))
+        stack[stack_size++] = node.first + 1;
+      if (_nodes[node.first].bbox.hit(r.origin, inv_dir, ray_t))
+        stack[stack_size++] = node.first;
+    }
+    return false;
+  }
+
+  void hit4(const RayPacket<4> &packet, Interval ray_t, HitRecord *records,
+            uint32_t *indices) const override {
+    trace_packet(packet, ray_t, records, indices);
+  }
+  void hit8(const RayPacket<8> &packet, Interval ray_t, HitRecord *records,
+            uint32_t *indices) const override {
+    trace_packet(packet, ray_t, records, indices);
+  }
+  void hit16(const RayPacket<16> &packet, Interval ray_t, HitRecord *records,
+             uint32_t *indices) const override {
+    trace_packet(packet, ray_t, records, indices);
+  }
+
+  std::optional<const IHittable *> get_hitted(uint32_t index) const override {
+    return (index < _objects.size())
+               ? std::optional<const IHittable *>{&_objects[index]}
+               : std::nullopt;
+  }
+
+  Tlas get_gpu_struct(VulkanContext &ctx) const override {
+    std::vector<VkAabbPositionsKHR> aabbs;
+    for (auto &obj : _objects)
+      aabbs.push_back(obj.get_bbox().to_vk());
+
+    std::vector<Blas> blas_vec;
+    blas_vec.emplace_back(ctx, aabbs);
+
+    return Tlas(ctx, std::move(blas_vec));
+  }
+
+private:
+  // Packet traversal : a node is visited if any active ray hits it. Nodes
+  // outside the packet frustum are culled without any ray test, and the
+  // first hitting ray is kept on the stack so the rays before it are skipped
+  // in the subtree.
+  template <size_t N>
+  void trace_packet(const RayPacket<N> &packet, Interval ray_t,
+                    HitRecord *records, uint32_t *indices) const {
+    std::array<glm::vec3, N> inv_dirs;
+    std::array<float, N> closest_so_far;
+    for (size_t k = 0; k < N; k++) {
+      inv_dirs[k] = 1.f / packet.rays[k].direction;
+      closest_so_far[k] = ray_t.max;
+      indices[k] = MISS_INDEX;
+    }
+    if (_nodes.empty() || packet.mask == 0)
+      return;
+
+    const Frustum *frustum = packet.frustum ? &*packet.frustum : nullptr;
+
+    // first active ray from `first` hitting the box, N if none
+    auto first_hit = [&](const BBox &bbox, uint32_t first, float *t) {
+      if (frustum && !frustum->intersects(bbox))
+        return static_cast<uint32_t>(N);
+      for (uint32_t k = first; k < N; k++)
+        if (packet.is_active(k) &&
+            bbox.hit(packet.rays[k].origin, inv_dirs[k],
+                     Interval(ray_t.min, closest_so_far[k]), t))
+          return k;
+      return static_cast<uint32_t>(N);
+    };
+
+    struct StackEntry {
+      uint32_t node;
+      uint32_t first; // first ray hitting the node
+    };
+
+    float t;
+    uint32_t root_first = first_hit(_nodes[0].bbox, 0, &t);
+    if (root_first == N)
+      return;
+
+    std::array<StackEntry, MAX_DEPTH> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = {0, root_first};
+    HitRecord temp_rec;
+
+    while (stack_size != 0) {
+      StackEntry entry = stack[--stack_size];
+      const Node &node = _nodes[entry.node];
+
+      if (node.is_leaf()) {
+        for (uint32_t k = entry.first; k < N; k++) {
+          if (!packet.is_active(k))
+            continue;
+
+          const Ray &r = packet.rays[k];
+          Interval search_t = {ray_t.min, closest_so_far[k]};
+          if (!node.bbox.hit(r.origin, inv_dirs[k], search_t))
+            continue;
+
+          for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            const T &object = _objects[i];
+            if (object.T::hit(r, Interval(ray_t.min, closest_so_far[k]),
+                           &temp_rec)) {
+              indices[k] = i;
+              closest_so_far[k] = temp_rec.t;
+              records[k] = temp_rec;
+            }
+          }
+        }
+        continue;
+      }
+
+      float left_t, right_t;
+      uint32_t left_first =
+          first_hit(_nodes[node.first].bbox, entry.first, &left_t);
+      uint32_t right_first =
+          first_hit(_nodes[node.first + 1].bbox, entry.first, &right_t);
+
+      StackEntry left = {node.first, left_first};
+      StackEntry right = {node.first + 1, right_first};
+      if (left_first != N && right_first != N) {
+        if (left_t > right_t)
+          std::swap(left, right);
+        stack[stack_size++] = right;
+        stack[stack_size++] = left;
+      } else if (left_first != N) {
+        stack[stack_size++] = left;
+      } else if (right_first != N) {
+        stack[stack_size++] = right;
+      }
+    }
+  }
+
+  void build(BvhBuildOptions options) {
+    if (_ids.size() != _objects.size()) {
+      _ids.resize(_objects.size());
+      std::iota(_ids.begin(), _ids.end(), 0);
+      _slots.resize(_objects.size());
+    }
+    std::vector<BBox> bboxes = object_bboxes();
+
+    std::vector<uint32_t> prim_order;
+    _buildStats = BvhBuilder(options).build(bboxes, &_nodes, &prim_order);
+    LOG(FINE, "bvh built : {} primitives, {} nodes in {:.2f}ms",
+        _buildStats.primCount, _buildStats.nodeCount,
+        _buildStats.buildTimeMs);
+
+    // objects are reordered to match the leaves, so leaf ranges are contiguous
+    reorder(0, prim_order);
+    record_build_cost();
+  }
+
+  std::vector<BBox> object_bboxes() const {
+    std::vector<BBox> bboxes;
+    bboxes.reserve(_objects.size());
+    for (const IHittable &object : _objects)
+      bboxes.push_back(object.get_bbox());
+    return bboxes;
+  }
+
+  // objects [begin, begin + order.size()) in `order`, relative to begin
+  void reorder(size_t begin, std::span<const uint32_t> order) {
+    std::vector<T> ordered;
+    std::vector<uint32_t> ids;
+    ordered.reserve(order.size());
+    ids.reserve(order.size());
+    for (uint32_t index : order) {
+      ordered.push_back(std::move(_objects[begin + index]));
+      ids.push_back(_ids[begin + index]);
+    }
+    for (size_t k = 0; k < order.size(); k++) {
+      _objects[begin + k] = std::move(ordered[k]);
+      _ids[begin + k] = ids[k];
+      _slots[ids[k]] = static_cast<uint32_t>(begin + k);
+    }
+  }
+
+  // a subtree leaves reference a contiguous objects range
+  std::pair<size_t, size_t> subtree_range(uint32_t index) const {
+    uint32_t first = index;
+    uint32_t last = index;
+    while (!_nodes[first].is_leaf())
+      first = _nodes[first].first;
+    while (!_nodes[last].is_leaf())
+      last = _nodes[last].first + 1;
+    return {_nodes[first].first, _nodes[last].first + _nodes[last].count};
+  }
+
+  // The new subtree takes the node slots of the old one, so the nodes out of
+  // it keep their indices : its leaves are split until it has as many node
+  // pairs as the old one, and the pairs past them are appended.
+  // Returns false, with the tree untouched, if the new subtree grafted at
+  // `depth` would go past MAX_DEPTH.
+  bool rebuild_subtree(uint32_t index, size_t depth,
+                       std::span<const BBox> bboxes, BvhBuildOptions options) {
+    auto [begin, end] = subtree_range(index);
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;
+    BvhBuilder(options).build(bboxes.subspan(begin, end - begin), &nodes,
+                              &order);
+
+    // old pairs in index order : mapped in order, children stay after their
+    // parent
+    std::vector<uint32_t> slots;
+    std::vector<uint32_t> stack = {index};
+    while (!stack.empty()) {
+      const Node &node = _nodes[stack.back()];
+      stack.pop_back();
+      if (node.is_leaf())
+        continue;
+      slots.push_back(node.first);
+      stack.push_back(node.first);
+      stack.push_back(node.first + 1);
+    }
+    std::ranges::sort(slots);
+
+    // the biggest leaves are cut in halves : n objects fit in n - 1 pairs,
+    // so while pairs are missing a leaf holds two objects or more
+    while ((nodes.size() - 1) / 2 < slots.size()) {
+      auto leaf = std::ranges::max_element(nodes, {}, &Node::count);
+      uint32_t first = leaf->first;
+      uint32_t count = leaf->count;
+      leaf->first = static_cast<uint32_t>(nodes.size());
+      leaf->count = 0;
+      for (auto [child_first, child_count] :
+           {std::pair{first, count / 2},
+            std::pair{first + count / 2, count - count / 2}}) {
+        Node child;
+        child.first = child_first;
+        child.count = child_count;
+        for (uint32_t k = child_first; k < child_first + child_count; k++)
+          child.bbox = child.bbox.merge(bboxes[begin + order[k]]);
+        nodes.push_back(child);
+      }
+    }
+
+    // children are after their parent : the depths are set in one pass
+    std::vector<size_t> depths(nodes.size(), depth);
+    for (uint32_t k = 0; k < nodes.size(); k++) {
+      if (nodes[k].is_leaf())
+        continue;
+      if (depths[k] + 1 >= MAX_DEPTH)
+        return false;
+      depths[nodes[k].first] = depths[nodes[k].first + 1] = depths[k] + 1;
+    }
+
+    reorder(begin, order);
+    while (slots.size() < (nodes.size() - 1) / 2) {
+      slots.push_back(static_cast<uint32_t>(_nodes.size()));
+      _nodes.resize(_nodes.size() + 2);
+    }
+
+    auto slot_of = [&](uint32_t k) {
+      return k == 0 ? index : slots[(k - 1) / 2] + (k - 1) % 2;
+    };
+    for (uint32_t k = 0; k < nodes.size(); k++) {
+      Node node = nodes[k];
+      node.first = node.is_leaf() ? node.first + static_cast<uint32_t>(begin)
+                                  : slot_of(node.first);
+      _nodes[slot_of(k)] = node;
+    }
+    return true;
+  }
+
+  void record_build_cost() {
+    _buildAreas.resize(_nodes.size());
+    for (size_t i = 0; i < _nodes.size(); i++)
+      _buildAreas[i] = _nodes[i].bbox.surface_area();
+    _buildCost = BvhBuilder::sah_cost(_nodes);
+  }
+
+  // -- Members
+private:
+  std::vector<T> _objects;
+  std::vector<Node> _nodes;
+  BvhBuildStats _buildStats;
+
+  // animation
+  std::vector<uint32_t> _ids;   // constructor index of each object
+  std::vector<uint32_t> _slots; // object index of each constructor index
+  std::vector<float> _buildAreas;
+  float _buildCost = 0;
+};
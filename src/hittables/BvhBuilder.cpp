@@ -0,0 +1,286 @@
+#include "BvhBuilder.h"
+
+#include <chrono>
+#include <numeric>
+
+// -- Methods
+
+BvhBuildStats BvhBuilder::build(std::span<const BBox> bboxes,
+                                std::vector<BvhNode> *nodes,
+                                std::vector<uint32_t> *prim_order) {
+  auto start = std::chrono::steady_clock::now();
+
+  BvhBuildStats stats;
+  stats.primCount = bboxes.size();
+
+  nodes->clear();
+  prim_order->resize(bboxes.size());
+  std::iota(prim_order->begin(), prim_order->end(), 0);
+  if (bboxes.empty())
+    return stats;
+
+  // only spawn threads when there is enough work for them
+  std::unique_ptr<ThreadPool> owned_pool;
+  _pool = _options.pool;
+  if (!_pool && _options.threadCount != 1 &&
+      bboxes.size() >= PARALLEL_THRESHOLD) {
+    size_t thread_count = _options.threadCount == 0
+                              ? ThreadPool::default_thread_count()
+                              : _options.threadCount;
+    if (thread_count > 1) {
+      owned_pool = std::make_unique<ThreadPool>(thread_count);
+      _pool = owned_pool.get();
+    }
+  }
+
+  _bboxes = bboxes;
+  _indices = prim_order;
+  _nodes = nodes;
+  _nodeCount = 1;
+  _leafCount = 0;
+  _maxDepth = 0;
+
+  _centers.resize(bboxes.size());
+  auto compute_centers = [this](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+      _centers[i] = _bboxes[i].center();
+  };
+  if (use_pool(bboxes.size(), PARALLEL_BIN_THRESHOLD))
+    parallel_for(*_pool, 0, bboxes.size(), PARALLEL_THRESHOLD,
+                 compute_centers);
+  else
+    compute_centers(0, bboxes.size());
+
+  // a binary tree with n leaves at most has 2n - 1 nodes
+  nodes->resize(2 * bboxes.size() - 1);
+  build_node(0, 0, bboxes.size(), 0);
+  nodes->resize(_nodeCount);
+
+  _pool = nullptr;
+  _bboxes = {};
+  _centers = {};
+  _indices = nullptr;
+  _nodes = nullptr;
+
+  stats.nodeCount = _nodeCount;
+  stats.leafCount = _leafCount;
+  stats.maxDepth = _maxDepth;
+  stats.buildTimeMs = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+  return stats;
+}
+
+void BvhBuilder::refit(std::span<BvhNode> nodes,
+                       std::span<const BBox> bboxes) {
+  for (size_t i = nodes.size(); i-- > 0;) {
+    BvhNode &node = nodes[i];
+    if (node.is_leaf()) {
+      BBox bbox = BBOX_EMPTY;
+      for (uint32_t prim = node.first; prim < node.first + node.count; prim++)
+        bbox = bbox.merge(bboxes[prim]);
+      node.bbox = bbox;
+    } else {
+      node.bbox = nodes[node.first].bbox.merge(nodes[node.first + 1].bbox);
+    }
+  }
+}
+
+float BvhBuilder::sah_cost(std::span<const BvhNode> nodes) {
+  double cost = 0;
+  for (const BvhNode &node : nodes)
+    cost += node.bbox.surface_area() *
+            (node.is_leaf() ? INTERSECT_COST * node.count : TRAVERSAL_COST);
+  return static_cast<float>(cost);
+}
+
+// -- private
+
+void BvhBuilder::build_node(uint32_t node_index, size_t begin, size_t end,
+                            size_t depth) {
+  Bounds bounds = compute_bounds(begin, end);
+  BvhNode &node = (*_nodes)[node_index];
+  node.bbox = bounds.bbox;
+
+  size_t max_depth = _maxDepth.load(std::memory_order_relaxed);
+  while (depth > max_depth &&
+         !_maxDepth.compare_exchange_weak(max_depth, depth,
+                                          std::memory_order_relaxed))
+    ;
+
+  size_t count = end - begin;
+  auto make_leaf = [&]() {
+    node.first = static_cast<uint32_t>(begin);
+    node.count = static_cast<uint32_t>(count);
+    _leafCount.fetch_add(1, std::memory_order_relaxed);
+  };
+
+  if (count == 1 || depth + 1 >= MAX_DEPTH)
+    return make_leaf();
+
+  BinMapping mapping = bin_mapping(bounds);
+  Split split = find_split(bounds, mapping, begin, end);
+  float leaf_cost = INTERSECT_COST * count;
+  if (count <= _options.maxLeafSize && leaf_cost <= split.cost)
+    return make_leaf();
+
+  size_t mid = end;
+  if (split.cost < INFINITY) {
+    auto it = std::partition(_indices->begin() + begin,
+                             _indices->begin() + end, [&](uint32_t prim) {
+                               return bin_of(mapping, split.axis, prim) <
+                                      split.bin;
+                             });
+    mid = static_cast<size_t>(it - _indices->begin());
+  }
+  // no usable split (e.g. every center at the same place)
+  if (mid == begin || mid == end)
+    mid = median_split(bounds, begin, end);
+
+  uint32_t left = _nodeCount.fetch_add(2, std::memory_order_relaxed);
+  node.first = left;
+  node.count = 0;
+
+  if (use_pool(count, PARALLEL_THRESHOLD)) {
+    TaskGroup group(*_pool);
+    group.run([=, this]() { build_node(left, begin, mid, depth + 1); });
+    build_node(left + 1, mid, end, depth + 1);
+    group.wait();
+  } else {
+    build_node(left, begin, mid, depth + 1);
+    build_node(left + 1, mid, end, depth + 1);
+  }
+}
+
+BvhBuilder::Bounds BvhBuilder::compute_bounds(size_t begin, size_t end) const {
+  auto reduce = [this](size_t chunk_begin, size_t chunk_end) {
+    Bounds result;
+    for (size_t i = chunk_begin; i < chunk_end; i++) {
+      uint32_t prim = (*_indices)[i];
+      result.bbox = result.bbox.merge(_bboxes[prim]);
+      result.centers =
+          result.centers.merge(BBox(_centers[prim], _centers[prim]));
+    }
+    return result;
+  };
+
+  if (!use_pool(end - begin, PARALLEL_BIN_THRESHOLD))
+    return reduce(begin, end);
+
+  size_t grain = (end - begin) / (4 * _pool->get_thread_count()) + 1;
+  std::vector<Bounds> partials((end - begin) / grain + 1);
+  parallel_for(*_pool, begin, end, grain,
+               [&](size_t chunk_begin, size_t chunk_end) {
+                 partials[(chunk_begin - begin) / grain] =
+                     reduce(chunk_begin, chunk_end);
+               });
+
+  Bounds result;
+  for (const Bounds &partial : partials)
+    result.merge(partial);
+  return result;
+}
+
+BvhBuilder::Bins BvhBuilder::compute_bins(const BinMapping &mapping,
+                                          size_t begin, size_t end) const {
+  auto reduce = [&](size_t chunk_begin, size_t chunk_end) {
+    Bins bins{};
+    for (size_t i = chunk_begin; i < chunk_end; i++) {
+      uint32_t prim = (*_indices)[i];
+      for (size_t axis = 0; axis < 3; axis++) {
+        Bin &bin = bins[axis][bin_of(mapping, axis, prim)];
+        bin.bbox = bin.bbox.merge(_bboxes[prim]);
+        bin.count++;
+      }
+    }
+    return bins;
+  };
+
+  if (!use_pool(end - begin, PARALLEL_BIN_THRESHOLD))
+    return reduce(begin, end);
+
+  size_t grain = (end - begin) / (4 * _pool->get_thread_count()) + 1;
+  std::vector<Bins> partials((end - begin) / grain + 1);
+  parallel_for(*_pool, begin, end, grain,
+               [&](size_t chunk_begin, size_t chunk_end) {
+                 partials[(chunk_begin - begin) / grain] =
+                     reduce(chunk_begin, chunk_end);
+               });
+
+  Bins result{};
+  for (const Bins &partial : partials)
+    for (size_t axis = 0; axis < 3; axis++)
+      for (size_t b = 0; b < _options.binCount; b++) {
+        result[axis][b].bbox =
+            result[axis][b].bbox.merge(partial[axis][b].bbox);
+        result[axis][b].count += partial[axis][b].count;
+      }
+  return result;
+}
+
+BvhBuilder::Split BvhBuilder::find_split(const Bounds &bounds,
+                                         const BinMapping &mapping,
+                                         size_t begin, size_t end) const {
+  Bins bins = compute_bins(mapping, begin, end);
+  float parent_area = std::max(bounds.bbox.surface_area(), 1e-12f);
+  size_t bin_count = _options.binCount;
+
+  Split best;
+  for (size_t axis = 0; axis < 3; axis++) {
+    if (mapping.scale[axis] == 0)
+      continue;
+
+    // right side areas and counts, for a split before bin b
+    std::array<float, MAX_BIN_COUNT> right_areas;
+    std::array<uint32_t, MAX_BIN_COUNT> right_counts;
+    BBox right_bbox = BBOX_EMPTY;
+    uint32_t right_count = 0;
+    for (size_t b = bin_count - 1; b > 0; b--) {
+      right_bbox = right_bbox.merge(bins[axis][b].bbox);
+      right_count += bins[axis][b].count;
+      right_areas[b] = right_bbox.surface_area();
+      right_counts[b] = right_count;
+    }
+
+    BBox left_bbox = BBOX_EMPTY;
+    uint32_t left_count = 0;
+    for (size_t b = 1; b < bin_count; b++) {
+      left_bbox = left_bbox.merge(bins[axis][b - 1].bbox);
+      left_count += bins[axis][b - 1].count;
+      if (left_count == 0 || right_counts[b] == 0)
+        continue;
+
+      float cost = TRAVERSAL_COST +
+                   INTERSECT_COST *
+                       (left_bbox.surface_area() * left_count +
+                        right_areas[b] * right_counts[b]) /
+                       parent_area;
+      if (cost < best.cost)
+        best = {cost, axis, b};
+    }
+  }
+  return best;
+}
+
+BvhBuilder::BinMapping BvhBuilder::bin_mapping(const Bounds &bounds) const {
+  BinMapping mapping = {bounds.centers.get_min(), glm::vec3(0)};
+  for (size_t axis = 0; axis < 3; axis++) {
+    float size = bounds.centers.axis_interval(axis).size();
+    if (size > 0)
+      mapping.scale[axis] = _options.binCount / size;
+  }
+  return mapping;
+}
+
+size_t BvhBuilder::median_split(const Bounds &bounds, size_t begin,
+                                size_t end) {
+  glm::vec3 extent = bounds.centers.get_max() - bounds.centers.get_min();
+  size_t axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                    : (extent.y > extent.z ? 1 : 2);
+  size_t mid = begin + (end - begin) / 2;
+  std::nth_element(_indices->begin() + begin, _indices->begin() + mid,
+                   _indices->begin() + end, [&](uint32_t a, uint32_t b) {
+                     return _centers[a][axis] < _centers[b][axis];
+                   });
+  return mid;
+}
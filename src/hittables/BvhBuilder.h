@@ -0,0 +1,138 @@
+#pragma once
+
+#include "types.h"
+#include "utils/ThreadPool.h"
+
+#include <atomic>
+
+// Flat bvh node, 32 bytes. Children are allocated by pair so inner nodes only
+// store the left child index, the right one is the next node.
+struct BvhNode {
+  BBox bbox = BBOX_EMPTY;
+  uint32_t first = 0; // left child (inner node) or first primitive (leaf)
+  uint32_t count = 0; // primitive count, 0 for inner nodes
+
+  bool is_leaf() const { return count != 0; }
+};
+
+struct BvhBuildOptions {
+  size_t binCount = 16;
+  size_t maxLeafSize = 4;
+
+  // 0 use every hardware thread, 1 build on the calling thread
+  size_t threadCount = 0;
+  // reuse an existing pool instead of spawning one for the build
+  ThreadPool *pool = nullptr;
+};
+
+struct BvhBuildStats {
+  size_t primCount = 0;
+  size_t nodeCount = 0;
+  size_t leafCount = 0;
+  size_t maxDepth = 0;
+  double buildTimeMs = 0;
+
+  double prims_per_second() const {
+    return buildTimeMs > 0 ? primCount / (buildTimeMs / 1000.) : 0;
+  }
+};
+
+// Binned SAH builder working only on the primitives bboxes. Subtrees above
+// PARALLEL_THRESHOLD primitives are built as separate tasks, and the binning
+// of the biggest nodes is split across the pool as well.
+class BvhBuilder {
+public:
+  static constexpr size_t MAX_DEPTH = 64;
+  static constexpr size_t MAX_BIN_COUNT = 32;
+  static constexpr size_t PARALLEL_THRESHOLD = 4096;
+  static constexpr size_t PARALLEL_BIN_THRESHOLD = 1 << 16;
+
+  static constexpr float TRAVERSAL_COST = 1.f;
+  static constexpr float INTERSECT_COST = 1.f;
+
+  // -- Constructors --
+  BvhBuilder(BvhBuildOptions options = {}) : _options(options) {
+    _options.binCount = std::clamp<size_t>(_options.binCount, 2, MAX_BIN_COUNT);
+    _options.maxLeafSize = std::max<size_t>(_options.maxLeafSize, 1);
+  }
+
+  NO_COPY(BvhBuilder);
+
+  // -- Methods --
+
+  // Build the hierarchy over `bboxes`. Leaves reference ranges of
+  // `prim_order`, which maps back to the bboxes indices.
+  BvhBuildStats build(std::span<const BBox> bboxes,
+                      std::vector<BvhNode> *nodes,
+                      std::vector<uint32_t> *prim_order);
+
+  // Recompute the nodes bounds bottom up, `bboxes` indexed like the leaves
+  // ranges. Relies on the children being stored after their parent.
+  static void refit(std::span<BvhNode> nodes, std::span<const BBox> bboxes);
+
+  // Sum of the nodes areas weighted by their traversal or intersection cost.
+  // Divided by the root area, the expected cost of a ray through the root.
+  static float sah_cost(std::span<const BvhNode> nodes);
+
+private:
+  struct Bounds {
+    BBox bbox = BBOX_EMPTY;
+    BBox centers = BBOX_EMPTY;
+
+    void merge(const Bounds &other) {
+      bbox = bbox.merge(other.bbox);
+      centers = centers.merge(other.centers);
+    }
+  };
+
+  // centers to bin index mapping, scale is 0 on flat axes
+  struct BinMapping {
+    glm::vec3 min;
+    glm::vec3 scale;
+  };
+
+  struct Bin {
+    BBox bbox = BBOX_EMPTY;
+    uint32_t count = 0;
+  };
+  using Bins = std::array<std::array<Bin, MAX_BIN_COUNT>, 3>;
+
+  struct Split {
+    float cost = INFINITY;
+    size_t axis = 0;
+    size_t bin = 0;
+  };
+
+  void build_node(uint32_t node_index, size_t begin, size_t end, size_t depth);
+
+  Bounds compute_bounds(size_t begin, size_t end) const;
+  Bins compute_bins(const BinMapping &mapping, size_t begin, size_t end) const;
+  Split find_split(const Bounds &bounds, const BinMapping &mapping,
+                   size_t begin, size_t end) const;
+  BinMapping bin_mapping(const Bounds &bounds) const;
+
+  size_t bin_of(const BinMapping &mapping, size_t axis, uint32_t prim) const {
+    float offset = _centers[prim][axis] - mapping.min[axis];
+    size_t bin = static_cast<size_t>(offset * mapping.scale[axis]);
+    return std::min(bin, _options.binCount - 1);
+  }
+  size_t median_split(const Bounds &bounds, size_t begin, size_t end);
+
+  bool use_pool(size_t count, size_t threshold) const {
+    return _pool && count >= threshold;
+  }
+
+  // -- Attributs --
+private:
+  BvhBuildOptions _options;
+
+  // current build state
+  ThreadPool *_pool = nullptr;
+  std::span<const BBox> _bboxes;
+  std::vector<glm::vec3> _centers;
+  std::vector<uint32_t> *_indices = nullptr;
+  std::vector<BvhNode> *_nodes = nullptr;
+  std::atomic<uint32_t> _nodeCount = 0;
+  std::atomic<size_t> _leafCount = 0;
+  std::atomic<size_t> _maxDepth = 0;
+};
@@ -11,6 +11,7 @@ struct HitRecord {
   glm::vec3 normal;
   glm::vec2 uv;
   bool front_face;
+  uint32_t material = 0; // index in Scene::materials
 
   void set_face_normal(glm::vec3 ray_dir, glm::vec3 out_normal) {
     front_face = glm::dot(ray_dir, out_normal) < 0;
@@ -23,9 +24,18 @@ public:
   virtual bool hit(Ray r, Interval ray_t, HitRecord *records) const = 0;
   virtual BBox get_bbox() const = 0;
 
+  // Any intersection in ray_t, for shadow rays : no closest search and no
+  // HitRecord. Primitives override it to skip the normal / uv computation.
+  virtual bool occluded(Ray r, Interval ray_t) const {
+    HitRecord record;
+    return hit(r, ray_t, &record);
+  }
+
   virtual ~IHittable() = default;
 };
 
+// Containers of a Hittable T call T::hit qualified : the primitive type is
+// known, so the call is static and can be inlined in the traversal.
 template <typename T>
 concept Hittable = std::is_base_of_v<IHittable, T>;
 
@@ -37,8 +47,52 @@ public:
   virtual uint32_t hit(Ray r, Interval ray_t, HitRecord *records) const = 0;
   virtual std::optional<const IHittable *> get_hitted(uint32_t index) const = 0;
 
+  // Any-hit query : stops on the first intersection found in ray_t
+  virtual bool occluded(Ray r, Interval ray_t) const {
+    HitRecord record;
+    return hit(r, ray_t, &record) != MISS_INDEX;
+  }
+
+  // Packets of coherent rays, indices[k] and records[k] are the hit() result
+  // of the ray k (MISS_INDEX for inactive rays). Traced ray by ray by default.
+  virtual void hit4(const RayPacket<4> &packet, Interval ray_t,
+                    HitRecord *records, uint32_t *indices) const {
+    hit_each(packet, ray_t, records, indices);
+  }
+  virtual void hit8(const RayPacket<8> &packet, Interval ray_t,
+                    HitRecord *records, uint32_t *indices) const {
+    hit_each(packet, ray_t, records, indices);
+  }
+  virtual void hit16(const RayPacket<16> &packet, Interval ray_t,
+                     HitRecord *records, uint32_t *indices) const {
+    hit_each(packet, ray_t, records, indices);
+  }
+
+  template <size_t N>
+  void hit_packet(const RayPacket<N> &packet, Interval ray_t,
+                  HitRecord *records, uint32_t *indices) const {
+    if constexpr (N == 4)
+      hit4(packet, ray_t, records, indices);
+    else if constexpr (N == 8)
+      hit8(packet, ray_t, records, indices);
+    else if constexpr (N == 16)
+      hit16(packet, ray_t, records, indices);
+    else
+      hit_each(packet, ray_t, records, indices);
+  }
+
   // vulkan
   virtual Tlas get_gpu_struct(VulkanContext &ctx) const = 0;
+
+protected:
+  template <size_t N>
+  void hit_each(const RayPacket<N> &packet, Interval ray_t, HitRecord *records,
+                uint32_t *indices) const {
+    for (size_t k = 0; k < N; k++)
+      indices[k] = packet.is_active(k)
+                       ? hit(packet.rays[k], ray_t, &records[k])
+                       : MISS_INDEX;
+  }
 };
 
 template <Hittable T> class HittableVector : public IAccStruct {
@@ -79,8 +133,8 @@ public:
     HitRecord temp_rec;
 
     for (uint32_t i = 0; i < _objects.size(); i++) {
-      const IHittable &object = _objects[i];
-      if (object.hit(r, Interval(ray_t.min, closest_so_far), &temp_rec)) {
+      const T &object = _objects[i];
+      if (object.T::hit(r, Interval(ray_t.min, closest_so_far), &temp_rec)) {
         closest_index = i;
         closest_so_far = temp_rec.t;
         *records = temp_rec;
@@ -88,6 +142,14 @@ public:
     }
     return closest_index;
   }
+
+  bool occluded(Ray r, Interval ray_t) const override {
+    for (const T &object : _objects)
+      if (object.T::occluded(r, ray_t))
+        return true;
+    return false;
+  }
+
   std::optional<const IHittable *> get_hitted(uint32_t index) const override {
     return (index < _objects.size())
                ? std::optional<const IHittable *>{&_objects[index]}
@@ -0,0 +1,280 @@
+#include "MeshCache.h"
+
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+// -- File format --
+
+namespace {
+
+constexpr std::array<char, 8> MAGIC = {'R', 'T', 'V', 'K', 'M', 'S', 'H', 0};
+
+struct Section {
+  uint64_t offset; // from the file start, SECTION_ALIGNMENT aligned
+  uint64_t count;  // elements
+};
+
+struct Header {
+  std::array<char, 8> magic;
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t contentHash;
+  uint64_t fileSize;
+
+  Section positions;
+  Section normals;
+  Section triangles;
+  Section nodes;
+
+  // BvhBuildStats
+  uint64_t primCount;
+  uint64_t leafCount;
+  uint64_t maxDepth;
+};
+
+// the sections are the in memory arrays, their layout is part of the format
+static_assert(std::endian::native == std::endian::little);
+static_assert(sizeof(glm::vec3) == 12 && alignof(glm::vec3) <= 4);
+static_assert(sizeof(TriangleMesh::Triangle) == 12);
+static_assert(sizeof(BvhNode) == 32);
+static_assert(std::is_trivially_copyable_v<BvhNode>);
+
+size_t align_up(size_t offset) {
+  constexpr size_t MASK = MeshCache::SECTION_ALIGNMENT - 1;
+  return (offset + MASK) & ~MASK;
+}
+
+// 8 bytes per step multiply / xorshift hash, finished by splitmix64
+uint64_t hash_bytes(std::span<const std::byte> bytes, uint64_t hash) {
+  constexpr uint64_t MUL = 0x9e3779b97f4a7c15ull;
+  size_t i = 0;
+  for (; i + 8 <= bytes.size(); i += 8) {
+    uint64_t word;
+    std::memcpy(&word, bytes.data() + i, 8);
+    hash = (hash ^ word) * MUL;
+    hash ^= hash >> 29;
+  }
+  uint64_t tail = 0;
+  if (i != bytes.size())
+    std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+  hash = (hash ^ tail ^ bytes.size()) * MUL;
+  return splitmix64(&hash);
+}
+
+// section view on the mapping, empty if it doesn't fit in the file
+template <typename T>
+std::span<const T> section_view(std::span<const std::byte> file,
+                                const Section &section) {
+  if (section.offset % MeshCache::SECTION_ALIGNMENT != 0 ||
+      section.offset > file.size() ||
+      section.count > (file.size() - section.offset) / sizeof(T))
+    return {};
+  return {reinterpret_cast<const T *>(file.data() + section.offset),
+          static_cast<size_t>(section.count)};
+}
+
+// The mapped arrays are read without bounds checks by the traversal : the
+// triangles must index the positions (and the normals, when present), the
+// leaves the triangles, and the inner nodes their two children, placed after
+// them (no cycle) and within the traversal stack depth.
+bool valid_indices(std::span<const glm::vec3> positions,
+                   std::span<const glm::vec3> normals,
+                   std::span<const TriangleMesh::Triangle> triangles,
+                   std::span<const BvhNode> nodes) {
+  if (!normals.empty() && normals.size() != positions.size())
+    return false;
+
+  for (const TriangleMesh::Triangle &tri : triangles)
+    for (uint32_t vertex : tri)
+      if (vertex >= positions.size())
+        return false;
+
+  std::vector<uint32_t> depths(nodes.size(), 0);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const BvhNode &node = nodes[i];
+    if (node.is_leaf()) {
+      if (node.first > triangles.size() ||
+          node.count > triangles.size() - node.first)
+        return false;
+      continue;
+    }
+    if (node.first <= i || node.first + 1 >= nodes.size() ||
+        depths[i] + 1 >= BvhBuilder::MAX_DEPTH)
+      return false;
+    for (uint32_t child : {node.first, node.first + 1})
+      depths[child] = std::max(depths[child], depths[i] + 1);
+  }
+  return true;
+}
+
+} // namespace
+
+// -- MeshCache impl --
+
+MeshCache::MeshCache(std::filesystem::path directory)
+    : _directory(std::move(directory)) {
+  std::error_code error;
+  std::filesystem::create_directories(_directory, error);
+  if (error)
+    LOGWARN("Could not create the mesh cache {} : {}", _directory.string(),
+            error.message());
+}
+
+TriangleMesh
+MeshCache::get_or_build(std::vector<glm::vec3> &&positions,
+                        std::vector<TriangleMesh::Triangle> &&triangles,
+                        std::vector<glm::vec3> &&normals /* = {} */,
+                        BvhBuildOptions options /* = {} */) const {
+  uint64_t hash = content_hash(positions, triangles, normals, options);
+  std::filesystem::path path = get_path(hash);
+
+  if (std::filesystem::exists(path)) {
+    if (auto mesh = load(path, hash)) {
+      LOG(FINE, "mesh cache hit : {}", path.string());
+      return std::move(*mesh);
+    }
+  }
+
+  TriangleMesh mesh(std::move(positions), std::move(triangles),
+                    std::move(normals), options);
+  save(path, mesh, hash);
+  return mesh;
+}
+
+std::filesystem::path MeshCache::get_path(uint64_t hash) const {
+  return _directory / fmt::format("{:016x}{}", hash, EXTENSION);
+}
+
+uint64_t
+MeshCache::content_hash(std::span<const glm::vec3> positions,
+                        std::span<const TriangleMesh::Triangle> triangles,
+                        std::span<const glm::vec3> normals,
+                        BvhBuildOptions options) {
+  uint64_t hash = VERSION;
+  hash = hash_bytes(std::as_bytes(positions), hash);
+  hash = hash_bytes(std::as_bytes(triangles), hash);
+  hash = hash_bytes(std::as_bytes(normals), hash);
+  const uint64_t build_params[] = {options.binCount, options.maxLeafSize};
+  return hash_bytes(std::as_bytes(std::span(build_params)), hash);
+}
+
+std::optional<TriangleMesh> MeshCache::load(const std::filesystem::path &path,
+                                            uint64_t hash) {
+  std::optional<MappedFile> file = MappedFile::open(path);
+  if (!file)
+    return std::nullopt;
+
+  std::span<const std::byte> data = file->get_data();
+  Header header;
+  if (data.size() < sizeof(Header)) {
+    LOGWARN("mesh cache {} is truncated", path.string());
+    return std::nullopt;
+  }
+  std::memcpy(&header, data.data(), sizeof(Header));
+
+  if (header.magic != MAGIC || header.version != VERSION ||
+      header.headerSize != sizeof(Header)) {
+    LOGWARN("mesh cache {} has another format, it is ignored", path.string());
+    return std::nullopt;
+  }
+  if (header.contentHash != hash || header.fileSize != data.size()) {
+    LOGWARN("mesh cache {} is stale or truncated", path.string());
+    return std::nullopt;
+  }
+
+  auto positions = section_view<glm::vec3>(data, header.positions);
+  auto normals = section_view<glm::vec3>(data, header.normals);
+  auto triangles = section_view<TriangleMesh::Triangle>(data, header.triangles);
+  auto nodes = section_view<BvhNode>(data, header.nodes);
+  if (positions.size() != header.positions.count ||
+      normals.size() != header.normals.count ||
+      triangles.size() != header.triangles.count ||
+      nodes.size() != header.nodes.count) {
+    LOGWARN("mesh cache {} has out of range sections", path.string());
+    return std::nullopt;
+  }
+  if (!valid_indices(positions, normals, triangles, nodes)) {
+    LOGWARN("mesh cache {} has out of range indices", path.string());
+    return std::nullopt;
+  }
+
+  BvhBuildStats stats = {
+      .primCount = header.primCount,
+      .nodeCount = header.nodes.count,
+      .leafCount = header.leafCount,
+      .maxDepth = header.maxDepth,
+  };
+  return TriangleMesh(std::make_shared<const MappedFile>(std::move(*file)),
+                      positions, normals, triangles, nodes, stats);
+}
+
+bool MeshCache::save(const std::filesystem::path &path,
+                     const TriangleMesh &mesh, uint64_t hash) {
+  Header header = {
+      .magic = MAGIC,
+      .version = VERSION,
+      .headerSize = sizeof(Header),
+      .contentHash = hash,
+      .fileSize = 0,
+      .positions = {},
+      .normals = {},
+      .triangles = {},
+      .nodes = {},
+      .primCount = mesh.get_build_stats().primCount,
+      .leafCount = mesh.get_build_stats().leafCount,
+      .maxDepth = mesh.get_build_stats().maxDepth,
+  };
+
+  // the sections follow the header in this order
+  const std::span<const std::byte> arrays[] = {
+      std::as_bytes(mesh.get_positions()), std::as_bytes(mesh.get_normals()),
+      std::as_bytes(mesh.get_triangles()), std::as_bytes(mesh.get_nodes())};
+  Section *sections[] = {&header.positions, &header.normals,
+                         &header.triangles, &header.nodes};
+  const size_t counts[] = {mesh.get_vertex_count(), mesh.get_normals().size(),
+                           mesh.get_triangle_count(),
+                           mesh.get_nodes().size()};
+
+  size_t offset = sizeof(Header);
+  for (size_t i = 0; i < 4; i++) {
+    offset = align_up(offset);
+    *sections[i] = {offset, counts[i]};
+    offset += arrays[i].size();
+  }
+  header.fileSize = offset;
+
+  std::filesystem::path tmp_path = path;
+  tmp_path += fmt::format(".{}.tmp", std::hash<std::thread::id>{}(
+                                         std::this_thread::get_id()));
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    constexpr char PADDING[SECTION_ALIGNMENT] = {};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    size_t written = sizeof(Header);
+    for (size_t i = 0; i < 4; i++) {
+      out.write(PADDING, sections[i]->offset - written);
+      out.write(reinterpret_cast<const char *>(arrays[i].data()),
+                arrays[i].size());
+      written = sections[i]->offset + arrays[i].size();
+    }
+    if (!out) {
+      LOGWARN("Could not write the mesh cache {}", tmp_path.string());
+      std::filesystem::remove(tmp_path);
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tmp_path, path, error);
+  if (error) {
+    LOGWARN("Could not write the mesh cache {} : {}", path.string(),
+            error.message());
+    std::filesystem::remove(tmp_path, error);
+    return false;
+  }
+
+  LOG(FINE, "mesh cache written : {}, {} bytes", path.string(), offset);
+  return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "hittables/TriangleMesh.h"
+#include "types.h"
+
+#include <filesystem>
+
+// On disk cache of built TriangleMesh : one file per mesh, named after the
+// content hash of its input geometry and build options. A file is the mesh
+// arrays exactly as the mesh reads them, each in a 64 bytes aligned section,
+// so a load is a mmap and a few header checks : no parsing, no copy, no
+// pointer fixup, the pages are read in place by the traversal.
+//
+// Files are written by the machine that reads them (native endianness and
+// layout), a version or layout change only makes the old files misses.
+class MeshCache {
+public:
+  static constexpr uint32_t VERSION = 1;
+  static constexpr size_t SECTION_ALIGNMENT = 64;
+  static constexpr const char *EXTENSION = ".rtmesh";
+
+  // -- Constructors
+  MeshCache(std::filesystem::path directory);
+
+  // -- Methods
+
+  // The cached mesh of this geometry, or a new one built and stored
+  TriangleMesh get_or_build(std::vector<glm::vec3> &&positions,
+                            std::vector<TriangleMesh::Triangle> &&triangles,
+                            std::vector<glm::vec3> &&normals = {},
+                            BvhBuildOptions options = {}) const;
+
+  std::filesystem::path get_path(uint64_t hash) const;
+
+  // Hash of the mesh constructor inputs, the thread options excluded
+  static uint64_t
+  content_hash(std::span<const glm::vec3> positions,
+               std::span<const TriangleMesh::Triangle> triangles,
+               std::span<const glm::vec3> normals, BvhBuildOptions options);
+
+  // nullopt if the file is missing, truncated, from another version or
+  // another content, or if its indices point out of its arrays
+  static std::optional<TriangleMesh> load(const std::filesystem::path &path,
+                                          uint64_t hash);
+  // written in a temporary file then renamed, a reader never sees a
+  // partial file. Returns false (and warns) on io errors.
+  static bool save(const std::filesystem::path &path, const TriangleMesh &mesh,
+                   uint64_t hash);
+
+  // -- Members
+private:
+  std::filesystem::path _directory;
+};
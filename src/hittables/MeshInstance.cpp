@@ -0,0 +1,68 @@
+#include "MeshInstance.h"
+
+#include <unordered_map>
+
+// -- MeshInstance impl --
+
+MeshInstance::MeshInstance(std::shared_ptr<const TriangleMesh> mesh,
+                           const glm::mat4 &transform /* = glm::mat4(1.f) */)
+    : _mesh(std::move(mesh)), _objectToWorld(transform),
+      _worldToObject(glm::inverse(transform)),
+      _normalMatrix(glm::transpose(glm::mat3(_worldToObject))),
+      _bbox(BBOX_EMPTY) {
+  if (_mesh->get_triangle_count() == 0)
+    return;
+  BBox local = _mesh->get_bbox();
+
+  // bbox of the 8 transformed corners
+  glm::vec3 corners[2] = {local.get_min(), local.get_max()};
+  for (int i = 0; i < 8; i++) {
+    glm::vec3 corner(corners[i & 1].x, corners[(i >> 1) & 1].y,
+                     corners[(i >> 2) & 1].z);
+    glm::vec3 p(_objectToWorld * glm::vec4(corner, 1.f));
+    _bbox = _bbox.merge(BBox(p, p));
+  }
+}
+
+bool MeshInstance::hit(Ray r, Interval ray_t, HitRecord *rec) const {
+  if (!_mesh->TriangleMesh::hit(to_object(r), ray_t, rec))
+    return false;
+
+  // the side is kept : dot(M d, M^-T n) = dot(d, n)
+  rec->p = r.at(rec->t);
+  rec->normal = glm::normalize(_normalMatrix * rec->normal);
+  return true;
+}
+
+// -- InstanceBvh impl --
+
+Tlas InstanceBvh::get_gpu_struct(VulkanContext &ctx) const {
+  std::unordered_map<const TriangleMesh *, uint32_t> blas_indices;
+  std::vector<Blas> blas_vec;
+  std::vector<TlasInstance> instances;
+  instances.reserve(get_object_count());
+
+  for (const MeshInstance &instance : get_objects()) {
+    const TriangleMesh &mesh = instance.get_mesh();
+    auto [it, inserted] = blas_indices.try_emplace(
+        &mesh, static_cast<uint32_t>(blas_vec.size()));
+
+    if (inserted) {
+      std::vector<VkAabbPositionsKHR> aabbs;
+      aabbs.reserve(mesh.get_triangle_count());
+      std::span<const glm::vec3> positions = mesh.get_positions();
+      for (const TriangleMesh::Triangle &tri : mesh.get_triangles()) {
+        glm::vec3 v0 = positions[tri[0]];
+        glm::vec3 v1 = positions[tri[1]];
+        glm::vec3 v2 = positions[tri[2]];
+        aabbs.push_back(BBox(glm::min(v0, glm::min(v1, v2)),
+                             glm::max(v0, glm::max(v1, v2)))
+                            .to_vk());
+      }
+      blas_vec.emplace_back(ctx, aabbs);
+    }
+    instances.push_back({it->second, instance.get_transform()});
+  }
+
+  return Tlas(ctx, std::move(blas_vec), instances);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "hittables/BvhAccStruct.h"
+#include "hittables/TriangleMesh.h"
+#include "types.h"
+
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <memory>
+
+// A TriangleMesh placed in the world by an affine transform. The mesh and its
+// bvh are shared by all its instances : the rays are moved to the mesh space,
+// with an unnormalized direction so the hit distance t is the world one.
+class MeshInstance : public IHittable {
+public:
+  // -- Constructors
+  MeshInstance(std::shared_ptr<const TriangleMesh> mesh,
+               const glm::mat4 &transform = glm::mat4(1.f));
+
+  // -- IHittable impl
+  bool hit(Ray r, Interval ray_t, HitRecord *rec) const override;
+  bool occluded(Ray r, Interval ray_t) const override {
+    return _mesh->TriangleMesh::occluded(to_object(r), ray_t);
+  }
+  BBox get_bbox() const override { return _bbox; }
+
+  // -- Getters
+  const TriangleMesh &get_mesh() const { return *_mesh; }
+  const glm::mat4 &get_transform() const { return _objectToWorld; }
+
+private:
+  Ray to_object(const Ray &r) const {
+    return {glm::vec3(_worldToObject * glm::vec4(r.origin, 1.f)),
+            glm::vec3(_worldToObject * glm::vec4(r.direction, 0.f))};
+  }
+
+  // -- Members
+private:
+  std::shared_ptr<const TriangleMesh> _mesh;
+  glm::mat4 _objectToWorld;
+  glm::mat4 _worldToObject;
+  glm::mat3 _normalMatrix; // inverse transpose of the linear part
+  BBox _bbox;              // world space
+};
+
+// Two level acceleration structure : a bvh over the instances bboxes, each
+// instance traversing the bvh of its mesh. On the gpu, one Blas per distinct
+// mesh and one Tlas instance per MeshInstance, with its transform.
+class InstanceBvh final : public BvhAccStruct<MeshInstance> {
+public:
+  using BvhAccStruct::BvhAccStruct;
+
+  Tlas get_gpu_struct(VulkanContext &ctx) const override;
+};
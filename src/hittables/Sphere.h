@@ -6,7 +6,8 @@
 
 class Sphere : public IHittable {
 public:
-  Sphere(glm::vec3 center, float radius) : _center(center), _radius(radius) {}
+  Sphere(glm::vec3 center, float radius, uint32_t material = 0)
+      : _center(center), _radius(radius), _material(material) {}
 
   ~Sphere() {}
 
@@ -37,14 +38,37 @@ public:
 
     glm::vec3 out_normal = (rec->p - _center) / _radius;
     rec->set_face_normal(r.direction, out_normal);
+    rec->material = _material;
 
     return true;
   }
+
+  bool occluded(Ray r, Interval ray_t) const override {
+    glm::vec3 oc = _center - r.origin;
+    float a = lenght_sq(r.direction);
+    float h = dot(r.direction, oc);
+    float c = lenght_sq(oc) - _radius * _radius;
+
+    float discriminant = h * h - a * c;
+    if (discriminant < 0)
+      return false;
+
+    float delta = std::sqrt(discriminant);
+    return ray_t.contains_open((h - delta) / a) ||
+           ray_t.contains_open((h + delta) / a);
+  }
+
   BBox get_bbox() const override {
     return BBox(_center - _radius, _center + _radius);
   }
 
+  // -- Getters
+  glm::vec3 get_center() const { return _center; }
+  float get_radius() const { return _radius; }
+  uint32_t get_material() const { return _material; }
+
 private:
   glm::vec3 _center;
   float _radius;
+  uint32_t _material;
 };
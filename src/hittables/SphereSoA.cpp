@@ -0,0 +1,293 @@
+#include "SphereSoA.h"
+
+#include <bit>
+
+// All kernels follow Sphere::hit : nearest root in the open interval, else the
+// farthest one. A negative discriminant (or a NaN padding radius) gives NaN
+// roots, which fail every comparison. The SIMD kernels use FMA, their roots can
+// differ from Sphere::hit in the last bits near tangency.
+
+static uint32_t closest_scalar(const float *cx, const float *cy,
+                               const float *cz, const float *radius,
+                               size_t count, Ray r, Interval ray_t, float *t) {
+  float a = lenght_sq(r.direction);
+  float closest_so_far = ray_t.max;
+  uint32_t closest_index = IAccStruct::MISS_INDEX;
+
+  for (size_t i = 0; i < count; i++) {
+    glm::vec3 oc = glm::vec3(cx[i], cy[i], cz[i]) - r.origin;
+    float h = glm::dot(r.direction, oc);
+    float c = lenght_sq(oc) - radius[i] * radius[i];
+    float delta = std::sqrt(h * h - a * c);
+
+    float root = (h - delta) / a;
+    if (!(ray_t.min < root && root < closest_so_far))
+      root = (h + delta) / a;
+    if (ray_t.min < root && root < closest_so_far) {
+      closest_so_far = root;
+      closest_index = static_cast<uint32_t>(i);
+    }
+  }
+
+  *t = closest_so_far;
+  return closest_index;
+}
+
+static bool any_scalar(const float *cx, const float *cy, const float *cz,
+                       const float *radius, size_t count, Ray r,
+                       Interval ray_t) {
+  float a = lenght_sq(r.direction);
+  for (size_t i = 0; i < count; i++) {
+    glm::vec3 oc = glm::vec3(cx[i], cy[i], cz[i]) - r.origin;
+    float h = glm::dot(r.direction, oc);
+    float c = lenght_sq(oc) - radius[i] * radius[i];
+    float delta = std::sqrt(h * h - a * c);
+
+    if (ray_t.contains_open((h - delta) / a) ||
+        ray_t.contains_open((h + delta) / a))
+      return true;
+  }
+  return false;
+}
+
+// Lanes keep their own closest t and index, reduced at the end
+static uint32_t reduce_lanes(const float *lane_t, const int32_t *lane_index,
+                             size_t lane_count, float *t) {
+  uint32_t closest_index = IAccStruct::MISS_INDEX;
+  for (size_t lane = 0; lane < lane_count; lane++) {
+    if (lane_index[lane] < 0)
+      continue;
+    uint32_t index = static_cast<uint32_t>(lane_index[lane]);
+    if (closest_index == IAccStruct::MISS_INDEX || lane_t[lane] < *t ||
+        (lane_t[lane] == *t && index < closest_index)) {
+      *t = lane_t[lane];
+      closest_index = index;
+    }
+  }
+  return closest_index;
+}
+
+#ifdef RTVK_X86
+
+RTVK_TARGET("avx2,fma")
+static uint32_t closest_avx2(const float *cx, const float *cy, const float *cz,
+                             const float *radius, size_t count, Ray r,
+                             Interval ray_t, float *t) {
+  const __m256 ox = _mm256_set1_ps(r.origin.x);
+  const __m256 oy = _mm256_set1_ps(r.origin.y);
+  const __m256 oz = _mm256_set1_ps(r.origin.z);
+  const __m256 dx = _mm256_set1_ps(r.direction.x);
+  const __m256 dy = _mm256_set1_ps(r.direction.y);
+  const __m256 dz = _mm256_set1_ps(r.direction.z);
+  const __m256 a = _mm256_set1_ps(lenght_sq(r.direction));
+  const __m256 t_min = _mm256_set1_ps(ray_t.min);
+
+  __m256 best_t = _mm256_set1_ps(ray_t.max);
+  __m256i best_index = _mm256_set1_epi32(-1);
+  __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i step = _mm256_set1_epi32(8);
+
+  for (size_t i = 0; i < count; i += 8) {
+    __m256 ocx = _mm256_sub_ps(_mm256_load_ps(cx + i), ox);
+    __m256 ocy = _mm256_sub_ps(_mm256_load_ps(cy + i), oy);
+    __m256 ocz = _mm256_sub_ps(_mm256_load_ps(cz + i), oz);
+    __m256 rad = _mm256_load_ps(radius + i);
+
+    __m256 h = _mm256_fmadd_ps(
+        dz, ocz, _mm256_fmadd_ps(dy, ocy, _mm256_mul_ps(dx, ocx)));
+    __m256 oc_sq = _mm256_fmadd_ps(
+        ocz, ocz, _mm256_fmadd_ps(ocy, ocy, _mm256_mul_ps(ocx, ocx)));
+    __m256 c = _mm256_fnmadd_ps(rad, rad, oc_sq);
+    __m256 delta =
+        _mm256_sqrt_ps(_mm256_fnmadd_ps(a, c, _mm256_mul_ps(h, h)));
+
+    __m256 root0 = _mm256_div_ps(_mm256_sub_ps(h, delta), a);
+    __m256 root1 = _mm256_div_ps(_mm256_add_ps(h, delta), a);
+    __m256 ok0 = _mm256_and_ps(_mm256_cmp_ps(root0, t_min, _CMP_GT_OQ),
+                               _mm256_cmp_ps(root0, best_t, _CMP_LT_OQ));
+    __m256 ok1 = _mm256_and_ps(_mm256_cmp_ps(root1, t_min, _CMP_GT_OQ),
+                               _mm256_cmp_ps(root1, best_t, _CMP_LT_OQ));
+    __m256 root = _mm256_blendv_ps(root1, root0, ok0);
+    __m256 ok = _mm256_or_ps(ok0, ok1);
+
+    best_t = _mm256_blendv_ps(best_t, root, ok);
+    best_index = _mm256_castps_si256(_mm256_blendv_ps(
+        _mm256_castsi256_ps(best_index), _mm256_castsi256_ps(index), ok));
+    index = _mm256_add_epi32(index, step);
+  }
+
+  alignas(32) float lane_t[8];
+  alignas(32) int32_t lane_index[8];
+  _mm256_store_ps(lane_t, best_t);
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lane_index), best_index);
+  return reduce_lanes(lane_t, lane_index, 8, t);
+}
+
+RTVK_TARGET("avx512f,avx512vl,avx512dq")
+static uint32_t closest_avx512(const float *cx, const float *cy,
+                               const float *cz, const float *radius,
+                               size_t count, Ray r, Interval ray_t, float *t) {
+  const __m512 ox = _mm512_set1_ps(r.origin.x);
+  const __m512 oy = _mm512_set1_ps(r.origin.y);
+  const __m512 oz = _mm512_set1_ps(r.origin.z);
+  const __m512 dx = _mm512_set1_ps(r.direction.x);
+  const __m512 dy = _mm512_set1_ps(r.direction.y);
+  const __m512 dz = _mm512_set1_ps(r.direction.z);
+  const __m512 a = _mm512_set1_ps(lenght_sq(r.direction));
+  const __m512 t_min = _mm512_set1_ps(ray_t.min);
+
+  __m512 best_t = _mm512_set1_ps(ray_t.max);
+  __m512i best_index = _mm512_set1_epi32(-1);
+  __m512i index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                    13, 14, 15);
+  const __m512i step = _mm512_set1_epi32(16);
+
+  for (size_t i = 0; i < count; i += 16) {
+    __m512 ocx = _mm512_sub_ps(_mm512_load_ps(cx + i), ox);
+    __m512 ocy = _mm512_sub_ps(_mm512_load_ps(cy + i), oy);
+    __m512 ocz = _mm512_sub_ps(_mm512_load_ps(cz + i), oz);
+    __m512 rad = _mm512_load_ps(radius + i);
+
+    __m512 h = _mm512_fmadd_ps(
+        dz, ocz, _mm512_fmadd_ps(dy, ocy, _mm512_mul_ps(dx, ocx)));
+    __m512 oc_sq = _mm512_fmadd_ps(
+        ocz, ocz, _mm512_fmadd_ps(ocy, ocy, _mm512_mul_ps(ocx, ocx)));
+    __m512 c = _mm512_fnmadd_ps(rad, rad, oc_sq);
+    __m512 delta =
+        _mm512_sqrt_ps(_mm512_fnmadd_ps(a, c, _mm512_mul_ps(h, h)));
+
+    __m512 root0 = _mm512_div_ps(_mm512_sub_ps(h, delta), a);
+    __m512 root1 = _mm512_div_ps(_mm512_add_ps(h, delta), a);
+    __mmask16 ok0 = _mm512_cmp_ps_mask(root0, t_min, _CMP_GT_OQ) &
+                    _mm512_cmp_ps_mask(root0, best_t, _CMP_LT_OQ);
+    __mmask16 ok1 = _mm512_cmp_ps_mask(root1, t_min, _CMP_GT_OQ) &
+                    _mm512_cmp_ps_mask(root1, best_t, _CMP_LT_OQ);
+    __m512 root = _mm512_mask_blend_ps(ok0, root1, root0);
+    __mmask16 ok = ok0 | ok1;
+
+    best_t = _mm512_mask_blend_ps(ok, best_t, root);
+    best_index = _mm512_mask_blend_epi32(ok, best_index, index);
+    index = _mm512_add_epi32(index, step);
+  }
+
+  alignas(64) float lane_t[16];
+  alignas(64) int32_t lane_index[16];
+  _mm512_store_ps(lane_t, best_t);
+  _mm512_store_si512(lane_index, best_index);
+  return reduce_lanes(lane_t, lane_index, 16, t);
+}
+
+// Any-hit kernels : the same roots, out on the first block with a lane in
+// the interval
+
+RTVK_TARGET("avx2,fma")
+static bool any_avx2(const float *cx, const float *cy, const float *cz,
+                     const float *radius, size_t count, Ray r,
+                     Interval ray_t) {
+  const __m256 ox = _mm256_set1_ps(r.origin.x);
+  const __m256 oy = _mm256_set1_ps(r.origin.y);
+  const __m256 oz = _mm256_set1_ps(r.origin.z);
+  const __m256 dx = _mm256_set1_ps(r.direction.x);
+  const __m256 dy = _mm256_set1_ps(r.direction.y);
+  const __m256 dz = _mm256_set1_ps(r.direction.z);
+  const __m256 a = _mm256_set1_ps(lenght_sq(r.direction));
+  const __m256 t_min = _mm256_set1_ps(ray_t.min);
+  const __m256 t_max = _mm256_set1_ps(ray_t.max);
+
+  for (size_t i = 0; i < count; i += 8) {
+    __m256 ocx = _mm256_sub_ps(_mm256_load_ps(cx + i), ox);
+    __m256 ocy = _mm256_sub_ps(_mm256_load_ps(cy + i), oy);
+    __m256 ocz = _mm256_sub_ps(_mm256_load_ps(cz + i), oz);
+    __m256 rad = _mm256_load_ps(radius + i);
+
+    __m256 h = _mm256_fmadd_ps(
+        dz, ocz, _mm256_fmadd_ps(dy, ocy, _mm256_mul_ps(dx, ocx)));
+    __m256 oc_sq = _mm256_fmadd_ps(
+        ocz, ocz, _mm256_fmadd_ps(ocy, ocy, _mm256_mul_ps(ocx, ocx)));
+    __m256 c = _mm256_fnmadd_ps(rad, rad, oc_sq);
+    __m256 delta =
+        _mm256_sqrt_ps(_mm256_fnmadd_ps(a, c, _mm256_mul_ps(h, h)));
+
+    __m256 root0 = _mm256_div_ps(_mm256_sub_ps(h, delta), a);
+    __m256 root1 = _mm256_div_ps(_mm256_add_ps(h, delta), a);
+    __m256 ok0 = _mm256_and_ps(_mm256_cmp_ps(root0, t_min, _CMP_GT_OQ),
+                               _mm256_cmp_ps(root0, t_max, _CMP_LT_OQ));
+    __m256 ok1 = _mm256_and_ps(_mm256_cmp_ps(root1, t_min, _CMP_GT_OQ),
+                               _mm256_cmp_ps(root1, t_max, _CMP_LT_OQ));
+    if (_mm256_movemask_ps(_mm256_or_ps(ok0, ok1)) != 0)
+      return true;
+  }
+  return false;
+}
+
+RTVK_TARGET("avx512f,avx512vl,avx512dq")
+static bool any_avx512(const float *cx, const float *cy, const float *cz,
+                       const float *radius, size_t count, Ray r,
+                       Interval ray_t) {
+  const __m512 ox = _mm512_set1_ps(r.origin.x);
+  const __m512 oy = _mm512_set1_ps(r.origin.y);
+  const __m512 oz = _mm512_set1_ps(r.origin.z);
+  const __m512 dx = _mm512_set1_ps(r.direction.x);
+  const __m512 dy = _mm512_set1_ps(r.direction.y);
+  const __m512 dz = _mm512_set1_ps(r.direction.z);
+  const __m512 a = _mm512_set1_ps(lenght_sq(r.direction));
+  const __m512 t_min = _mm512_set1_ps(ray_t.min);
+  const __m512 t_max = _mm512_set1_ps(ray_t.max);
+
+  for (size_t i = 0; i < count; i += 16) {
+    __m512 ocx = _mm512_sub_ps(_mm512_load_ps(cx + i), ox);
+    __m512 ocy = _mm512_sub_ps(_mm512_load_ps(cy + i), oy);
+    __m512 ocz = _mm512_sub_ps(_mm512_load_ps(cz + i), oz);
+    __m512 rad = _mm512_load_ps(radius + i);
+
+    __m512 h = _mm512_fmadd_ps(
+        dz, ocz, _mm512_fmadd_ps(dy, ocy, _mm512_mul_ps(dx, ocx)));
+    __m512 oc_sq = _mm512_fmadd_ps(
+        ocz, ocz, _mm512_fmadd_ps(ocy, ocy, _mm512_mul_ps(ocx, ocx)));
+    __m512 c = _mm512_fnmadd_ps(rad, rad, oc_sq);
+    __m512 delta =
+        _mm512_sqrt_ps(_mm512_fnmadd_ps(a, c, _mm512_mul_ps(h, h)));
+
+    __m512 root0 = _mm512_div_ps(_mm512_sub_ps(h, delta), a);
+    __m512 root1 = _mm512_div_ps(_mm512_add_ps(h, delta), a);
+    __mmask16 ok0 = _mm512_cmp_ps_mask(root0, t_min, _CMP_GT_OQ) &
+                    _mm512_cmp_ps_mask(root0, t_max, _CMP_LT_OQ);
+    __mmask16 ok1 = _mm512_cmp_ps_mask(root1, t_min, _CMP_GT_OQ) &
+                    _mm512_cmp_ps_mask(root1, t_max, _CMP_LT_OQ);
+    if ((ok0 | ok1) != 0)
+      return true;
+  }
+  return false;
+}
+
+#endif
+
+// -- Methods
+
+uint32_t SphereSoA::closest(Ray r, Interval ray_t, float *t) const {
+  const size_t count = _radius.size(); // padded
+#ifdef RTVK_X86
+  if (_simdLevel >= SimdLevel::Avx512)
+    return closest_avx512(_centerX.data(), _centerY.data(), _centerZ.data(),
+                          _radius.data(), count, r, ray_t, t);
+  if (_simdLevel >= SimdLevel::Avx2)
+    return closest_avx2(_centerX.data(), _centerY.data(), _centerZ.data(),
+                        _radius.data(), count, r, ray_t, t);
+#endif
+  return closest_scalar(_centerX.data(), _centerY.data(), _centerZ.data(),
+                        _radius.data(), count, r, ray_t, t);
+}
+
+bool SphereSoA::any(Ray r, Interval ray_t) const {
+  const size_t count = _radius.size(); // padded
+#ifdef RTVK_X86
+  if (_simdLevel >= SimdLevel::Avx512)
+    return any_avx512(_centerX.data(), _centerY.data(), _centerZ.data(),
+                      _radius.data(), count, r, ray_t);
+  if (_simdLevel >= SimdLevel::Avx2)
+    return any_avx2(_centerX.data(), _centerY.data(), _centerZ.data(),
+                    _radius.data(), count, r, ray_t);
+#endif
+  return any_scalar(_centerX.data(), _centerY.data(), _centerZ.data(),
+                    _radius.data(), count, r, ray_t);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "hittables/Hittable.h"
+#include "hittables/Sphere.h"
+#include "types.h"
+#include "utils/simd.h"
+
+// Spheres stored as structure of arrays (centers x/y/z and radii in separate
+// 64 bytes aligned arrays), intersected 16 (AVX-512) or 8 (AVX2) at a time.
+// Lanes only keep their closest t, the HitRecord (point, normal) is computed
+// once for the final closest sphere.
+class SphereSoA : public IAccStruct {
+public:
+  // arrays are padded to this size with NaN radii that never hit
+  static constexpr size_t BLOCK_SIZE = 16;
+
+  // -- Constructors
+  SphereSoA() : _simdLevel(cpu_simd_level()) {}
+
+  SphereSoA(std::vector<Sphere> &&spheres) : SphereSoA() {
+    _spheres = std::move(spheres);
+    _centerX.reserve(padded_size(_spheres.size()));
+    _centerY.reserve(padded_size(_spheres.size()));
+    _centerZ.reserve(padded_size(_spheres.size()));
+    _radius.reserve(padded_size(_spheres.size()));
+    for (const Sphere &sphere : _spheres)
+      push_soa(sphere);
+    pad();
+  }
+
+  NO_COPY(SphereSoA);
+
+  ~SphereSoA() {}
+
+  SphereSoA(SphereSoA &&other) = default;
+  SphereSoA &operator=(SphereSoA &&other) = default;
+
+  // -- Methods
+  void push(Sphere sphere) {
+    // drop the padding, push, and pad again
+    size_t count = _spheres.size();
+    _centerX.resize(count);
+    _centerY.resize(count);
+    _centerZ.resize(count);
+    _radius.resize(count);
+
+    _spheres.push_back(sphere);
+    push_soa(sphere);
+    pad();
+  }
+
+  // Closest sphere in (ray_t.min, ray_t.max), without any HitRecord.
+  uint32_t closest(Ray r, Interval ray_t, float *t) const;
+  // Whether any sphere is hit in (ray_t.min, ray_t.max)
+  bool any(Ray r, Interval ray_t) const;
+
+  // -- Getters
+  size_t size() const { return _spheres.size(); }
+  SimdLevel get_simd_level() const { return _simdLevel; }
+  // for benchmarks : force a slower kernel
+  void set_simd_level(SimdLevel level) {
+    _simdLevel = std::min(level, cpu_simd_level());
+  }
+
+  // -- IAccStruct impl
+  uint32_t hit(Ray r, Interval ray_t, HitRecord *records) const override {
+    float t;
+    uint32_t index = closest(r, ray_t, &t);
+    if (index == MISS_INDEX)
+      return MISS_INDEX;
+
+    glm::vec3 center(_centerX[index], _centerY[index], _centerZ[index]);
+    records->t = t;
+    records->p = r.at(t);
+    records->set_face_normal(r.direction,
+                             (records->p - center) / _radius[index]);
+    records->material = _spheres[index].get_material();
+    return index;
+  }
+
+  bool occluded(Ray r, Interval ray_t) const override { return any(r, ray_t); }
+
+  std::optional<const IHittable *> get_hitted(uint32_t index) const override {
+    return (index < _spheres.size())
+               ? std::optional<const IHittable *>{&_spheres[index]}
+               : std::nullopt;
+  }
+
+  Tlas get_gpu_struct(VulkanContext &ctx) const override {
+    std::vector<VkAabbPositionsKHR> aabbs;
+    for (auto &sphere : _spheres)
+      aabbs.push_back(sphere.get_bbox().to_vk());
+
+    std::vector<Blas> blas_vec;
+    blas_vec.emplace_back(ctx, aabbs);
+
+    return Tlas(ctx, std::move(blas_vec));
+  }
+
+private:
+  static size_t padded_size(size_t count) {
+    return (count + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+  }
+
+  void push_soa(const Sphere &sphere) {
+    glm::vec3 center = sphere.get_center();
+    _centerX.push_back(center.x);
+    _centerY.push_back(center.y);
+    _centerZ.push_back(center.z);
+    _radius.push_back(sphere.get_radius());
+  }
+
+  void pad() {
+    size_t padded = padded_size(_spheres.size());
+    _centerX.resize(padded, 0.f);
+    _centerY.resize(padded, 0.f);
+    _centerZ.resize(padded, 0.f);
+    _radius.resize(padded, NAN);
+  }
+
+  // -- Members
+private:
+  // hot data, padded to BLOCK_SIZE
+  AlignedVector<float> _centerX, _centerY, _centerZ;
+  AlignedVector<float> _radius;
+
+  // cold data, for get_hitted and the gpu
+  std::vector<Sphere> _spheres;
+  SimdLevel _simdLevel;
+};
@@ -0,0 +1,280 @@
+#include "TriangleMesh.h"
+
+// -- Watertight ray / triangle test --
+
+namespace {
+
+// Ray transformed once per mesh query : kz is the dominant axis of the
+// direction, the triangles are sheared so the ray goes along +z
+struct WatertightRay {
+  glm::vec3 origin;
+  glm::vec3 invDir;
+  int kx, ky, kz;
+  float sx, sy, sz;
+
+  WatertightRay(const Ray &r) : origin(r.origin), invDir(1.f / r.direction) {
+    glm::vec3 abs_dir = glm::abs(r.direction);
+    kz = abs_dir.x > abs_dir.y ? (abs_dir.x > abs_dir.z ? 0 : 2)
+                               : (abs_dir.y > abs_dir.z ? 1 : 2);
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+    // keep the winding
+    if (r.direction[kz] < 0)
+      std::swap(kx, ky);
+
+    sx = r.direction[kx] / r.direction[kz];
+    sy = r.direction[ky] / r.direction[kz];
+    sz = 1.f / r.direction[kz];
+  }
+};
+
+struct TriangleHit {
+  float t;
+  float b0, b1, b2; // barycentrics of v0, v1, v2
+};
+
+bool intersect_triangle(const WatertightRay &ray, glm::vec3 v0, glm::vec3 v1,
+                        glm::vec3 v2, Interval ray_t, TriangleHit *hit) {
+  glm::vec3 a = v0 - ray.origin;
+  glm::vec3 b = v1 - ray.origin;
+  glm::vec3 c = v2 - ray.origin;
+
+  float ax = a[ray.kx] - ray.sx * a[ray.kz];
+  float ay = a[ray.ky] - ray.sy * a[ray.kz];
+  float bx = b[ray.kx] - ray.sx * b[ray.kz];
+  float by = b[ray.ky] - ray.sy * b[ray.kz];
+  float cx = c[ray.kx] - ray.sx * c[ray.kz];
+  float cy = c[ray.ky] - ray.sy * c[ray.kz];
+
+  float u = cx * by - cy * bx;
+  float v = ax * cy - ay * cx;
+  float w = bx * ay - by * ax;
+
+  // on an edge : the float result can't be trusted, redo it in double
+  if (u == 0.f || v == 0.f || w == 0.f) {
+    u = static_cast<float>(static_cast<double>(cx) * by -
+                           static_cast<double>(cy) * bx);
+    v = static_cast<float>(static_cast<double>(ax) * cy -
+                           static_cast<double>(ay) * cx);
+    w = static_cast<float>(static_cast<double>(bx) * ay -
+                           static_cast<double>(by) * ax);
+  }
+
+  if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+    return false;
+
+  float det = u + v + w;
+  if (det == 0.f)
+    return false;
+
+  float az = ray.sz * a[ray.kz];
+  float bz = ray.sz * b[ray.kz];
+  float cz = ray.sz * c[ray.kz];
+  float t = (u * az + v * bz + w * cz) / det;
+  if (!ray_t.contains_open(t))
+    return false;
+
+  float inv_det = 1.f / det;
+  *hit = {t, u * inv_det, v * inv_det, w * inv_det};
+  return true;
+}
+
+} // namespace
+
+// -- TriangleMesh impl --
+
+// -- Constructors
+
+TriangleMesh::TriangleMesh(std::vector<glm::vec3> &&positions,
+                           std::vector<Triangle> &&triangles,
+                           std::vector<glm::vec3> &&normals /* = {} */,
+                           BvhBuildOptions options /* = {} */)
+    : _ownedPositions(std::move(positions)), _ownedNormals(std::move(normals)),
+      _ownedTriangles(std::move(triangles)) {
+  if (!_ownedNormals.empty() &&
+      _ownedNormals.size() != _ownedPositions.size()) {
+    LOGWARN("mesh normals count ({}) differs from the positions one ({}), "
+            "they are ignored",
+            _ownedNormals.size(), _ownedPositions.size());
+    _ownedNormals.clear();
+  }
+
+  size_t vertex_count = _ownedPositions.size();
+  size_t valid_count = 0;
+  for (const Triangle &tri : _ownedTriangles)
+    if (tri[0] < vertex_count && tri[1] < vertex_count &&
+        tri[2] < vertex_count)
+      _ownedTriangles[valid_count++] = tri;
+  if (valid_count != _ownedTriangles.size()) {
+    LOGWARN("{} mesh triangles have out of range indices, they are dropped",
+            _ownedTriangles.size() - valid_count);
+    _ownedTriangles.resize(valid_count);
+  }
+
+  build(options);
+
+  _positions = _ownedPositions;
+  _normals = _ownedNormals;
+  _triangles = _ownedTriangles;
+  _nodes = _ownedNodes;
+}
+
+// -- Methods
+
+bool TriangleMesh::hit(Ray r, Interval ray_t, HitRecord *rec) const {
+  if (_nodes.empty())
+    return false;
+
+  const WatertightRay wray(r);
+  float closest_so_far = ray_t.max;
+  uint32_t closest_index = IAccStruct::MISS_INDEX;
+  TriangleHit closest_hit = {}, temp_hit;
+
+  std::array<uint32_t, MAX_DEPTH> stack;
+  size_t stack_size = 0;
+  if (_nodes[0].bbox.hit(wray.origin, wray.invDir, ray_t))
+    stack[stack_size++] = 0;
+
+  while (stack_size != 0) {
+    const BvhNode &node = _nodes[stack[--stack_size]];
+
+    if (node.is_leaf()) {
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        const Triangle &tri = _triangles[i];
+        if (intersect_triangle(wray, _positions[tri[0]], _positions[tri[1]],
+                               _positions[tri[2]],
+                               Interval(ray_t.min, closest_so_far),
+                               &temp_hit)) {
+          closest_index = i;
+          closest_so_far = temp_hit.t;
+          closest_hit = temp_hit;
+        }
+      }
+      continue;
+    }
+
+    float left_t, right_t;
+    Interval search_t = {ray_t.min, closest_so_far};
+    bool left_hit =
+        _nodes[node.first].bbox.hit(wray.origin, wray.invDir, search_t,
+                                    &left_t);
+    bool right_hit =
+        _nodes[node.first + 1].bbox.hit(wray.origin, wray.invDir, search_t,
+                                        &right_t);
+
+    // the nearest child is popped first
+    if (left_hit && right_hit) {
+      bool left_first = left_t <= right_t;
+      stack[stack_size++] = left_first ? node.first + 1 : node.first;
+      stack[stack_size++] = left_first ? node.first : node.first + 1;
+    } else if (left_hit) {
+      stack[stack_size++] = node.first;
+    } else if (right_hit) {
+      stack[stack_size++] = node.first + 1;
+    }
+  }
+
+  if (closest_index == IAccStruct::MISS_INDEX)
+    return false;
+
+  // the HitRecord is only filled for the closest triangle
+  const Triangle &tri = _triangles[closest_index];
+  glm::vec3 v0 = _positions[tri[0]];
+  glm::vec3 geometric_normal = glm::normalize(
+      glm::cross(_positions[tri[1]] - v0, _positions[tri[2]] - v0));
+
+  rec->t = closest_hit.t;
+  rec->p = r.at(closest_hit.t);
+  rec->uv = {closest_hit.b1, closest_hit.b2};
+  rec->material = _material;
+  if (_normals.empty()) {
+    rec->set_face_normal(r.direction, geometric_normal);
+  } else {
+    glm::vec3 shading_normal = glm::normalize(
+        closest_hit.b0 * _normals[tri[0]] + closest_hit.b1 * _normals[tri[1]] +
+        closest_hit.b2 * _normals[tri[2]]);
+    // the side is given by the geometry
+    rec->set_face_normal(r.direction, geometric_normal);
+    rec->normal = rec->front_face ? shading_normal : -shading_normal;
+  }
+  return true;
+}
+
+bool TriangleMesh::occluded(Ray r, Interval ray_t) const {
+  if (_nodes.empty())
+    return false;
+
+  const WatertightRay wray(r);
+  TriangleHit temp_hit;
+
+  std::array<uint32_t, MAX_DEPTH> stack;
+  size_t stack_size = 0;
+  if (_nodes[0].bbox.hit(wray.origin, wray.invDir, ray_t))
+    stack[stack_size++] = 0;
+
+  while (stack_size != 0) {
+    const BvhNode &node = _nodes[stack[--stack_size]];
+
+    if (node.is_leaf()) {
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        const Triangle &tri = _triangles[i];
+        if (intersect_triangle(wray, _positions[tri[0]], _positions[tri[1]],
+                               _positions[tri[2]], ray_t, &temp_hit))
+          return true;
+      }
+      continue;
+    }
+
+    if (_nodes[node.first + 1].bbox.hit(wray.origin, wray.invDir, ray_t))
+      stack[stack_size++] = node.first + 1;
+    if (_nodes[node.first].bbox.hit(wray.origin, wray.invDir, ray_t))
+      stack[stack_size++] = node.first;
+  }
+  return false;
+}
+
+void TriangleMesh::build(BvhBuildOptions options) {
+  std::vector<BBox> bboxes;
+  bboxes.reserve(_ownedTriangles.size());
+  for (const Triangle &tri : _ownedTriangles) {
+    glm::vec3 v0 = _ownedPositions[tri[0]];
+    glm::vec3 v1 = _ownedPositions[tri[1]];
+    glm::vec3 v2 = _ownedPositions[tri[2]];
+    bboxes.emplace_back(glm::min(v0, glm::min(v1, v2)),
+                        glm::max(v0, glm::max(v1, v2)));
+  }
+
+  std::vector<uint32_t> prim_order;
+  _buildStats = BvhBuilder(options).build(bboxes, &_ownedNodes, &prim_order);
+
+  // triangles in leaves order
+  std::vector<Triangle> ordered;
+  ordered.reserve(_ownedTriangles.size());
+  for (uint32_t index : prim_order)
+    ordered.push_back(_ownedTriangles[index]);
+  _ownedTriangles = std::move(ordered);
+
+  // vertices in first use order, unused ones are dropped
+  constexpr uint32_t UNUSED = -1;
+  std::vector<uint32_t> remap(_ownedPositions.size(), UNUSED);
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  positions.reserve(_ownedPositions.size());
+  normals.reserve(_ownedNormals.size());
+  for (Triangle &tri : _ownedTriangles)
+    for (uint32_t &vertex : tri) {
+      if (remap[vertex] == UNUSED) {
+        remap[vertex] = static_cast<uint32_t>(positions.size());
+        positions.push_back(_ownedPositions[vertex]);
+        if (!_ownedNormals.empty())
+          normals.push_back(_ownedNormals[vertex]);
+      }
+      vertex = remap[vertex];
+    }
+  _ownedPositions = std::move(positions);
+  _ownedNormals = std::move(normals);
+
+  LOG(FINE, "mesh bvh built : {} triangles, {} vertices, {} nodes in {:.2f}ms",
+      _ownedTriangles.size(), _ownedPositions.size(), _buildStats.nodeCount,
+      _buildStats.buildTimeMs);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "hittables/BvhBuilder.h"
+#include "hittables/Hittable.h"
+#include "types.h"
+#include "utils/MappedFile.h"
+
+#include <array>
+#include <memory>
+
+// Indexed triangle mesh with its own bvh over the triangles. After the build
+// the triangles are stored in the bvh leaves order, and the vertices in the
+// order of their first use by those triangles, so a leaf reads a few
+// consecutive indices and vertices.
+//
+// Triangles are intersected with the watertight test of Woop, Benthin and
+// Wald (2013) : no ray goes through a shared edge or vertex. The HitRecord uv
+// are the barycentric coordinates of v1 and v2.
+//
+// The arrays are read through views, on the mesh own vectors or, for a mesh
+// loaded by MeshCache, straight on the mapped cache file.
+class TriangleMesh : public IHittable {
+public:
+  using Triangle = std::array<uint32_t, 3>;
+
+  static constexpr size_t MAX_DEPTH = BvhBuilder::MAX_DEPTH;
+
+  // -- Constructors
+  // normals : optional, one per position, interpolated for the shading
+  TriangleMesh(std::vector<glm::vec3> &&positions,
+               std::vector<Triangle> &&triangles,
+               std::vector<glm::vec3> &&normals = {},
+               BvhBuildOptions options = {});
+
+  NO_COPY(TriangleMesh);
+
+  ~TriangleMesh() {}
+
+  TriangleMesh(TriangleMesh &&other) = default;
+  TriangleMesh &operator=(TriangleMesh &&other) = default;
+
+  // -- IHittable impl
+  bool hit(Ray r, Interval ray_t, HitRecord *rec) const override;
+  bool occluded(Ray r, Interval ray_t) const override;
+
+  BBox get_bbox() const override {
+    return _nodes.empty() ? BBOX_EMPTY : _nodes[0].bbox;
+  }
+
+  // -- Getters
+  bool is_mapped() const { return _mapping != nullptr; }
+  size_t get_triangle_count() const { return _triangles.size(); }
+  size_t get_vertex_count() const { return _positions.size(); }
+  std::span<const glm::vec3> get_positions() const { return _positions; }
+  std::span<const glm::vec3> get_normals() const { return _normals; }
+  std::span<const Triangle> get_triangles() const { return _triangles; }
+  std::span<const BvhNode> get_nodes() const { return _nodes; }
+  const BvhBuildStats &get_build_stats() const { return _buildStats; }
+  uint32_t get_material() const { return _material; }
+
+  // -- Setters
+  // shared by every triangle, and by every instance of the mesh
+  void set_material(uint32_t material) { _material = material; }
+
+private:
+  friend class MeshCache;
+
+  // arrays of an already built mesh, kept alive by the mapping
+  TriangleMesh(std::shared_ptr<const MappedFile> mapping,
+               std::span<const glm::vec3> positions,
+               std::span<const glm::vec3> normals,
+               std::span<const Triangle> triangles,
+               std::span<const BvhNode> nodes, BvhBuildStats stats)
+      : _positions(positions), _normals(normals), _triangles(triangles),
+        _nodes(nodes), _buildStats(stats), _mapping(std::move(mapping)) {}
+
+  void build(BvhBuildOptions options);
+
+  // -- Members
+private:
+  // a moved vector keeps its buffer, so the views survive the moves
+  std::span<const glm::vec3> _positions;
+  std::span<const glm::vec3> _normals;
+  std::span<const Triangle> _triangles;
+  std::span<const BvhNode> _nodes;
+  BvhBuildStats _buildStats;
+  uint32_t _material = 0;
+
+  std::vector<glm::vec3> _ownedPositions;
+  std::vector<glm::vec3> _ownedNormals;
+  std::vector<Triangle> _ownedTriangles;
+  std::vector<BvhNode> _ownedNodes;
+  std::shared_ptr<const MappedFile> _mapping;
+};
@@ -0,0 +1,72 @@
+#include "WideBvh.h"
+
+// Both kernels use the operands order of min/max to drop NaN (0 * inf) : the
+// SSE/AVX min and max return the second operand when one of them is NaN.
+
+#ifdef RTVK_X86
+
+uint32_t intersect_wide_node_sse(const WideBvhNode<4> &node, const WideRay &ray,
+                                 Interval ray_t, float *t_near) {
+  __m128 t_min = _mm_set1_ps(ray_t.min);
+  __m128 t_max = _mm_set1_ps(ray_t.max);
+
+  for (size_t axis = 0; axis < 3; axis++) {
+    __m128 origin = _mm_set1_ps(ray.origin[axis]);
+    __m128 inv_dir = _mm_set1_ps(ray.invDir[axis]);
+
+    __m128 t0 = _mm_mul_ps(
+        _mm_sub_ps(_mm_load_ps(node.bounds[ray.nearRow[axis]]), origin),
+        inv_dir);
+    __m128 t1 = _mm_mul_ps(
+        _mm_sub_ps(_mm_load_ps(node.bounds[ray.farRow[axis]]), origin),
+        inv_dir);
+
+    t_min = _mm_max_ps(t0, t_min);
+    t_max = _mm_min_ps(t1, t_max);
+  }
+
+  _mm_store_ps(t_near, t_min);
+  return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(t_min, t_max)));
+}
+
+RTVK_TARGET("avx2,fma")
+uint32_t intersect_wide_node_avx2(const WideBvhNode<8> &node,
+                                  const WideRay &ray, Interval ray_t,
+                                  float *t_near) {
+  __m256 t_min = _mm256_set1_ps(ray_t.min);
+  __m256 t_max = _mm256_set1_ps(ray_t.max);
+
+  for (size_t axis = 0; axis < 3; axis++) {
+    __m256 origin = _mm256_set1_ps(ray.origin[axis]);
+    __m256 inv_dir = _mm256_set1_ps(ray.invDir[axis]);
+
+    __m256 t0 = _mm256_mul_ps(
+        _mm256_sub_ps(_mm256_load_ps(node.bounds[ray.nearRow[axis]]), origin),
+        inv_dir);
+    __m256 t1 = _mm256_mul_ps(
+        _mm256_sub_ps(_mm256_load_ps(node.bounds[ray.farRow[axis]]), origin),
+        inv_dir);
+
+    t_min = _mm256_max_ps(t0, t_min);
+    t_max = _mm256_min_ps(t1, t_max);
+  }
+
+  _mm256_store_ps(t_near, t_min);
+  return static_cast<uint32_t>(
+      _mm256_movemask_ps(_mm256_cmp_ps(t_min, t_max, _CMP_LE_OQ)));
+}
+
+#else
+
+uint32_t intersect_wide_node_sse(const WideBvhNode<4> &node, const WideRay &ray,
+                                 Interval ray_t, float *t_near) {
+  return intersect_wide_node_scalar<4>(node, ray, ray_t, t_near);
+}
+
+uint32_t intersect_wide_node_avx2(const WideBvhNode<8> &node,
+                                  const WideRay &ray, Interval ray_t,
+                                  float *t_near) {
+  return intersect_wide_node_scalar<8>(node, ray, ray_t, t_near);
+}
+
+#endif
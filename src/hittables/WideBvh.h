@@ -0,0 +1,357 @@
+#pragma once
+
+#include "hittables/BvhBuilder.h"
+#include "hittables/Hittable.h"
+#include "types.h"
+#include "utils/simd.h"
+
+#include <array>
+#include <bit>
+
+// 4 or 8 wide bvh node. The children bounds are stored as structure of arrays
+// (one row per plane), so a single ray is tested against every child with one
+// SSE (4) or AVX2 (8) instruction per plane. 128 / 256 bytes per node.
+template <size_t W> struct alignas(32) WideBvhNode {
+  static constexpr uint32_t EMPTY_SLOT = -1;
+
+  // rows : min x, min y, min z, max x, max y, max z
+  float bounds[6][W];
+  uint32_t child[W]; // inner node index, or first primitive for leaves
+  uint32_t count[W]; // primitive count for leaves, 0 for inner nodes
+
+  WideBvhNode() {
+    for (size_t i = 0; i < W; i++) {
+      // empty boxes are rejected by the ordered slab test
+      for (size_t row = 0; row < 3; row++) {
+        bounds[row][i] = INFINITY;
+        bounds[row + 3][i] = -INFINITY;
+      }
+      child[i] = EMPTY_SLOT;
+      count[i] = 0;
+    }
+  }
+
+  void set_bbox(size_t slot, const BBox &bbox) {
+    for (size_t axis = 0; axis < 3; axis++) {
+      bounds[axis][slot] = bbox.axis_interval(axis).min;
+      bounds[axis + 3][slot] = bbox.axis_interval(axis).max;
+    }
+  }
+};
+
+// Ray data shared by the node kernels. near/far are the bounds rows to use on
+// each axis, picked from the direction sign so empty slots never hit.
+struct WideRay {
+  glm::vec3 origin;
+  glm::vec3 invDir;
+  std::array<uint32_t, 3> nearRow;
+  std::array<uint32_t, 3> farRow;
+
+  WideRay(const Ray &r) : origin(r.origin), invDir(1.f / r.direction) {
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      bool negative = std::signbit(invDir[axis]);
+      nearRow[axis] = negative ? axis + 3 : axis;
+      farRow[axis] = negative ? axis : axis + 3;
+    }
+  }
+};
+
+// -- Node kernels : return the hit children mask, and their entry distance
+
+uint32_t intersect_wide_node_sse(const WideBvhNode<4> &node, const WideRay &ray,
+                                 Interval ray_t, float *t_near);
+uint32_t intersect_wide_node_avx2(const WideBvhNode<8> &node,
+                                  const WideRay &ray, Interval ray_t,
+                                  float *t_near);
+
+template <size_t W>
+uint32_t intersect_wide_node_scalar(const WideBvhNode<W> &node,
+                                    const WideRay &ray, Interval ray_t,
+                                    float *t_near) {
+  uint32_t mask = 0;
+  for (size_t i = 0; i < W; i++) {
+    float t_min = ray_t.min;
+    float t_max = ray_t.max;
+    for (size_t axis = 0; axis < 3; axis++) {
+      float t0 = (node.bounds[ray.nearRow[axis]][i] - ray.origin[axis]) *
+                 ray.invDir[axis];
+      float t1 = (node.bounds[ray.farRow[axis]][i] - ray.origin[axis]) *
+                 ray.invDir[axis];
+      // NaN (0 * inf) are dropped, as with the SIMD min/max
+      t_min = t0 > t_min ? t0 : t_min;
+      t_max = t1 < t_max ? t1 : t_max;
+    }
+    t_near[i] = t_min;
+    mask |= static_cast<uint32_t>(t_min <= t_max) << i;
+  }
+  return mask;
+}
+
+// Collapse of a binary bvh into a W wide one : every wide node opens the
+// biggest (surface area) binary children until it has W slots.
+template <size_t W>
+std::vector<WideBvhNode<W>> collapse_bvh(std::span<const BvhNode> binary) {
+  std::vector<WideBvhNode<W>> nodes;
+  if (binary.empty())
+    return nodes;
+
+  auto collapse = [&](auto &self, uint32_t binary_index) -> uint32_t {
+    std::array<uint32_t, W> slots;
+    size_t slot_count = 0;
+    slots[slot_count++] = binary_index;
+
+    while (slot_count < W) {
+      // open the biggest inner slot
+      size_t best = W;
+      float best_area = -1;
+      for (size_t i = 0; i < slot_count; i++) {
+        const BvhNode &node = binary[slots[i]];
+        float area = node.bbox.surface_area();
+        if (!node.is_leaf() && area > best_area) {
+          best = i;
+          best_area = area;
+        }
+      }
+      if (best == W)
+        break;
+
+      uint32_t opened = slots[best];
+      slots[best] = binary[opened].first;
+      slots[slot_count++] = binary[opened].first + 1;
+    }
+
+    uint32_t node_index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    for (size_t i = 0; i < slot_count; i++) {
+      const BvhNode &node = binary[slots[i]];
+      uint32_t child = node.is_leaf() ? node.first : self(self, slots[i]);
+
+      WideBvhNode<W> &wide = nodes[node_index];
+      wide.set_bbox(i, node.bbox);
+      wide.child[i] = child;
+      wide.count[i] = node.count;
+    }
+    return node_index;
+  };
+
+  collapse(collapse, 0);
+  return nodes;
+}
+
+// Wide bvh acceleration structure, the width is picked at construction from
+// the cpu : 8 with AVX2, else 4 with SSE (scalar kernels off x86).
+template <Hittable T> class WideBvhAccStruct : public IAccStruct {
+public:
+  static constexpr size_t STACK_SIZE = 8 * BvhBuilder::MAX_DEPTH;
+
+  // -- Constructors
+  // width : 4, 8, or 0 to choose from the cpu
+  WideBvhAccStruct(std::vector<T> &&objects, size_t width = 0,
+                   BvhBuildOptions options = {})
+      : _objects(std::move(objects)), _simdLevel(cpu_simd_level()) {
+    if (width == 0)
+      width = cpu_supports(SimdLevel::Avx2) ? 8 : 4;
+    _width = width == 8 ? 8 : 4;
+    build(options);
+  }
+
+  NO_COPY(WideBvhAccStruct);
+
+  ~WideBvhAccStruct() {}
+
+  WideBvhAccStruct(WideBvhAccStruct &&other) = default;
+  WideBvhAccStruct &operator=(WideBvhAccStruct &&other) = default;
+
+  // -- Getters
+  size_t get_width() const { return _width; }
+  SimdLevel get_simd_level() const { return _simdLevel; }
+  size_t get_node_count() const {
+    return _width == 8 ? _nodes8.size() : _nodes4.size();
+  }
+  const BvhBuildStats &get_build_stats() const { return _buildStats; }
+
+  // -- IAccStruct impl
+  uint32_t hit(Ray r, Interval ray_t, HitRecord *records) const override {
+    if (_width == 8)
+      return _simdLevel >= SimdLevel::Avx2
+                 ? traverse<8, intersect_wide_node_avx2>(_nodes8, r, ray_t,
+                                                         records)
+                 : traverse<8, intersect_wide_node_scalar<8>>(_nodes8, r,
+                                                              ray_t, records);
+
+    return _simdLevel >= SimdLevel::Sse
+               ? traverse<4, intersect_wide_node_sse>(_nodes4, r, ray_t,
+                                                      records)
+               : traverse<4, intersect_wide_node_scalar<4>>(_nodes4, r, ray_t,
+                                                            records);
+  }
+
+  bool occluded(Ray r, Interval ray_t) const override {
+    if (_width == 8)
+      return _simdLevel >= SimdLevel::Avx2
+                 ? traverse_any<8, intersect_wide_node_avx2>(_nodes8, r, ray_t)
+                 : traverse_any<8, intersect_wide_node_scalar<8>>(_nodes8, r,
+                                                                  ray_t);
+
+    return _simdLevel >= SimdLevel::Sse
+               ? traverse_any<4, intersect_wide_node_sse>(_nodes4, r, ray_t)
+               : traverse_any<4, intersect_wide_node_scalar<4>>(_nodes4, r,
+                                                                ray_t);
+  }
+
+  std::optional<const IHittable *> get_hitted(uint32_t index) const override {
+    return (index < _objects.size())
+               ? std::optional<const IHittable *>{&_objects[index]}
+               : std::nullopt;
+  }
+
+  Tlas get_gpu_struct(VulkanContext &ctx) const override {
+    std::vector<VkAabbPositionsKHR> aabbs;
+    for (auto &obj : _objects)
+      aabbs.push_back(obj.get_bbox().to_vk());
+
+    std::vector<Blas> blas_vec;
+    blas_vec.emplace_back(ctx, aabbs);
+
+    return Tlas(ctx, std::move(blas_vec));
+  }
+
+private:
+  // any-hit walk : the interval never shrinks, so the children are pushed
+  // unsorted and the leaves are tested as they come
+  template <size_t W, auto Kernel>
+  bool traverse_any(const std::vector<WideBvhNode<W>> &nodes, Ray r,
+                    Interval ray_t) const {
+    if (nodes.empty())
+      return false;
+
+    struct StackEntry {
+      uint32_t child;
+      uint32_t count;
+    };
+
+    const WideRay wray(r);
+    std::array<StackEntry, STACK_SIZE> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = {0, 0};
+
+    while (stack_size != 0) {
+      StackEntry entry = stack[--stack_size];
+
+      if (entry.count != 0) {
+        for (uint32_t i = entry.child; i < entry.child + entry.count; i++) {
+          const T &object = _objects[i];
+          if (object.T::occluded(r, ray_t))
+            return true;
+        }
+        continue;
+      }
+
+      const WideBvhNode<W> &node = nodes[entry.child];
+      alignas(32) float t_near[W];
+      uint32_t mask = Kernel(node, wray, ray_t, t_near);
+      while (mask != 0) {
+        size_t slot = std::countr_zero(mask);
+        mask &= mask - 1;
+        stack[stack_size++] = {node.child[slot], node.count[slot]};
+      }
+    }
+    return false;
+  }
+
+  template <size_t W, auto Kernel>
+  uint32_t traverse(const std::vector<WideBvhNode<W>> &nodes, Ray r,
+                    Interval ray_t, HitRecord *records) const {
+    if (nodes.empty())
+      return MISS_INDEX;
+
+    struct StackEntry {
+      uint32_t child;
+      uint32_t count;
+      float t;
+    };
+
+    const WideRay wray(r);
+    float closest_so_far = ray_t.max;
+    uint32_t closest_index = MISS_INDEX;
+    HitRecord temp_rec;
+
+    std::array<StackEntry, STACK_SIZE> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = {0, 0, ray_t.min};
+
+    while (stack_size != 0) {
+      StackEntry entry = stack[--stack_size];
+      if (entry.t > closest_so_far)
+        continue;
+
+      if (entry.count != 0) {
+        for (uint32_t i = entry.child; i < entry.child + entry.count; i++) {
+          const T &object = _objects[i];
+          if (object.T::hit(r, Interval(ray_t.min, closest_so_far),
+                            &temp_rec)) {
+            closest_index = i;
+            closest_so_far = temp_rec.t;
+            *records = temp_rec;
+          }
+        }
+        continue;
+      }
+
+      const WideBvhNode<W> &node = nodes[entry.child];
+      alignas(32) float t_near[W];
+      uint32_t mask = Kernel(node, wray, {ray_t.min, closest_so_far}, t_near);
+
+      // push the hit children sorted far to near, the nearest is popped next
+      size_t first = stack_size;
+      while (mask != 0) {
+        size_t slot = std::countr_zero(mask);
+        mask &= mask - 1;
+
+        StackEntry child = {node.child[slot], node.count[slot], t_near[slot]};
+        size_t pos = stack_size++;
+        while (pos > first && stack[pos - 1].t < child.t) {
+          stack[pos] = stack[pos - 1];
+          pos--;
+        }
+        stack[pos] = child;
+      }
+    }
+
+    return closest_index;
+  }
+
+  void build(BvhBuildOptions options) {
+    std::vector<BBox> bboxes;
+    bboxes.reserve(_objects.size());
+    for (const IHittable &object : _objects)
+      bboxes.push_back(object.get_bbox());
+
+    std::vector<BvhNode> binary;
+    std::vector<uint32_t> prim_order;
+    _buildStats = BvhBuilder(options).build(bboxes, &binary, &prim_order);
+
+    if (_width == 8)
+      _nodes8 = collapse_bvh<8>(binary);
+    else
+      _nodes4 = collapse_bvh<4>(binary);
+
+    LOG(FINE, "bvh{} built : {} primitives, {} nodes, {} kernels", _width,
+        _buildStats.primCount, get_node_count(), simd_level_name(_simdLevel));
+
+    std::vector<T> ordered;
+    ordered.reserve(_objects.size());
+    for (uint32_t index : prim_order)
+      ordered.push_back(std::move(_objects[index]));
+    _objects = std::move(ordered);
+  }
+
+  // -- Members
+private:
+  std::vector<T> _objects;
+  size_t _width;
+  SimdLevel _simdLevel;
+  std::vector<WideBvhNode<4>> _nodes4;
+  std::vector<WideBvhNode<8>> _nodes8;
+  BvhBuildStats _buildStats;
+};
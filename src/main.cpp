@@ -4,14 +4,17 @@
 #include "SDL3/SDL_scancode.h"
 #include "glm/ext/vector_float3.hpp"
 #include "graphics/vulkan_context.h"
+#include "hittables/BvhAccStruct.h"
 #include "hittables/Hittable.h"
 #include "hittables/Sphere.h"
 
 #include <cassert>
+#include <chrono>
 
 #include "graphics/vulkan_context.h"
 #include "renderer/CPURenderer.h"
 #include "renderer/GPURenderer.h"
+#include "renderer/PathTracingCPURenderer.h"
 #include "test.h"
 #include "types.h"
 
@@ -36,16 +39,29 @@ int main() {
     test(ctx);
 
     LOG(1, "Running ray tracer...");
-    std::vector<Sphere> objects = {Sphere{glm::vec3(-5.05, 0, 0), 5.},
-                                   Sphere{glm::vec3(5.05, 0, 0), 5.}};
-
-    Scene scene{Camera(), std::make_unique<HittableVector<Sphere>>(std::move(objects))};
-
-    std::unique_ptr<Renderer> renderer =std::make_unique<SimpleCPURenderer>(ctx.get_window_size().width,
-                                               ctx.get_window_size().height);
-
-    renderer->render(scene);
-    LOG(1, "Running ray done !");
+    std::vector<Sphere> objects = {Sphere{glm::vec3(-5.05, 0, 0), 5., 0},
+                                   Sphere{glm::vec3(5.05, 0, 0), 5., 1}};
+
+    Scene scene{Camera(),
+                std::make_unique<BvhAccStruct<Sphere>>(std::move(objects))};
+    scene.materials = {Material::diffuse({0.7f, 0.3f, 0.3f, 1}),
+                       Material::metal({0.8f, 0.8f, 0.8f, 1}, 0.05f)};
+    scene.background = GradientBackground(WHITE, {0.5f, 0.7f, 1, 1});
+
+    auto cpu_renderer = std::make_unique<PathTracingCPURenderer>(
+        ctx.get_window_size().width, ctx.get_window_size().height);
+    cpu_renderer->set_thread_count(0); // every hardware thread
+    cpu_renderer->set_spp(16);
+
+    auto start = std::chrono::steady_clock::now();
+    cpu_renderer->render(scene);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    LOG(1, "Running ray done ! {:.2f} Mrays/s",
+        static_cast<double>(cpu_renderer->get_ray_count()) /
+            elapsed.count() * 1e-6);
+
+    std::unique_ptr<Renderer> renderer = std::move(cpu_renderer);
     LOG(1, "Drawing the image...");
     auto &img_buff = renderer->get_img_buff();
     img_buff.write_on_disk("test.png", ImageFormat::PNG);
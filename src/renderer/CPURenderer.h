@@ -1,13 +1,41 @@
 #pragma once
 
+#include "AccumulationBuffer.h"
 #include "Camera.h"
 #include "ImageBuffer.h"
 #include "Renderer.h"
 #include "hittables/Hittable.h"
 #include "types.h"
+#include "utils/Sampler.h"
+#include "utils/ThreadPool.h"
+#include "utils/curves.h"
 
 #include "Scene.h"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <optional>
+
+// Adaptive sampling : after minSpp samples, only the tiles whose worst pixel
+// relative error is above the threshold get one more sample per pass. The
+// render stops when every tile is below it, or at maxSpp. The adaptive
+// passes run tile by tile, even in wavefront mode.
+struct AdaptiveSampling {
+  float threshold = 0; // 0 disables it
+  size_t minSpp = 4;
+  size_t maxSpp = 256;
+};
+
+// Order of the pixels in a render tile (and of the tiles for Hilbert). By
+// default it follows the image layout, so the writes go through the storage
+// in order.
+enum class TraversalOrder {
+  Scanline, // rows, for the Linear layout
+  Tile,     // 8x8 blocks in their storage order, for the tiled layouts
+  Hilbert,  // along a Hilbert curve, every pixel next to the previous one
+};
+
 class CPURenderer : public Renderer {
 public:
   CPURenderer(ImageBuffer &&img_buffer) : Renderer(std::move(img_buffer)) {}
@@ -15,19 +43,184 @@ public:
               ImgFormat format = ImgFormat::RGBA)
       : Renderer(ImageBuffer(img_width, img_heigth, format)) {}
 
+  // One sample per pixel straight in the image, or spp samples averaged in
+  // the accumulation buffer
   virtual void render(const Scene &scene) override {
+    if (_adaptive.threshold > 0) {
+      render_adaptive(scene);
+      return;
+    }
+    if (_spp <= 1) {
+      trace_image(scene);
+      return;
+    }
+
+    reset_accumulation();
+    for (size_t s = 0; s < _spp; s++)
+      render_pass(scene);
+    resolve();
+  }
+
+  // Progressive rendering : adds one sample per pixel to the accumulation
+  // buffer, resolve() shows the current mean
+  void render_pass(const Scene &scene) {
+    fit_accumulation();
+    _accumulating = true;
+    trace_image(scene);
+    _accumulating = false;
+    _sampleIndex++;
+  }
+
+  void render_adaptive(const Scene &scene) {
+    fit_accumulation();
+    reset_accumulation();
+    size_t min_spp = std::max<size_t>(_adaptive.minSpp, 2);
+    for (size_t s = 0; s < min_spp; s++)
+      render_pass(scene);
+
+    std::vector<Tile> tiles = make_tiles();
+    std::vector<float> errors(tiles.size());
+    size_t sample_count = min_spp * tiles_area(tiles);
+
+    // the converged tiles are dropped, they never come back
+    while (_sampleIndex < _adaptive.maxSpp) {
+      auto compute_errors = [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++)
+          errors[t] = tile_error(tiles[t]);
+      };
+      if (_threadPool)
+        parallel_for(*_threadPool, 0, tiles.size(), 16, compute_errors);
+      else
+        compute_errors(0, tiles.size());
+
+      size_t active = 0;
+      for (size_t t = 0; t < tiles.size(); t++)
+        if (errors[t] > _adaptive.threshold)
+          tiles[active++] = tiles[t];
+      tiles.resize(active);
+      if (tiles.empty())
+        break;
+
+      _accumulating = true;
+      trace_tiles(scene, tiles);
+      _accumulating = false;
+      _sampleIndex++;
+      sample_count += tiles_area(tiles);
+    }
+
+    LOG(FINE, "adaptive sampling : {} passes, {:.2f} spp on average, {}",
+        _sampleIndex,
+        static_cast<float>(sample_count) /
+            static_cast<float>(_imgBuffer.get_width() *
+                               _imgBuffer.get_height()),
+        tiles.empty() ? "converged" : "max spp reached");
+    resolve();
+  }
+
+  // accumulation buffer mean to the image buffer
+  void resolve() {
     size_t img_width = _imgBuffer.get_width();
-    size_t img_height = _imgBuffer.get_height();
-    _camRenderInfo = scene.camera.get_render_info(img_width, img_height);
-    for (size_t i = 0; i < img_width; i++)
-      for (size_t j = 0; j < img_height; j++) {
-        _imgBuffer.write_pixel(i, j, post_process(gen_ray(scene, i, j)));
+    auto resolve_rows = [this, img_width](size_t y0, size_t y1) {
+      std::vector<Color> row(img_width);
+      for (size_t y = y0; y < y1; y++) {
+        for (size_t x = 0; x < img_width; x++)
+          row[x] = post_process(_accumulation.get_mean(x, y));
+        _imgBuffer.write_row(0, y, row);
       }
+    };
+
+    if (_threadPool)
+      parallel_for(*_threadPool, 0, _accumulation.get_height(), 16,
+                   resolve_rows);
+    else
+      resolve_rows(0, _accumulation.get_height());
+  }
+
+  void reset_accumulation() {
+    _accumulation.clear();
+    _sampleIndex = 0;
+  }
+
+  // PcgSampler by default
+  void set_sampler(std::unique_ptr<ISampler> sampler) {
+    _sampler = std::move(sampler);
+  }
+
+  // 1 keeps the single sample path without accumulation
+  void set_spp(size_t spp) { _spp = std::max<size_t>(spp, 1); }
+
+  // replaces spp when its threshold is not 0
+  void set_adaptive_sampling(AdaptiveSampling adaptive) {
+    _adaptive = adaptive;
+  }
+
+
+  // 0 use every hardware thread, 1 keep the single threaded path
+  void set_thread_count(size_t thread_count) {
+    if (thread_count == 0)
+      thread_count = ThreadPool::default_thread_count();
+
+    if (thread_count <= 1)
+      _threadPool.reset();
+    else if (!_threadPool || _threadPool->get_thread_count() != thread_count)
+      _threadPool = std::make_unique<ThreadPool>(thread_count);
+  }
+
+  // multiples of ImageBuffer::TILE_SIZE keep the render tiles on the
+  // storage tiles
+  void set_tile_size(size_t tile_size) {
+    _tileSize = std::max<size_t>(tile_size, 1);
+  }
+
+  // nullopt follows the image layout
+  void set_traversal_order(std::optional<TraversalOrder> order) {
+    _traversalOrder = order;
   }
 
+  // Primary rays traced by KxK pixel blocks : 2 (hit4), 4 (hit16), or 0 to
+  // trace every pixel alone. Packets are shaded with closest_hit / miss,
+  // the renderers without supports_packets() trace pixel by pixel anyway.
+  void set_packet_size(size_t packet_size) {
+    _packetSize = (packet_size == 2 || packet_size == 4) ? packet_size : 0;
+  }
+
+  // Wavefront mode : pixels are rendered by batches of `ray_count` rays, one
+  // stage (generate, extend, shade, connect) at a time over the whole batch.
+  // 0 goes back to the tiled path.
+  void set_wavefront_size(size_t ray_count) { _wavefrontSize = ray_count; }
+
+  TraversalOrder get_traversal_order() const {
+    if (_traversalOrder)
+      return *_traversalOrder;
+    return _imgBuffer.get_layout() == PixelLayout::Linear
+               ? TraversalOrder::Scanline
+               : TraversalOrder::Tile;
+  }
+  size_t get_thread_count() const {
+    return _threadPool ? _threadPool->get_thread_count() : 1;
+  }
+  size_t get_packet_size() const { return _packetSize; }
+  size_t get_wavefront_size() const { return _wavefrontSize; }
+  size_t get_spp() const { return _spp; }
+  const AdaptiveSampling &get_adaptive_sampling() const { return _adaptive; }
+  // samples accumulated since the last reset
+  uint32_t get_sample_index() const { return _sampleIndex; }
+  const AccumulationBuffer &get_accumulation() const { return _accumulation; }
+  // Rays traced by the wavefront stages and trace_path (camera rays, bounces
+  // and shadow rays) since the last reset, for rays / second measures
+  uint64_t get_ray_count() const {
+    return _rayCount.load(std::memory_order_relaxed);
+  }
+  void reset_ray_count() { _rayCount.store(0, std::memory_order_relaxed); }
+
   virtual ~CPURenderer()  = default;
 
 protected:
+  // Sampler dimensions used by the camera, the shading starts at DIM_SHADING
+  static constexpr uint32_t DIM_PIXEL = 0; // 2D
+  static constexpr uint32_t DIM_LENS = 2;  // 2D
+  static constexpr uint32_t DIM_SHADING = 4;
+
   // Pipeline Simulation
   virtual Color gen_ray(const Scene &scene, size_t i, size_t j) const = 0;
 
@@ -38,28 +231,488 @@ protected:
 
   virtual Color post_process(Color color) const { return color; }
 
+  // True when gen_ray is exactly get_ray, closest_hit / miss and
+  // post_process : the packet path then renders the same image
+  virtual bool supports_packets() const { return false; }
+
+  // camera rays only see what is in front of the camera
+  static constexpr Interval CAMERA_RAY_T = {0, INFINITY};
+
+  // -- Wavefront
+  struct QueuedRay {
+    Ray ray;
+    Color throughput;
+    uint32_t pixel; // pixel_index of the image
+    uint32_t depth; // 0 for the camera rays
+    Interval ray_t = CAMERA_RAY_T;
+    // false when the previous hit already sampled Scene::lights, or the
+    // environment map
+    bool countEmission = true;
+    bool countEnvironment = true;
+  };
+
+  struct ShadowRay {
+    Ray ray;
+    Interval ray_t;
+    Color contribution; // added to the pixel when nothing is in the way
+    uint32_t pixel;     // pixel_index of the image
+  };
+
+  struct ShadeResult {
+    Color radiance{0}; // added to the pixel
+    std::optional<QueuedRay> next;
+    std::optional<ShadowRay> shadow;
+  };
+
+  // Shading of one extended ray, the default stops at the first hit with
+  // closest_hit / miss. Integrators can continue the path (next) or ask for
+  // a light visibility test (shadow).
+  virtual ShadeResult shade(const Scene &scene, const QueuedRay &ray,
+                            const HitRecord &record, uint32_t hit_index) const {
+    Color color = hit_index != IAccStruct::MISS_INDEX
+                      ? closest_hit(scene, record, hit_index)
+                      : miss(scene, ray.ray);
+    return {ray.throughput * color};
+  }
+
+  // Whole path of one ray, bounce after bounce through shade() : the tiled
+  // version of the wavefront stages, giving the same radiance
+  Color trace_path(const Scene &scene, QueuedRay ray) const {
+    Color radiance(0);
+    uint64_t ray_count = 0;
+    while (true) {
+      HitRecord record;
+      uint32_t hit_index = scene._accStruct->hit(ray.ray, ray.ray_t, &record);
+      ShadeResult result = shade(scene, ray, record, hit_index);
+      radiance += result.radiance;
+      ray_count++;
+
+      if (result.shadow) {
+        ray_count++;
+        if (!scene._accStruct->occluded(result.shadow->ray,
+                                        result.shadow->ray_t))
+          radiance += result.shadow->contribution;
+      }
+      if (!result.next)
+        break;
+      ray = *result.next;
+    }
+    count_rays(ray_count);
+    return radiance;
+  }
+
+  void count_rays(uint64_t count) const {
+    _rayCount.fetch_add(count, std::memory_order_relaxed);
+  }
+
   // Helpers
-  virtual Ray get_ray(size_t i, size_t j, const Camera &cam) const {
-    float i_f = static_cast<float>(i);
-    float j_f = static_cast<float>(j);
+  struct Tile {
+    size_t x0, y0; // included
+    size_t x1, y1; // excluded
+  };
+
+  // One sample for every pixel, with the current render mode
+  void trace_image(const Scene &scene) {
+    size_t img_width = _imgBuffer.get_width();
+    size_t img_height = _imgBuffer.get_height();
+    _camRenderInfo = scene.camera.get_render_info(img_width, img_height);
+
+    if (_wavefrontSize != 0) {
+      render_wavefront(scene);
+      return;
+    }
 
-    glm::vec3 pixel_sample = _camRenderInfo.px00_loc +
-                             i_f * _camRenderInfo.dt_u +
-                             j_f * _camRenderInfo.dt_v;
+    if (!_threadPool) {
+      render_tile(scene, {0, 0, img_width, img_height});
+      return;
+    }
+
+    trace_tiles(scene, make_tiles());
+  }
+
+  // every tile writes its own pixels, so tiles can run in any order
+  void trace_tiles(const Scene &scene, std::span<const Tile> tiles) {
+    if (!_threadPool) {
+      for (const Tile &tile : tiles)
+        render_tile(scene, tile);
+      return;
+    }
+
+    TaskGroup group(*_threadPool);
+    for (const Tile &tile : tiles)
+      group.run([this, &scene, tile]() { render_tile(scene, tile); });
+    group.wait();
+  }
+
+  std::vector<Tile> make_tiles() const {
+    size_t img_width = _imgBuffer.get_width();
+    size_t img_height = _imgBuffer.get_height();
+    std::vector<Tile> tiles;
+    for (size_t y = 0; y < img_height; y += _tileSize)
+      for (size_t x = 0; x < img_width; x += _tileSize)
+        tiles.push_back({x, y, std::min(x + _tileSize, img_width),
+                         std::min(y + _tileSize, img_height)});
+
+    if (get_traversal_order() == TraversalOrder::Hilbert) {
+      uint32_t size = static_cast<uint32_t>(std::bit_ceil(
+          (std::max(img_width, img_height) + _tileSize - 1) / _tileSize));
+      auto curve_index = [this, size](const Tile &tile) {
+        return hilbert_encode(size, static_cast<uint32_t>(tile.x0 / _tileSize),
+                              static_cast<uint32_t>(tile.y0 / _tileSize));
+      };
+      std::ranges::sort(tiles, {}, curve_index);
+    }
+    return tiles;
+  }
+
+  // func(x, y) for the cells of a step x step grid over the tile (pixels for
+  // 1, packets for K), in the traversal order
+  template <typename Func>
+  void for_each_cell(Tile tile, size_t step, Func &&func) const {
+    size_t cols = (tile.x1 - tile.x0 + step - 1) / step;
+    size_t rows = (tile.y1 - tile.y0 + step - 1) / step;
+    auto visit = [&](size_t c, size_t r) {
+      func(tile.x0 + c * step, tile.y0 + r * step);
+    };
+
+    switch (get_traversal_order()) {
+    case TraversalOrder::Scanline:
+      for (size_t r = 0; r < rows; r++)
+        for (size_t c = 0; c < cols; c++)
+          visit(c, r);
+      break;
+    case TraversalOrder::Tile: {
+      size_t block = std::max<size_t>(ImageBuffer::TILE_SIZE / step, 1);
+      bool morton = _imgBuffer.get_layout() == PixelLayout::Morton;
+      for (size_t r0 = 0; r0 < rows; r0 += block)
+        for (size_t c0 = 0; c0 < cols; c0 += block) {
+          if (!morton) {
+            for (size_t r = r0; r < std::min(r0 + block, rows); r++)
+              for (size_t c = c0; c < std::min(c0 + block, cols); c++)
+                visit(c, r);
+            continue;
+          }
+          for (uint32_t code = 0; code < block * block; code++) {
+            auto [dc, dr] = morton_decode(code);
+            if (c0 + dc < cols && r0 + dr < rows)
+              visit(c0 + dc, r0 + dr);
+          }
+        }
+      break;
+    }
+    case TraversalOrder::Hilbert: {
+      // the cells out of the tile are skipped
+      uint32_t size =
+          static_cast<uint32_t>(std::bit_ceil(std::max(cols, rows)));
+      for (uint32_t d = 0; d < size * size; d++) {
+        auto [c, r] = hilbert_decode(size, d);
+        if (c < cols && r < rows)
+          visit(c, r);
+      }
+      break;
+    }
+    }
+  }
+
+  static size_t tiles_area(std::span<const Tile> tiles) {
+    size_t area = 0;
+    for (const Tile &tile : tiles)
+      area += (tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+    return area;
+  }
+
+  // worst pixel of the tile
+  float tile_error(Tile tile) const {
+    float error = 0;
+    for (size_t j = tile.y0; j < tile.y1; j++)
+      for (size_t i = tile.x0; i < tile.x1; i++)
+        error = std::max(error, _accumulation.get_error(i, j));
+    return error;
+  }
+
+  void fit_accumulation() {
+    size_t img_width = _imgBuffer.get_width();
+    size_t img_height = _imgBuffer.get_height();
+    if (_accumulation.get_width() != img_width ||
+        _accumulation.get_height() != img_height)
+      _accumulation = AccumulationBuffer(img_width, img_height);
+  }
+
+  // Sample output of every render mode, before the last post_process
+  void write_sample(size_t i, size_t j, Color color) {
+    if (_accumulating)
+      _accumulation.add_sample(i, j, color);
+    else
+      _imgBuffer.write_pixel(i, j, post_process(color));
+  }
+
+  virtual void render_tile(const Scene &scene, Tile tile) {
+    if (_packetSize == 2 && supports_packets())
+      return render_tile_packets<2>(scene, tile);
+    if (_packetSize == 4 && supports_packets())
+      return render_tile_packets<4>(scene, tile);
+
+    for_each_cell(tile, 1, [&](size_t i, size_t j) {
+      write_sample(i, j, gen_ray(scene, i, j));
+    });
+  }
+
+  template <size_t K> void render_tile_packets(const Scene &scene, Tile tile) {
+    constexpr size_t N = K * K;
+    std::array<HitRecord, N> records;
+    std::array<uint32_t, N> indices;
+
+    for_each_cell(tile, K, [&](size_t x, size_t y) {
+      RayPacket<N> packet = get_ray_packet<K>(x, y, scene.camera);
+      // blocks on the tile border
+      for (size_t k = 0; k < N; k++)
+        if (x + k % K >= tile.x1 || y + k / K >= tile.y1)
+          packet.mask &= ~(1u << k);
+
+      scene._accStruct->hit_packet(packet, CAMERA_RAY_T, records.data(),
+                                   indices.data());
+
+      for (size_t k = 0; k < N; k++) {
+        if (!packet.is_active(k))
+          continue;
+        Color color = indices[k] != IAccStruct::MISS_INDEX
+                          ? closest_hit(scene, records[k], indices[k])
+                          : miss(scene, packet.rays[k]);
+        // same post_process as gen_ray
+        write_sample(x + k % K, y + k / K, post_process(color));
+      }
+    });
+  }
+
+  // Rays of the KxK block at (x, y), row by row. The frustum is only built
+  // when every ray starts from the same point (no defocus), through the
+  // outer corners of the block pixels : it holds any jitter.
+  template <size_t K>
+  RayPacket<K * K> get_ray_packet(size_t x, size_t y, const Camera &cam) const {
+    constexpr size_t N = K * K;
+    RayPacket<N> packet;
+    bool same_origin = true;
+    for (size_t k = 0; k < N; k++) {
+      packet.rays[k] = get_ray(x + k % K, y + k / K, cam);
+      same_origin &= packet.rays[k].origin == packet.rays[0].origin;
+    }
+
+    if (same_origin) {
+      glm::vec3 origin = packet.rays[0].origin;
+      float u0 = static_cast<float>(x) - 0.5f, u1 = u0 + K;
+      float v0 = static_cast<float>(y) - 0.5f, v1 = v0 + K;
+      packet.frustum = Frustum::from_corners(
+          origin, {pixel_point(u0, v0) - origin, pixel_point(u1, v0) - origin,
+                   pixel_point(u1, v1) - origin, pixel_point(u0, v1) - origin});
+    }
+    return packet;
+  }
+
+  void render_wavefront(const Scene &scene) {
+    size_t img_width = _imgBuffer.get_width();
+    size_t pixel_count = img_width * _imgBuffer.get_height();
+
+    for (size_t begin = 0; begin < pixel_count; begin += _wavefrontSize) {
+      size_t end = std::min(begin + _wavefrontSize, pixel_count);
+      _wavefront.begin = begin;
+      _wavefront.radiance.assign(end - begin, Color(0));
+
+      wavefront_generate(scene, begin, end);
+      while (!_wavefront.rays.empty()) {
+        wavefront_extend(scene);
+        wavefront_shade(scene);
+        wavefront_connect(scene);
+      }
+
+      // same post_process as gen_ray
+      for (size_t p = begin; p < end; p++)
+        write_sample(p % img_width, p / img_width,
+                     post_process(_wavefront.radiance[p - begin]));
+    }
+  }
+
+  // camera rays of the pixels [begin, end), row major
+  void wavefront_generate(const Scene &scene, size_t begin, size_t end) {
+    size_t img_width = _imgBuffer.get_width();
+    _wavefront.rays.resize(end - begin);
+    for_each_chunk(end - begin, [&](size_t chunk_begin, size_t chunk_end) {
+      for (size_t k = chunk_begin; k < chunk_end; k++) {
+        size_t p = begin + k;
+        Ray ray = get_ray(p % img_width, p / img_width, scene.camera);
+        _wavefront.rays[k] = {ray, Color(1), static_cast<uint32_t>(p), 0};
+      }
+    });
+  }
+
+  // closest hit of every queued ray, sorted by direction octant first so
+  // consecutive rays walk the same bvh nodes
+  void wavefront_extend(const Scene &scene) {
+    sort_by_octant(&_wavefront.rays, &_wavefront.sortScratch);
+
+    size_t count = _wavefront.rays.size();
+    _wavefront.records.resize(count);
+    _wavefront.indices.resize(count);
+    for_each_chunk(count, [&](size_t chunk_begin, size_t chunk_end) {
+      for (size_t k = chunk_begin; k < chunk_end; k++)
+        _wavefront.indices[k] =
+            scene._accStruct->hit(_wavefront.rays[k].ray,
+                                  _wavefront.rays[k].ray_t,
+                                  &_wavefront.records[k]);
+    });
+    count_rays(count);
+  }
+
+  // shade every ray, then gather the radiance, the continuations (next
+  // extend) and the shadow rays (connect)
+  void wavefront_shade(const Scene &scene) {
+    size_t count = _wavefront.rays.size();
+    _wavefront.results.resize(count);
+    for_each_chunk(count, [&](size_t chunk_begin, size_t chunk_end) {
+      for (size_t k = chunk_begin; k < chunk_end; k++)
+        _wavefront.results[k] =
+            shade(scene, _wavefront.rays[k], _wavefront.records[k],
+                  _wavefront.indices[k]);
+    });
+
+    _wavefront.nextRays.clear();
+    _wavefront.shadowRays.clear();
+    for (size_t k = 0; k < count; k++) {
+      ShadeResult &result = _wavefront.results[k];
+      _wavefront.radiance[_wavefront.rays[k].pixel - _wavefront.begin] +=
+          result.radiance;
+      if (result.next)
+        _wavefront.nextRays.push_back(*result.next);
+      if (result.shadow)
+        _wavefront.shadowRays.push_back(*result.shadow);
+    }
+    std::swap(_wavefront.rays, _wavefront.nextRays);
+  }
+
+  // visibility of the shadow rays
+  void wavefront_connect(const Scene &scene) {
+    size_t count = _wavefront.shadowRays.size();
+    if (count == 0)
+      return;
+
+    _wavefront.visible.resize(count);
+    for_each_chunk(count, [&](size_t chunk_begin, size_t chunk_end) {
+      for (size_t k = chunk_begin; k < chunk_end; k++) {
+        const ShadowRay &shadow = _wavefront.shadowRays[k];
+        _wavefront.visible[k] =
+            !scene._accStruct->occluded(shadow.ray, shadow.ray_t);
+      }
+    });
+
+    count_rays(count);
+
+    for (size_t k = 0; k < count; k++) {
+      const ShadowRay &shadow = _wavefront.shadowRays[k];
+      if (_wavefront.visible[k])
+        _wavefront.radiance[shadow.pixel - _wavefront.begin] +=
+            shadow.contribution;
+    }
+  }
+
+  // stable counting sort on the direction signs
+  static void sort_by_octant(std::vector<QueuedRay> *rays,
+                             std::vector<QueuedRay> *scratch) {
+    auto octant = [](const Ray &r) {
+      return static_cast<size_t>(std::signbit(r.direction.x)) |
+             static_cast<size_t>(std::signbit(r.direction.y)) << 1 |
+             static_cast<size_t>(std::signbit(r.direction.z)) << 2;
+    };
+
+    std::array<size_t, 9> offsets = {};
+    for (const QueuedRay &queued : *rays)
+      offsets[octant(queued.ray) + 1]++;
+    if (std::ranges::count(offsets, rays->size()) == 1)
+      return; // a single octant
+    for (size_t i = 1; i < offsets.size(); i++)
+      offsets[i] += offsets[i - 1];
+
+    scratch->resize(rays->size());
+    for (const QueuedRay &queued : *rays)
+      (*scratch)[offsets[octant(queued.ray)]++] = queued;
+    std::swap(*rays, *scratch);
+  }
+
+  uint32_t pixel_index(size_t i, size_t j) const {
+    return static_cast<uint32_t>(i + j * _imgBuffer.get_width());
+  }
+
+  template <typename Func> void for_each_chunk(size_t count, Func &&func) {
+    if (_threadPool)
+      parallel_for(*_threadPool, 0, count, WAVEFRONT_GRAIN, func);
+    else
+      func(0, count);
+  }
+
+  // The single sample path goes through the pixel centers. Accumulated
+  // samples are all jittered in the pixel, the first one included : the
+  // sampler sequences start at their first point
+  virtual Ray get_ray(size_t i, size_t j, const Camera &cam) const {
+    uint32_t pixel = pixel_index(i, j);
+    glm::vec2 jitter = _accumulating
+                           ? _sampler->get_2d(pixel, _sampleIndex, DIM_PIXEL)
+                           : glm::vec2(0.5f);
+    glm::vec3 pixel_sample =
+        pixel_point(static_cast<float>(i) + jitter.x - 0.5f,
+                    static_cast<float>(j) + jitter.y - 0.5f);
 
     glm::vec3 ray_origin = cam.defocusAngle <= 0
                                ? _camRenderInfo.center
-                               : _camRenderInfo.defocus_disk_sample();
+                               : _camRenderInfo.defocus_disk_sample(
+                                     _sampler->get_2d(pixel, _sampleIndex,
+                                                      DIM_LENS));
     glm::vec3 ray_dir = pixel_sample - ray_origin;
 
     return {ray_origin, ray_dir};
   }
 
+  // point of the image plane at the pixel coordinates (u, v), the pixel
+  // centers at the integers
+  glm::vec3 pixel_point(float u, float v) const {
+    return _camRenderInfo.px00_loc + u * _camRenderInfo.dt_u +
+           v * _camRenderInfo.dt_v;
+  }
+
   // -- Members
 
 protected:
   // Uniforms simulation
   Camera::CameraRenderInfo _camRenderInfo;
+  uint32_t _sampleIndex = 0;
+  std::unique_ptr<ISampler> _sampler = std::make_unique<PcgSampler>();
+
+  // Multi sampling
+  AccumulationBuffer _accumulation;
+  size_t _spp = 1;
+  AdaptiveSampling _adaptive;
+  bool _accumulating = false;
+
+  // Parallel rendering, null when single threaded
+  std::unique_ptr<ThreadPool> _threadPool;
+  size_t _tileSize = 32;
+  size_t _packetSize = 0;
+  std::optional<TraversalOrder> _traversalOrder; // follows the layout
+
+  // Wavefront queues, kept between batches to reuse their memory
+  static constexpr size_t WAVEFRONT_GRAIN = 1024;
+  struct WavefrontQueues {
+    std::vector<QueuedRay> rays, nextRays, sortScratch;
+    std::vector<HitRecord> records;
+    std::vector<uint32_t> indices;
+    std::vector<ShadeResult> results;
+    std::vector<ShadowRay> shadowRays;
+    std::vector<uint8_t> visible;
+    std::vector<Color> radiance; // per pixel of the batch
+    size_t begin = 0;            // first pixel of the batch
+  };
+  WavefrontQueues _wavefront;
+  size_t _wavefrontSize = 0;
+
+  // relaxed, only added once per path or per wavefront stage
+  mutable std::atomic<uint64_t> _rayCount = 0;
 };
 
 class SimpleCPURenderer : public CPURenderer {
@@ -73,10 +726,11 @@ public:
   ~SimpleCPURenderer() = default;
 
 protected:
-  Color gen_ray(const Scene &scene, size_t i, size_t j) const override {
+  // final : the packet path and StaticCPURenderer replay this pipeline
+  Color gen_ray(const Scene &scene, size_t i, size_t j) const final {
     Ray ray = get_ray(i, j, scene.camera);
     HitRecord record;
-    uint32_t hit_index = scene._accStruct->hit(ray, INTERVAL_REELS, &record);
+    uint32_t hit_index = scene._accStruct->hit(ray, CAMERA_RAY_T, &record);
     Color hit_color;
     if (hit_index != IAccStruct::MISS_INDEX)
       hit_color = closest_hit(scene, record, hit_index);
@@ -93,4 +747,6 @@ protected:
   Color miss(const Scene &scene, Ray r) const override {
     return Color(glm::normalize(r.direction) / 2.f + 0.5f, 1);
   }
+
+  bool supports_packets() const override { return true; }
 };
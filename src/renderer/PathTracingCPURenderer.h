@@ -0,0 +1,183 @@
+#pragma once
+
+#include "Material.h"
+#include "renderer/CPURenderer.h"
+
+struct PathTracingOptions {
+  uint32_t maxDepth = 8;      // rays per path, the camera ray included
+  uint32_t rouletteDepth = 3; // first bounce that can be killed
+  // sample Scene::lights from the diffuse hits, when it is set
+  bool nextEventEstimation = true;
+};
+
+// Unidirectional path tracer over the scene materials : the emission of the
+// hit surfaces and the background are gathered along the path, which bounces
+// by the material scatter (cosine weighted diffuse, fuzzy metal, Fresnel
+// weighted dielectric). Paths stop at maxDepth, or from rouletteDepth with a
+// probability of 1 - max(throughput) (Russian roulette), the surviving ones
+// being reweighted so the estimate stays unbiased.
+//
+// With next event estimation, every diffuse hit also picks a light in the
+// scene LightBvh or a direction of its EnvironmentMap, and traces a shadow
+// ray toward it. The diffuse bounce then ignores the emission of the lights
+// it hits when the LightBvh was sampled, and the environment it misses to
+// when the map was, as the light sample already accounts for them (no
+// multiple importance sampling). The other emissive surfaces are only found
+// by the bounces, their emission is always counted.
+//
+// Every bounce goes through shade(), so the tiled path (trace_path) and the
+// wavefront stages give the same image. The packet path, which only shades
+// the primary hits, is never used : set_packet_size has no effect.
+class PathTracingCPURenderer : public CPURenderer {
+public:
+  using CPURenderer::CPURenderer;
+
+  ~PathTracingCPURenderer() = default;
+
+  void set_options(PathTracingOptions options) {
+    options.maxDepth = std::max<uint32_t>(options.maxDepth, 1);
+    _options = options;
+  }
+  const PathTracingOptions &get_options() const { return _options; }
+
+protected:
+  // scatter (2D), roulette (1D), light pick (1D) and light direction (2D)
+  // samples of a bounce, even to keep the 2D ones aligned
+  static constexpr uint32_t DIMS_PER_BOUNCE = 8;
+  // secondary rays start a bit off their surface
+  static constexpr float SECONDARY_T_MIN = 1e-4f;
+
+  Color gen_ray(const Scene &scene, size_t i, size_t j) const override {
+    QueuedRay ray = {get_ray(i, j, scene.camera), Color(1), pixel_index(i, j),
+                     0};
+    return post_process(trace_path(scene, ray));
+  }
+
+  // whole paths in gen_ray : no packets
+  bool supports_packets() const override { return false; }
+
+  // emission only, the bounces go through shade()
+  Color closest_hit(const Scene &scene, HitRecord record,
+                    uint32_t hit_index) const override {
+    return scene.get_material(record.material).emission;
+  }
+
+  Color miss(const Scene &scene, Ray r) const override {
+    return scene.get_background(r);
+  }
+
+  // the radiance sums have no meaningful alpha
+  Color post_process(Color color) const override {
+    return Color(glm::vec3(color), 1);
+  }
+
+  ShadeResult shade(const Scene &scene, const QueuedRay &ray,
+                    const HitRecord &record,
+                    uint32_t hit_index) const override {
+    if (hit_index == IAccStruct::MISS_INDEX) {
+      // already sampled by the previous diffuse hit
+      if (!ray.countEnvironment)
+        return {};
+      return {ray.throughput * miss(scene, ray.ray)};
+    }
+
+    const Material &material = scene.get_material(record.material);
+    ShadeResult result;
+    // the previous hit only sampled the lights, not the other emissive
+    // surfaces (meshes, spheres left out of Scene::lights)
+    if (ray.countEmission ||
+        (material.is_emissive() && !scene.lights->on_light(record.p)))
+      result.radiance = ray.throughput * material.emission;
+    if (ray.depth + 1 >= _options.maxDepth)
+      return result;
+
+    uint32_t dim = DIM_SHADING + ray.depth * DIMS_PER_BOUNCE;
+    bool sample_lights = _options.nextEventEstimation &&
+                         (scene.lights || scene.get_environment()) &&
+                         material.type == Material::Type::DIFFUSE &&
+                         luminance(material.albedo) > 0;
+    if (sample_lights)
+      result.shadow = sample_light(scene, ray, record, material, dim);
+
+    std::optional<Scatter> scatter = material.scatter(
+        ray.ray.direction, record,
+        _sampler->get_2d(ray.pixel, _sampleIndex, dim));
+    if (!scatter)
+      return result;
+
+    Color throughput = ray.throughput * scatter->attenuation;
+    float max_throughput =
+        std::max({throughput.x, throughput.y, throughput.z});
+    if (max_throughput <= 0)
+      return result; // black surface
+    if (ray.depth + 1 >= _options.rouletteDepth) {
+      float survival = std::min(max_throughput, 0.95f);
+      if (_sampler->get_1d(ray.pixel, _sampleIndex, dim + 2) >= survival)
+        return result;
+      throughput /= survival;
+    }
+
+    result.next = QueuedRay{{record.p, scatter->direction},
+                            throughput,
+                            ray.pixel,
+                            ray.depth + 1,
+                            {SECONDARY_T_MIN, INFINITY},
+                            !(sample_lights && scene.lights),
+                            !(sample_lights && scene.get_environment())};
+    return result;
+  }
+
+  // Shadow ray toward a light picked from the diffuse hit, carrying the
+  // light radiance times the lambertian term over the sampling pdf. An
+  // environment map is one more light, picked half of the time when the
+  // scene has others.
+  std::optional<ShadowRay> sample_light(const Scene &scene,
+                                        const QueuedRay &ray,
+                                        const HitRecord &record,
+                                        const Material &material,
+                                        uint32_t dim) const {
+    float u_pick = _sampler->get_1d(ray.pixel, _sampleIndex, dim + 3);
+    glm::vec2 u_dir = _sampler->get_2d(ray.pixel, _sampleIndex, dim + 4);
+
+    const EnvironmentMap *environment = scene.get_environment();
+    float environment_probability =
+        !environment ? 0 : (scene.lights ? 0.5f : 1);
+
+    glm::vec3 direction;
+    Color radiance;
+    float pdf;
+    Interval shadow_t = {SECONDARY_T_MIN, INFINITY};
+    if (u_pick < environment_probability) {
+      std::optional<EnvironmentSample> sample =
+          environment->sample(u_pick / environment_probability, u_dir);
+      if (!sample)
+        return std::nullopt;
+      direction = sample->direction;
+      radiance = sample->radiance;
+      pdf = sample->pdf * environment_probability;
+    } else {
+      std::optional<LightSample> sample = scene.lights->sample(
+          record.p, record.normal,
+          (u_pick - environment_probability) / (1 - environment_probability),
+          u_dir);
+      if (!sample)
+        return std::nullopt;
+      direction = sample->direction;
+      radiance = sample->radiance;
+      pdf = sample->pdf * (1 - environment_probability);
+      // stops short of the light surface
+      shadow_t.max = sample->distance * (1 - 1e-4f);
+    }
+
+    float cos_theta = glm::dot(record.normal, direction);
+    if (cos_theta <= 0 || pdf <= 0)
+      return std::nullopt;
+
+    Color contribution = ray.throughput * material.albedo * radiance *
+                         (cos_theta / (static_cast<float>(M_PI) * pdf));
+    return ShadowRay{{record.p, direction}, shadow_t, contribution, ray.pixel};
+  }
+
+private:
+  PathTracingOptions _options;
+};
@@ -16,6 +16,15 @@ public:
 
   const ImageBuffer &get_img_buff() const { return _imgBuffer; }
 
+  // Moves the rendered image out (e.g. to an ImageWriter), a new one of the
+  // same size, format and layout takes its place
+  ImageBuffer take_img_buff() {
+    ImageBuffer image(_imgBuffer.get_width(), _imgBuffer.get_height(),
+                      _imgBuffer.get_format(), _imgBuffer.get_layout());
+    std::swap(image, _imgBuffer);
+    return image;
+  }
+
 protected:
   ImageBuffer _imgBuffer;
 };
\ No newline at end of file
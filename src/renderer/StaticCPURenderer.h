@@ -0,0 +1,52 @@
+#pragma once
+
+#include "renderer/CPURenderer.h"
+
+// Compile time specialized CPURenderer : the renderer (Base), acceleration
+// structure and primitive type are known, so the per pixel path (get_ray,
+// AccStruct<T>::hit, T::hit, closest_hit / miss, post_process) is made of
+// static calls the compiler can inline. The only virtual call left is
+// render_tile, once per tile.
+//
+// The kernel replays the closest_hit / miss pipeline like the packet path :
+// Base must be a SimpleCPURenderer, whose gen_ray is that pipeline and is
+// final. Packets, wavefront, and scenes with another acceleration structure
+// use the Base virtual path.
+//
+// e.g. StaticCPURenderer<SimpleCPURenderer, BvhAccStruct, Sphere>
+template <typename Base, template <typename> typename AccStruct, Hittable T>
+  requires std::derived_from<Base, SimpleCPURenderer>
+class StaticCPURenderer final : public Base {
+public:
+  using Accel = AccStruct<T>;
+
+  using Base::Base;
+
+  ~StaticCPURenderer() = default;
+
+protected:
+  void render_tile(const Scene &scene,
+                   typename Base::Tile tile) override {
+    const Accel *accel = dynamic_cast<const Accel *>(scene._accStruct.get());
+    if (!accel || this->get_packet_size() != 0)
+      return Base::render_tile(scene, tile);
+
+    this->for_each_cell(tile, 1, [&](size_t i, size_t j) {
+      this->write_sample(i, j, trace(scene, *accel, i, j));
+    });
+  }
+
+private:
+  // qualified calls : no virtual dispatch
+  Color trace(const Scene &scene, const Accel &accel, size_t i,
+              size_t j) const {
+    Ray ray = Base::get_ray(i, j, scene.camera);
+    HitRecord record;
+    uint32_t hit_index = accel.Accel::hit(ray, Base::CAMERA_RAY_T, &record);
+    Color color = hit_index != IAccStruct::MISS_INDEX
+                      ? Base::closest_hit(scene, record, hit_index)
+                      : Base::miss(scene, ray);
+    // same post_process as gen_ray
+    return Base::post_process(color);
+  }
+};
@@ -1,15 +1,40 @@
 #include "test.h"
+#include "Background.h"
 #include "ImageBuffer.h"
+#include "ImageWriter.h"
+#include "GltfLoader.h"
+#include "LightBvh.h"
+#include "TiledFramebuffer.h"
 #include "graphics/Image.h"
 #include "graphics/PipelineDescriptor.h"
 #include "graphics/Shaders.h"
 #include "graphics/pipelines.h"
 #include "graphics/raii_graphic.h"
 #include "graphics/vulkan_context.h"
+#include "hittables/BvhAccStruct.h"
 #include "hittables/Hittable.h"
+#include "hittables/MeshCache.h"
+#include "hittables/MeshInstance.h"
 #include "hittables/Sphere.h"
+#include "hittables/SphereSoA.h"
+#include "hittables/TriangleMesh.h"
+#include "hittables/WideBvh.h"
+#include "renderer/CPURenderer.h"
+#include "renderer/PathTracingCPURenderer.h"
+#include "renderer/StaticCPURenderer.h"
 #include "types.h"
+#include "utils/AliasTable.h"
+#include "utils/Sampler.h"
+#include "utils/curves.h"
+#include "utils/half.h"
+#include "utils/png.h"
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <stb_image.h>
 #include <utility>
 #include <vector>
 
@@ -121,4 +146,1942 @@ void test_acceleration_struct(VulkanContext &ctx) {
   LOGOK("acceleration_struct");
 }
 
-#endif
\ No newline at end of file
+void test_parallel_render(VulkanContext &ctx) {
+  std::vector<Sphere> vec_sphere;
+  for (uint i = 0; i < 20; i++) {
+    vec_sphere.push_back(Sphere(glm::vec3(i * i, 0, 0), i + 1));
+  }
+  Scene scene{Camera(),
+              std::make_unique<HittableVector<Sphere>>(std::move(vec_sphere))};
+
+  SimpleCPURenderer single(301, 157);
+  single.render(scene);
+
+  SimpleCPURenderer parallel(301, 157);
+  parallel.set_thread_count(4);
+  parallel.set_tile_size(16);
+  parallel.render(scene);
+
+  auto expected = single.get_img_buff().get_data();
+  auto result = parallel.get_img_buff().get_data();
+  if (!std::equal(expected.begin(), expected.end(), result.begin(),
+                  result.end()))
+    LOGERR("parallel render differs from the single threaded one");
+
+  LOGOK("parallel_render");
+}
+
+void test_bvh(VulkanContext &ctx) {
+  std::vector<Sphere> spheres;
+  for (uint i = 0; i < 1000; i++) {
+    glm::vec3 center(random_float(-50, 50), random_float(-50, 50),
+                     random_float(-50, 50));
+    spheres.push_back(Sphere(center, random_float(0.1, 2)));
+  }
+  HittableVector<Sphere> vec{std::vector<Sphere>(spheres)};
+  BvhAccStruct<Sphere> bvh(std::move(spheres));
+
+  for (uint i = 0; i < 10000; i++) {
+    Ray ray = {glm::vec3(random_float(-60, 60), random_float(-60, 60), -100),
+               glm::vec3(random_float(-1, 1), random_float(-1, 1), 1)};
+    HitRecord vec_rec, bvh_rec;
+    bool vec_hit = vec.hit(ray, {0, INFINITY}, &vec_rec) !=
+                   IAccStruct::MISS_INDEX;
+    bool bvh_hit = bvh.hit(ray, {0, INFINITY}, &bvh_rec) !=
+                   IAccStruct::MISS_INDEX;
+
+    if (vec_hit != bvh_hit || (vec_hit && vec_rec.t != bvh_rec.t))
+      LOGERR("bvh hit differs from the linear search");
+  }
+
+  LOGOK("bvh");
+}
+
+void test_wide_bvh(VulkanContext &ctx) {
+  // the SIMD node kernels match the scalar one, empty slots and axis
+  // parallel rays (infinite inverse direction) included
+  auto random_ray = []() {
+    glm::vec3 direction(random_float(-1, 1), random_float(-1, 1),
+                        random_float(-1, 1));
+    for (size_t axis = 0; axis < 3; axis++)
+      if (random_float() < 0.2f)
+        direction[axis] = 0;
+    if (direction == glm::vec3(0))
+      direction.z = 1;
+    return Ray(glm::vec3(random_float(-6, 6), random_float(-6, 6),
+                         random_float(-6, 6)),
+               direction);
+  };
+  auto check_kernel = [&]<size_t W>(const char *name, auto kernel) {
+    size_t diffs = 0, hits = 0;
+    for (uint i = 0; i < 2000; i++) {
+      WideBvhNode<W> node;
+      for (size_t slot = 0; slot < W; slot++) {
+        if (random_float() < 0.25f)
+          continue; // empty slot
+        glm::vec3 a(random_float(-5, 5), random_float(-5, 5),
+                    random_float(-5, 5));
+        glm::vec3 b = a + glm::vec3(random_float(0, 3), random_float(0, 3),
+                                    random_float(0, 3));
+        node.set_bbox(slot, BBox(a, b));
+        node.child[slot] = static_cast<uint32_t>(slot);
+      }
+      WideRay ray(random_ray());
+      Interval ray_t(0, random_float() < 0.5f ? INFINITY : 4.f);
+      alignas(32) float expected_t[W], result_t[W];
+      uint32_t expected = intersect_wide_node_scalar<W>(node, ray, ray_t,
+                                                        expected_t);
+      uint32_t result = kernel(node, ray, ray_t, result_t);
+      diffs += expected != result;
+      for (size_t slot = 0; slot < W; slot++)
+        if (expected & result & (1u << slot))
+          diffs += expected_t[slot] != result_t[slot];
+      hits += std::popcount(expected);
+    }
+    if (diffs != 0 || hits == 0)
+      LOGERR("{} kernel : {} results differ from the scalar one ({} hits)",
+             name, diffs, hits);
+  };
+  if (cpu_supports(SimdLevel::Sse))
+    check_kernel.template operator()<4>("sse", intersect_wide_node_sse);
+  if (cpu_supports(SimdLevel::Avx2))
+    check_kernel.template operator()<8>("avx2", intersect_wide_node_avx2);
+
+  // the bvh4 and bvh8 traversals match the brute force search
+  std::vector<Sphere> spheres;
+  for (uint i = 0; i < 1000; i++) {
+    glm::vec3 center(random_float(-50, 50), random_float(-50, 50),
+                     random_float(-50, 50));
+    spheres.push_back(Sphere(center, random_float(0.1, 2)));
+  }
+  HittableVector<Sphere> vec{std::vector<Sphere>(spheres)};
+  for (size_t width : {4, 8}) {
+    WideBvhAccStruct<Sphere> wide(std::vector<Sphere>(spheres), width);
+    if (wide.get_width() != width)
+      LOGERR("bvh{} built with a width of {}", width, wide.get_width());
+
+    size_t diffs = 0, hits = 0;
+    for (uint i = 0; i < 10000; i++) {
+      Ray ray = {glm::vec3(random_float(-60, 60), random_float(-60, 60),
+                           random_float(-60, 60)),
+                 glm::vec3(random_float(-1, 1), random_float(-1, 1),
+                           random_float(-1, 1))};
+      Interval ray_t(0, random_float() < 0.5f ? INFINITY : 30.f);
+      HitRecord vec_rec, wide_rec;
+      bool vec_hit = vec.hit(ray, ray_t, &vec_rec) != IAccStruct::MISS_INDEX;
+      bool wide_hit = wide.hit(ray, ray_t, &wide_rec) !=
+                      IAccStruct::MISS_INDEX;
+      diffs += vec_hit != wide_hit ||
+               (vec_hit && (vec_rec.t != wide_rec.t ||
+                            vec_rec.normal != wide_rec.normal));
+      diffs += wide.occluded(ray, ray_t) != vec_hit;
+      hits += vec_hit;
+    }
+    if (diffs != 0 || hits == 0)
+      LOGERR("bvh{} : {} results differ from the linear search ({} hits)",
+             width, diffs, hits);
+  }
+
+  LOGOK("wide_bvh");
+}
+
+void test_sphere_soa(VulkanContext &ctx) {
+  // every kernel against Sphere::hit, with counts that leave partial blocks
+  // of 8 and 16 lanes, and rays starting inside spheres (back faces)
+  std::vector<SimdLevel> levels = {SimdLevel::Scalar};
+  for (SimdLevel level : {SimdLevel::Avx2, SimdLevel::Avx512})
+    if (cpu_supports(level))
+      levels.push_back(level);
+
+  for (size_t count : {1, 5, 8, 13, 16, 17, 31, 100}) {
+    std::vector<Sphere> spheres;
+    for (size_t i = 0; i < count; i++) {
+      glm::vec3 center(random_float(-5, 5), random_float(-5, 5),
+                       random_float(-5, 5));
+      spheres.push_back(Sphere(center, random_float(0.3, 2)));
+    }
+    HittableVector<Sphere> vec{std::vector<Sphere>(spheres)};
+    SphereSoA soa{std::vector<Sphere>(spheres)};
+
+    // the SIMD roots differ from Sphere::hit in the last bits (FMA) : a
+    // different result is only allowed on a grazing ray or a near tie
+    auto grazing = [&](const Ray &r, uint32_t index) {
+      glm::vec3 oc = spheres[index].get_center() - r.origin;
+      glm::vec3 dir = glm::normalize(r.direction);
+      float dist = glm::length(oc - glm::dot(oc, dir) * dir);
+      return std::abs(dist - spheres[index].get_radius()) < 1e-3f;
+    };
+    auto near = [](float a, float b) {
+      return std::abs(a - b) <= 1e-4f * std::max(std::abs(a), 1.f);
+    };
+
+    for (SimdLevel level : levels) {
+      soa.set_simd_level(level);
+      size_t diffs = 0, hits = 0, back_faces = 0;
+      for (uint i = 0; i < 2000; i++) {
+        Ray r(glm::vec3(random_float(-7, 7), random_float(-7, 7),
+                        random_float(-7, 7)),
+              glm::vec3(random_float(-1, 1), random_float(-1, 1),
+                        random_float(-1, 1)));
+        Interval ray_t(0, random_float() < 0.5f ? INFINITY : 5.f);
+        HitRecord expected, result;
+        uint32_t expected_index = vec.hit(r, ray_t, &expected);
+        uint32_t result_index = soa.hit(r, ray_t, &result);
+        bool expected_hit = expected_index != IAccStruct::MISS_INDEX;
+        bool result_hit = result_index != IAccStruct::MISS_INDEX;
+
+        if (expected_hit != result_hit) {
+          diffs += !grazing(r, expected_hit ? expected_index : result_index);
+        } else if (expected_hit) {
+          bool same = expected_index == result_index &&
+                      near(expected.t, result.t) &&
+                      expected.front_face == result.front_face &&
+                      glm::length(expected.normal - result.normal) < 1e-3f;
+          bool tie = expected_index != result_index &&
+                     near(expected.t, result.t);
+          diffs += !same && !tie && !grazing(r, expected_index);
+          hits++;
+          back_faces += !expected.front_face;
+        }
+        if (soa.occluded(r, ray_t) != expected_hit)
+          diffs += !expected_hit || !grazing(r, expected_index);
+      }
+      if (diffs != 0 || hits == 0 || (count > 8 && back_faces == 0))
+        LOGERR("{} kernel over {} spheres : {} results differ from "
+               "Sphere::hit ({} hits, {} back faces)",
+               simd_level_name(level), count, diffs, hits, back_faces);
+    }
+  }
+
+  LOGOK("sphere_soa");
+}
+
+void test_bvh_builder(VulkanContext &ctx) {
+  // above PARALLEL_BIN_THRESHOLD : parallel subtrees and parallel binning
+  constexpr size_t PRIM_COUNT = BvhBuilder::PARALLEL_BIN_THRESHOLD + 4000;
+  std::vector<BBox> bboxes;
+  for (size_t i = 0; i < PRIM_COUNT; i++) {
+    glm::vec3 p(random_float(-100, 100), random_float(-100, 100),
+                random_float(-100, 100));
+    bboxes.push_back(BBox(p, p + glm::vec3(random_float(0.1, 2))));
+  }
+
+  auto contains = [](const BBox &outer, const BBox &inner) {
+    for (size_t axis = 0; axis < 3; axis++)
+      if (inner.axis_interval(axis).min < outer.axis_interval(axis).min ||
+          inner.axis_interval(axis).max > outer.axis_interval(axis).max)
+        return false;
+    return true;
+  };
+
+  // the stats match a walk of the tree, which covers every primitive once
+  auto check_build = [&](const char *name, BvhBuildOptions options) {
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> prim_order;
+    BvhBuildStats stats =
+        BvhBuilder(options).build(bboxes, &nodes, &prim_order);
+
+    std::vector<uint32_t> sorted_order = prim_order;
+    std::ranges::sort(sorted_order);
+    for (size_t i = 0; i < sorted_order.size(); i++)
+      if (sorted_order[i] != i)
+        LOGERR("{} : the primitive order is not a permutation", name);
+
+    size_t leaf_count = 0, max_depth = 0, covered = 0;
+    std::vector<std::pair<uint32_t, size_t>> stack = {{0, 0}};
+    while (!stack.empty()) {
+      auto [index, depth] = stack.back();
+      stack.pop_back();
+      const BvhNode &node = nodes[index];
+      max_depth = std::max(max_depth, depth);
+      if (node.is_leaf()) {
+        if (node.first != covered)
+          LOGERR("{} : leaf ranges overlap or leave a gap", name);
+        covered += node.count;
+        leaf_count++;
+        for (uint32_t i = node.first; i < node.first + node.count; i++)
+          if (!contains(node.bbox, bboxes[prim_order[i]]))
+            LOGERR("{} : a leaf doesn't contain its primitives", name);
+        continue;
+      }
+      for (uint32_t child : {node.first, node.first + 1})
+        if (child <= index || child >= nodes.size() ||
+            !contains(node.bbox, nodes[child].bbox))
+          LOGERR("{} : node {} has a bad child {}", name, index, child);
+      // right pushed first : the leaves come left to right
+      stack.push_back({node.first + 1, depth + 1});
+      stack.push_back({node.first, depth + 1});
+    }
+
+    if (covered != PRIM_COUNT || stats.primCount != PRIM_COUNT ||
+        stats.nodeCount != nodes.size() || stats.leafCount != leaf_count ||
+        stats.maxDepth != max_depth || max_depth >= BvhBuilder::MAX_DEPTH)
+      LOGERR("{} : stats of {} nodes, {} leaves, depth {} for a tree of {} "
+             "nodes, {} leaves, depth {}",
+             name, stats.nodeCount, stats.leafCount, stats.maxDepth,
+             nodes.size(), leaf_count, max_depth);
+    return BvhBuilder::sah_cost(nodes);
+  };
+
+  // the splits don't depend on the threads
+  ThreadPool pool(4);
+  float serial_cost = check_build("serial", {.threadCount = 1});
+  float pool_cost = check_build("pool", {.pool = &pool});
+  float owned_cost = check_build("owned pool", {.threadCount = 3});
+  for (float cost : {pool_cost, owned_cost})
+    if (std::abs(cost - serial_cost) > 1e-5f * serial_cost)
+      LOGERR("parallel build sah cost of {} instead of {}", cost,
+             serial_cost);
+
+  // a parallel built bvh still finds the closest hit
+  std::vector<Sphere> spheres;
+  for (size_t i = 0; i < 2 * BvhBuilder::PARALLEL_THRESHOLD; i++) {
+    glm::vec3 center(random_float(-50, 50), random_float(-50, 50),
+                     random_float(-50, 50));
+    spheres.push_back(Sphere(center, random_float(0.1, 1)));
+  }
+  HittableVector<Sphere> vec{std::vector<Sphere>(spheres)};
+  BvhAccStruct<Sphere> bvh(std::move(spheres), {.pool = &pool});
+  if (bvh.get_build_stats().primCount != 2 * BvhBuilder::PARALLEL_THRESHOLD)
+    LOGERR("parallel bvh built over {} primitives",
+           bvh.get_build_stats().primCount);
+
+  size_t diffs = 0, hits = 0;
+  for (uint i = 0; i < 5000; i++) {
+    Ray ray = {glm::vec3(random_float(-60, 60), random_float(-60, 60), -100),
+               glm::vec3(random_float(-0.5, 0.5), random_float(-0.5, 0.5), 1)};
+    HitRecord vec_rec, bvh_rec;
+    bool vec_hit = vec.hit(ray, {0, INFINITY}, &vec_rec) !=
+                   IAccStruct::MISS_INDEX;
+    bool bvh_hit = bvh.hit(ray, {0, INFINITY}, &bvh_rec) !=
+                   IAccStruct::MISS_INDEX;
+    diffs += vec_hit != bvh_hit || (vec_hit && vec_rec.t != bvh_rec.t);
+    hits += vec_hit;
+  }
+  if (diffs != 0 || hits == 0)
+    LOGERR("{} parallel bvh hits differ from the linear search ({} hits)",
+           diffs, hits);
+
+  LOGOK("bvh_builder");
+}
+
+// 200 random spheres in front of the camera, the scene of the render paths
+// comparisons
+static Scene make_random_sphere_scene(Camera camera = Camera()) {
+  std::vector<Sphere> spheres;
+  for (uint i = 0; i < 200; i++) {
+    glm::vec3 center(random_float(-8, 8), random_float(-8, 8),
+                     random_float(-4, 4));
+    spheres.push_back(Sphere(center, random_float(0.2, 1)));
+  }
+  return {camera, std::make_unique<BvhAccStruct<Sphere>>(std::move(spheres))};
+}
+
+// 301x157 image of a default SimpleCPURenderer : tiled, scalar, one sample
+static std::vector<uint8_t> reference_render(const Scene &scene) {
+  SimpleCPURenderer reference(301, 157);
+  reference.render(scene);
+  std::span<const uint8_t> data = reference.get_img_buff().get_data();
+  return {data.begin(), data.end()};
+}
+
+void test_packet_render(VulkanContext &ctx) {
+  Scene scene = make_random_sphere_scene();
+
+  std::vector<uint8_t> expected = reference_render(scene);
+
+  for (size_t packet_size : {2, 4}) {
+    SimpleCPURenderer packets(301, 157);
+    packets.set_packet_size(packet_size);
+    packets.set_tile_size(15); // blocks cut by the tiles borders
+    packets.set_thread_count(4);
+    packets.render(scene);
+
+    auto result = packets.get_img_buff().get_data();
+    if (!std::equal(expected.begin(), expected.end(), result.begin(),
+                    result.end()))
+      LOGERR("{}x{} packet render differs from the scalar one", packet_size,
+             packet_size);
+  }
+
+  // a sphere behind the camera, on the line of every ray : culled by the
+  // packet frustum, and out of the scalar camera rays interval as well
+  std::vector<Sphere> behind = {Sphere({0, 0, -30}, 15),
+                                Sphere({0, 0, 5}, 3)};
+  Scene behind_scene{Camera(), std::make_unique<BvhAccStruct<Sphere>>(
+                                   std::move(behind))};
+  Scene front_scene{Camera(), std::make_unique<BvhAccStruct<Sphere>>(
+                                  std::vector<Sphere>{Sphere({0, 0, 5}, 3)})};
+  std::vector<uint8_t> front = reference_render(front_scene);
+  if (!std::ranges::equal(reference_render(behind_scene), front))
+    LOGERR("a sphere behind the camera shows in the scalar render");
+  SimpleCPURenderer behind_packets(301, 157);
+  behind_packets.set_packet_size(4);
+  behind_packets.render(behind_scene);
+  if (!std::ranges::equal(behind_packets.get_img_buff().get_data(), front))
+    LOGERR("a sphere behind the camera shows in the packet render");
+
+  // a gen_ray of its own : the packet size is ignored
+  class IndexCPURenderer : public CPURenderer {
+  public:
+    using CPURenderer::CPURenderer;
+
+  protected:
+    Color gen_ray(const Scene &scene, size_t i, size_t j) const override {
+      return Color(static_cast<float>(pixel_index(i, j) % 255) / 255, 0, 0, 1);
+    }
+    Color closest_hit(const Scene &scene, HitRecord record,
+                      uint32_t hit_index) const override {
+      return WHITE;
+    }
+    Color miss(const Scene &scene, Ray r) const override { return WHITE; }
+  };
+  IndexCPURenderer index_scalar(301, 157), index_packets(301, 157);
+  index_packets.set_packet_size(4);
+  index_scalar.render(scene);
+  index_packets.render(scene);
+  if (!std::ranges::equal(index_scalar.get_img_buff().get_data(),
+                          index_packets.get_img_buff().get_data()))
+    LOGERR("packets used by a renderer without packet support");
+
+  LOGOK("packet_render");
+}
+
+void test_wavefront_render(VulkanContext &ctx) {
+  Scene scene = make_random_sphere_scene();
+
+  std::vector<uint8_t> expected = reference_render(scene);
+
+  SimpleCPURenderer wavefront(301, 157);
+  wavefront.set_wavefront_size(5000); // last batch smaller
+  wavefront.set_thread_count(4);
+  wavefront.render(scene);
+
+  auto result = wavefront.get_img_buff().get_data();
+  if (!std::equal(expected.begin(), expected.end(), result.begin(),
+                  result.end()))
+    LOGERR("wavefront render differs from the tiled one");
+
+  LOGOK("wavefront_render");
+}
+
+void test_static_render(VulkanContext &ctx) {
+  Scene scene = make_random_sphere_scene();
+
+  std::vector<uint8_t> expected = reference_render(scene);
+
+  using StaticRenderer =
+      StaticCPURenderer<SimpleCPURenderer, BvhAccStruct, Sphere>;
+  std::unique_ptr<Renderer> specialized =
+      std::make_unique<StaticRenderer>(301, 157);
+  specialized->render(scene);
+
+  auto result = specialized->get_img_buff().get_data();
+  if (!std::equal(expected.begin(), expected.end(), result.begin(),
+                  result.end()))
+    LOGERR("static render differs from the virtual one");
+
+  LOGOK("static_render");
+}
+
+void test_accumulation(VulkanContext &ctx) {
+  Scene scene = make_random_sphere_scene();
+
+  std::vector<uint8_t> expected = reference_render(scene);
+
+  // the single sample path is not jittered : the sampler is not used, and a
+  // pass of samples at the pixel centers gives the same image
+  class CenterSampler : public ISampler {
+  public:
+    float get_1d(uint32_t, uint32_t, uint32_t) const override { return 0.5f; }
+    glm::vec2 get_2d(uint32_t, uint32_t, uint32_t) const override {
+      return glm::vec2(0.5f);
+    }
+  };
+  SimpleCPURenderer seeded(301, 157);
+  seeded.set_sampler(std::make_unique<PcgSampler>(7));
+  seeded.render(scene);
+  if (!std::ranges::equal(seeded.get_img_buff().get_data(), expected))
+    LOGERR("the single sample render depends on the sampler");
+
+  SimpleCPURenderer progressive(301, 157);
+  progressive.set_sampler(std::make_unique<CenterSampler>());
+  progressive.set_thread_count(4);
+  progressive.render_pass(scene);
+  progressive.resolve();
+
+  auto result = progressive.get_img_buff().get_data();
+  if (!std::equal(expected.begin(), expected.end(), result.begin(),
+                  result.end()))
+    LOGERR("single pass accumulation differs from the direct render");
+
+  for (uint i = 0; i < 7; i++)
+    progressive.render_pass(scene);
+  if (progressive.get_accumulation().get_sample_count(150, 80) != 8)
+    LOGERR("wrong accumulated sample count");
+
+  // a small variance over a bright mean : 1000 +- 1, so a standard error of
+  // 1e-5 relative, lost in the cancellation of a float sum of squares
+  AccumulationBuffer bright(1, 1);
+  constexpr uint32_t SAMPLES = 10000;
+  for (uint32_t i = 0; i < SAMPLES; i++)
+    bright.add_sample(0, 0, Color(i % 2 == 0 ? 999.f : 1001.f));
+  float expected_error =
+      std::sqrt(SAMPLES / (SAMPLES - 1.f) / SAMPLES) / 1000.f;
+  if (std::abs(bright.get_error(0, 0) - expected_error) >
+      0.01f * expected_error)
+    LOGERR("relative error of {} instead of {}", bright.get_error(0, 0),
+           expected_error);
+
+  LOGOK("accumulation");
+}
+
+void test_adaptive_sampling(VulkanContext &ctx) {
+  std::vector<Sphere> spheres = {Sphere(glm::vec3(0, 0, 0), 3)};
+  Scene scene{Camera(),
+              std::make_unique<BvhAccStruct<Sphere>>(std::move(spheres))};
+
+  SimpleCPURenderer renderer(160, 120);
+  renderer.set_tile_size(16);
+  renderer.set_adaptive_sampling({0.01f, 4, 32});
+  renderer.render(scene);
+
+  const AccumulationBuffer &accumulation = renderer.get_accumulation();
+  // the smooth background converges at once, the sphere silhouette doesn't
+  if (accumulation.get_sample_count(0, 0) != 4)
+    LOGERR("background tile got {} samples instead of 4",
+           accumulation.get_sample_count(0, 0));
+  if (renderer.get_sample_index() <= 4)
+    LOGERR("no tile got more samples than the minimum");
+
+  LOGOK("adaptive_sampling");
+}
+
+void test_samplers(VulkanContext &ctx) {
+  // every 4x4 stratum gets one of the 16 first points
+  SobolSampler sobol(42);
+  std::array<bool, 16> strata = {};
+  for (uint32_t i = 0; i < 16; i++) {
+    glm::vec2 u = sobol.get_2d(7, i, 0);
+    strata[static_cast<size_t>(u.x * 4) * 4 + static_cast<size_t>(u.y * 4)] =
+        true;
+  }
+  if (std::ranges::count(strata, false) != 0)
+    LOGERR("sobol points are not stratified");
+
+  // counter based : the same image whatever the threads
+  Camera camera;
+  camera.defocusAngle = 0.05f;
+  Scene scene = make_random_sphere_scene(camera);
+
+  SimpleCPURenderer single(160, 90);
+  single.set_spp(4);
+  single.render(scene);
+
+  SimpleCPURenderer parallel(160, 90);
+  parallel.set_spp(4);
+  parallel.set_thread_count(4);
+  parallel.set_tile_size(7);
+  parallel.render(scene);
+
+  auto expected = single.get_img_buff().get_data();
+  auto result = parallel.get_img_buff().get_data();
+  if (!std::equal(expected.begin(), expected.end(), result.begin(),
+                  result.end()))
+    LOGERR("multi sampled render depends on the threads");
+
+  LOGOK("samplers");
+}
+
+static std::vector<uint8_t> read_file(const std::string &filename) {
+  std::ifstream file(filename, std::ios::binary);
+  return {std::istreambuf_iterator<char>(file),
+          std::istreambuf_iterator<char>()};
+}
+
+// Empty directory in the system temporary one, removed with its files when
+// the test leaves, failed or not
+struct TempDirectory {
+  std::filesystem::path path;
+
+  TempDirectory(const char *name)
+      : path(std::filesystem::temp_directory_path() / name) {
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+  }
+  NO_COPY(TempDirectory);
+  ~TempDirectory() {
+    std::error_code error;
+    std::filesystem::remove_all(path, error);
+  }
+
+  std::string file(const char *name) const { return (path / name).string(); }
+};
+
+void test_triangle_mesh(VulkanContext &ctx) {
+  // 64x64 grid of quads in the z = 0 plane, [0, 1]^2
+  constexpr uint32_t N = 64;
+  std::vector<glm::vec3> positions;
+  std::vector<TriangleMesh::Triangle> triangles;
+  for (uint32_t y = 0; y <= N; y++)
+    for (uint32_t x = 0; x <= N; x++)
+      positions.emplace_back(float(x) / N, float(y) / N, 0.f);
+  for (uint32_t y = 0; y < N; y++)
+    for (uint32_t x = 0; x < N; x++) {
+      uint32_t v = y * (N + 1) + x;
+      triangles.push_back({v, v + 1, v + N + 2});
+      triangles.push_back({v, v + N + 2, v + N + 1});
+    }
+  TriangleMesh grid(std::move(positions), std::move(triangles));
+
+  // watertight : rays aimed at the inner shared vertices and edges all hit
+  size_t leaks = 0;
+  HitRecord rec;
+  for (uint32_t i = 0; i < 20000; i++) {
+    glm::vec3 target(float(1 + i % (N - 1)) / N,
+                     float(1 + (i * 7) % (2 * N - 1)) / (2 * N), 0.f);
+    glm::vec3 origin(random_float(-1, 2), random_float(-1, 2),
+                     random_float(0.5, 3));
+    if (!grid.hit(Ray(origin, target - origin), Interval(0, 10), &rec))
+      leaks++;
+  }
+  if (leaks != 0)
+    LOGERR("{} rays went through the triangle grid", leaks);
+
+  // bvh traversal against a brute force over single triangle meshes
+  std::vector<glm::vec3> soup;
+  for (uint i = 0; i < 3000; i++) {
+    glm::vec3 p(random_float(-5, 5), random_float(-5, 5), random_float(-5, 5));
+    for (int k = 0; k < 3; k++)
+      soup.push_back(p + glm::vec3(random_float(-0.5, 0.5),
+                                   random_float(-0.5, 0.5),
+                                   random_float(-0.5, 0.5)));
+  }
+  std::vector<TriangleMesh> singles;
+  std::vector<TriangleMesh::Triangle> soup_triangles;
+  for (uint32_t i = 0; i < soup.size(); i += 3) {
+    singles.emplace_back(std::vector<glm::vec3>{soup[i], soup[i + 1],
+                                                soup[i + 2]},
+                         std::vector<TriangleMesh::Triangle>{{0, 1, 2}});
+    soup_triangles.push_back({i, i + 1, i + 2});
+  }
+  TriangleMesh mesh(std::move(soup), std::move(soup_triangles));
+
+  size_t diffs = 0;
+  for (uint i = 0; i < 2000; i++) {
+    Ray r(glm::vec3(random_float(-8, 8), random_float(-8, 8), -10),
+          glm::vec3(random_float(-0.5, 0.5), random_float(-0.5, 0.5), 1));
+    HitRecord expected, result;
+    bool expected_hit = false;
+    float closest = INFINITY;
+    for (const TriangleMesh &single : singles)
+      if (single.hit(r, Interval(0, closest), &expected)) {
+        expected_hit = true;
+        closest = expected.t;
+      }
+    bool result_hit = mesh.hit(r, Interval(0, INFINITY), &result);
+    if (expected_hit != result_hit || (result_hit && result.t != closest))
+      diffs++;
+  }
+  if (diffs != 0)
+    LOGERR("{} mesh bvh hits differ from the brute force", diffs);
+
+  LOGOK("triangle mesh");
+}
+
+void test_gltf_loader(VulkanContext &ctx) {
+  // a quad (u16 indices) placed twice, a points only mesh, and a broken
+  // copy of the quad with an index past its 4 vertices
+  auto gltf = [](const char *buffer) {
+    return fmt::format(R"({{
+  "asset": {{"version": "2.0"}},
+  "buffers": [{{"byteLength": 60,
+    "uri": "data:application/octet-stream;base64,{}"}}],
+  "bufferViews": [{{"buffer": 0, "byteOffset": 0, "byteLength": 48}},
+                  {{"buffer": 0, "byteOffset": 48, "byteLength": 12}}],
+  "accessors": [
+    {{"bufferView": 0, "componentType": 5126, "count": 4, "type": "VEC3",
+      "min": [-1, -1, 0], "max": [1, 1, 0]}},
+    {{"bufferView": 1, "componentType": 5123, "count": 6, "type": "SCALAR"}}],
+  "meshes": [
+    {{"primitives": [{{"attributes": {{"POSITION": 0}}, "indices": 1}}]}},
+    {{"primitives": [{{"attributes": {{"POSITION": 0}}, "mode": 0}}]}}],
+  "nodes": [{{"mesh": 0, "translation": [0, 0, -5]}}, {{"mesh": 1}},
+            {{"mesh": 0, "translation": [3, 0, -5]}}],
+  "scenes": [{{"nodes": [0, 1, 2]}}],
+  "scene": 0
+}})",
+                       buffer);
+  };
+  constexpr const char *QUAD =
+      "AACAvwAAgL8AAAAAAACAPwAAgL8AAAAAAACAPwAAgD8AAAAA"
+      "AACAvwAAgD8AAAAAAAABAAIAAAACAAMA";
+  constexpr const char *BROKEN_QUAD =
+      "AACAvwAAgL8AAAAAAACAPwAAgL8AAAAAAACAPwAAgD8AAAAA"
+      "AACAvwAAgD8AAAAAAAABAAIAAAACAAcA";
+
+  TempDirectory directory("rtvk_gltf_loader");
+  std::string quad_path = directory.file("quad.gltf");
+  std::string broken_path = directory.file("broken.gltf");
+  std::ofstream(quad_path) << gltf(QUAD);
+  std::ofstream(broken_path) << gltf(BROKEN_QUAD);
+
+  std::optional<GltfScene> scene = load_gltf(quad_path);
+  if (!scene || scene->meshes.size() != 1 || scene->instances.size() != 2)
+    LOGERR("glTF quad loaded as {} meshes, {} instances",
+           scene ? scene->meshes.size() : 0,
+           scene ? scene->instances.size() : 0);
+  const TriangleMesh &quad = scene->meshes[0];
+  std::vector<TriangleMesh::Triangle> expected_triangles = {{0, 1, 2},
+                                                            {0, 2, 3}};
+  if (quad.get_vertex_count() != 4 ||
+      quad.get_positions()[2] != glm::vec3(1, 1, 0) ||
+      !std::ranges::equal(quad.get_triangles(), expected_triangles))
+    LOGERR("glTF quad read wrong");
+
+  // both instances are hit where their node put them
+  std::vector<TriangleMesh> world = flatten_gltf(*scene);
+  HitRecord rec;
+  for (size_t i = 0; i < 2; i++) {
+    glm::vec3 target(i == 0 ? 0.5f : 3.5f, 0.2f, -5);
+    if (world.size() != 2 ||
+        !world[i].hit(Ray(glm::vec3(target.x, target.y, 0), {0, 0, -1}),
+                      Interval(0, 10), &rec) ||
+        std::abs(rec.t - 5) > 1e-4f)
+      LOGERR("glTF instance {} not hit at its place", i);
+  }
+
+  // the broken mesh is skipped, missing files are reported without throwing
+  std::optional<GltfScene> broken = load_gltf(broken_path);
+  if (!broken || !broken->meshes.empty() || !broken->instances.empty())
+    LOGERR("glTF mesh with out of range indices not skipped");
+  if (load_gltf(directory.file("missing.gltf")))
+    LOGERR("missing glTF file loaded");
+
+  LOGOK("gltf_loader");
+}
+
+void test_instancing(VulkanContext &ctx) {
+  std::vector<glm::vec3> positions;
+  std::vector<TriangleMesh::Triangle> triangles;
+  for (uint32_t i = 0; i < 300; i++) {
+    glm::vec3 p(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1));
+    for (int k = 0; k < 3; k++)
+      positions.push_back(p + glm::vec3(random_float(-0.2, 0.2),
+                                        random_float(-0.2, 0.2),
+                                        random_float(-0.2, 0.2)));
+    triangles.push_back({3 * i, 3 * i + 1, 3 * i + 2});
+  }
+  auto mesh = std::make_shared<const TriangleMesh>(std::move(positions),
+                                                   std::move(triangles));
+
+  // the same mesh 1000 times, against the world space copies
+  std::vector<MeshInstance> instances;
+  std::vector<TriangleMesh> flattened;
+  for (int i = 0; i < 1000; i++) {
+    glm::mat4 transform = glm::translate(
+        glm::mat4(1.f),
+        glm::vec3(random_float(-40, 40), random_float(-40, 40),
+                  random_float(-40, 40)));
+    transform = glm::rotate(transform, random_float(0, 6.28),
+                            glm::vec3(random_float(-1, 1),
+                                      random_float(-1, 1), 1));
+    transform = glm::scale(transform, glm::vec3(random_float(0.5, 2)));
+    instances.emplace_back(mesh, transform);
+
+    std::vector<glm::vec3> world;
+    for (glm::vec3 p : mesh->get_positions())
+      world.push_back(glm::vec3(transform * glm::vec4(p, 1.f)));
+    std::vector<TriangleMesh::Triangle> tris(mesh->get_triangles().begin(),
+                                             mesh->get_triangles().end());
+    flattened.emplace_back(std::move(world), std::move(tris));
+  }
+  InstanceBvh instanced(std::move(instances));
+  BvhAccStruct<TriangleMesh> flat(std::move(flattened));
+
+  size_t diffs = 0;
+  for (uint i = 0; i < 2000; i++) {
+    Ray r(glm::vec3(random_float(-50, 50), random_float(-50, 50), -60),
+          glm::vec3(random_float(-0.5, 0.5), random_float(-0.5, 0.5), 1));
+    HitRecord expected, result;
+    bool expected_hit =
+        flat.hit(r, Interval(0, INFINITY), &expected) != IAccStruct::MISS_INDEX;
+    bool result_hit = instanced.hit(r, Interval(0, INFINITY), &result) !=
+                      IAccStruct::MISS_INDEX;
+    if (expected_hit != result_hit ||
+        (result_hit &&
+         (std::abs(result.t - expected.t) > 1e-3f * expected.t ||
+          glm::dot(result.normal, expected.normal) < 0.999f)))
+      diffs++;
+  }
+  // rays grazing an edge can land on either side of it in the two spaces
+  if (diffs > 2)
+    LOGERR("{} instanced hits differ from the world space meshes", diffs);
+
+  LOGOK("instancing");
+}
+
+void test_mesh_cache(VulkanContext &ctx) {
+  auto make_soup = [](uint32_t count) {
+    std::vector<glm::vec3> positions;
+    std::vector<TriangleMesh::Triangle> triangles;
+    for (uint32_t i = 0; i < count; i++) {
+      glm::vec3 p(random_float(-5, 5), random_float(-5, 5),
+                  random_float(-5, 5));
+      for (int k = 0; k < 3; k++)
+        positions.push_back(p + glm::vec3(random_float(-0.5, 0.5),
+                                          random_float(-0.5, 0.5),
+                                          random_float(-0.5, 0.5)));
+      triangles.push_back({3 * i, 3 * i + 1, 3 * i + 2});
+    }
+    return std::make_pair(positions, triangles);
+  };
+
+  TempDirectory directory("rtvk_test_mesh_cache");
+  MeshCache cache(directory.path);
+
+  auto [positions, triangles] = make_soup(2000);
+  uint64_t hash = MeshCache::content_hash(positions, triangles, {}, {});
+  TriangleMesh built{std::vector(positions), std::vector(triangles)};
+  TriangleMesh first = cache.get_or_build(std::vector(positions),
+                                          std::vector(triangles));
+  TriangleMesh second = cache.get_or_build(std::vector(positions),
+                                           std::vector(triangles));
+  if (first.is_mapped() || !second.is_mapped())
+    LOGERR("the second mesh should be read from the cache");
+
+  // the mapped mesh is the built one
+  size_t diffs = 0;
+  for (uint i = 0; i < 2000; i++) {
+    Ray r(glm::vec3(random_float(-8, 8), random_float(-8, 8), -10),
+          glm::vec3(random_float(-0.5, 0.5), random_float(-0.5, 0.5), 1));
+    HitRecord expected, result;
+    bool expected_hit = built.hit(r, Interval(0, INFINITY), &expected);
+    bool result_hit = second.hit(r, Interval(0, INFINITY), &result);
+    if (expected_hit != result_hit || (result_hit && expected.t != result.t))
+      diffs++;
+  }
+  if (diffs != 0)
+    LOGERR("{} hits differ on the cached mesh", diffs);
+
+  // other content or options, other key
+  positions[0].x += 1e-3f;
+  if (MeshCache::content_hash(positions, triangles, {}, {}) == hash ||
+      MeshCache::content_hash(positions, triangles, {},
+                              {.maxLeafSize = 2}) == hash)
+    LOGERR("the content hash ignores a change");
+
+  // a file of the right size with an index out of range is a miss : a
+  // vertex past the positions, a node child past the nodes, or a cycle
+  std::filesystem::path cached = cache.get_path(hash);
+  std::vector<uint8_t> original = read_file(cached.string());
+  auto corrupted_load = [&](std::span<const std::byte> array, size_t offset,
+                            uint32_t value) {
+    auto bytes = std::as_bytes(std::span(original));
+    auto found = std::ranges::search(bytes, array);
+    if (found.empty())
+      LOGERR("cached array not found in {}", cached.string());
+    std::vector<uint8_t> corrupted = original;
+    std::memcpy(corrupted.data() + (found.begin() - bytes.begin()) + offset,
+                &value, sizeof(value));
+    std::ofstream(cached, std::ios::binary)
+        .write(reinterpret_cast<const char *>(corrupted.data()),
+               static_cast<std::streamsize>(corrupted.size()));
+    return MeshCache::load(cached, hash).has_value();
+  };
+  auto triangle_bytes = std::as_bytes(built.get_triangles());
+  auto node_bytes = std::as_bytes(built.get_nodes());
+  size_t root_first = offsetof(BvhNode, first);
+  if (corrupted_load(triangle_bytes, 4, 6000) ||
+      corrupted_load(node_bytes, root_first, 1u << 30) ||
+      corrupted_load(node_bytes, root_first, 0))
+    LOGERR("a cache file with out of range indices was loaded");
+
+  // a normals section that does not match the positions is a miss : the
+  // header's normals (offset 48) points at one position (section at 32)
+  {
+    std::vector<uint8_t> corrupted = original;
+    uint64_t count = 1;
+    std::memcpy(corrupted.data() + 48, corrupted.data() + 32, 8);
+    std::memcpy(corrupted.data() + 56, &count, sizeof(count));
+    std::ofstream(cached, std::ios::binary)
+        .write(reinterpret_cast<const char *>(corrupted.data()),
+               static_cast<std::streamsize>(corrupted.size()));
+    if (MeshCache::load(cached, hash))
+      LOGERR("a cache file with a short normals section was loaded");
+  }
+
+  // a truncated file is a miss, not a crash
+  std::filesystem::resize_file(cache.get_path(hash),
+                               std::filesystem::file_size(
+                                   cache.get_path(hash)) / 2);
+  if (MeshCache::load(cache.get_path(hash), hash))
+    LOGERR("a truncated cache file was loaded");
+
+  LOGOK("mesh cache");
+}
+
+void test_bvh_refit(VulkanContext &ctx) {
+  std::vector<Sphere> spheres;
+  for (uint i = 0; i < 4000; i++)
+    spheres.push_back(Sphere(glm::vec3(random_float(-20, 20),
+                                       random_float(-20, 20),
+                                       random_float(-20, 20)),
+                             random_float(0.1, 0.3)));
+  std::vector<Sphere> moved_spheres = spheres;
+  BvhAccStruct<Sphere> bvh(std::move(spheres));
+  std::vector<BvhNode> built_nodes = bvh.get_nodes();
+
+  // same hits as the brute force and as a bvh built over the moved spheres
+  auto check = [&](const char *step) {
+    HittableVector<Sphere> brute{std::vector<Sphere>(moved_spheres)};
+    BvhAccStruct<Sphere> fresh{std::vector<Sphere>(moved_spheres)};
+    size_t diffs = 0;
+    for (uint i = 0; i < 1000; i++) {
+      Ray r(glm::vec3(random_float(-25, 25), random_float(-25, 25), -30),
+            glm::vec3(random_float(-0.3, 0.3), random_float(-0.3, 0.3), 1));
+      HitRecord expected, fresh_record, result;
+      bool expected_hit = brute.hit(r, Interval(0, INFINITY), &expected) !=
+                          IAccStruct::MISS_INDEX;
+      bool fresh_hit = fresh.hit(r, Interval(0, INFINITY), &fresh_record) !=
+                       IAccStruct::MISS_INDEX;
+      bool result_hit = bvh.hit(r, Interval(0, INFINITY), &result) !=
+                        IAccStruct::MISS_INDEX;
+      if (expected_hit != result_hit || fresh_hit != result_hit ||
+          (result_hit &&
+           (expected.t != result.t || fresh_record.t != result.t)))
+        diffs++;
+    }
+    if (diffs != 0)
+      LOGERR("{} : {} hits differ from the brute force or a fresh build",
+             step, diffs);
+  };
+
+  auto move = [&](uint32_t id, glm::vec3 offset) {
+    Sphere &sphere = bvh.get_object(id);
+    sphere = Sphere(sphere.get_center() + offset, sphere.get_radius());
+    moved_spheres[id] = sphere;
+  };
+
+  // small moves : refit only
+  for (uint32_t id = 0; id < 4000; id += 100)
+    move(id, glm::vec3(0.1f, 0, 0));
+  if (bvh.update())
+    LOGERR("small moves should only refit the bvh");
+  check("refit");
+
+  // moves inside a corner of the scene : only its subtrees are rebuilt
+  std::vector<BvhNode> before = bvh.get_nodes();
+  std::vector<glm::vec3> before_centers;
+  for (const Sphere &sphere : bvh.get_objects())
+    before_centers.push_back(sphere.get_center());
+  for (uint32_t id = 0; id < 4000; id++) {
+    glm::vec3 center = moved_spheres[id].get_center();
+    if (center.x < -10 && center.y < -10 && center.z < -10)
+      move(id, glm::vec3(random_float(-20, -10), random_float(-20, -10),
+                         random_float(-20, -10)) -
+                   center);
+  }
+
+  // the subtrees update() rebuilds : the topmost nodes with a child grown
+  // past the threshold once refit, compared to the build
+  constexpr float THRESHOLD = 1.02f;
+  std::vector<BvhNode> refit = before;
+  std::vector<BBox> bboxes;
+  for (const Sphere &sphere : bvh.get_objects())
+    bboxes.push_back(sphere.get_bbox());
+  BvhBuilder::refit(refit, bboxes);
+  auto grew = [&](uint32_t index) {
+    return refit[index].bbox.surface_area() >
+           THRESHOLD * built_nodes[index].bbox.surface_area();
+  };
+  std::vector<bool> rebuilt(before.size(), false);
+  std::vector<uint32_t> stack = {0};
+  while (!stack.empty()) {
+    uint32_t index = stack.back();
+    stack.pop_back();
+    const BvhNode &node = before[index];
+    if (node.is_leaf())
+      continue;
+    bool in_rebuild = rebuilt[index] || grew(node.first) ||
+                      grew(node.first + 1);
+    rebuilt[index] = in_rebuild;
+    for (uint32_t child : {node.first, node.first + 1}) {
+      rebuilt[child] = in_rebuild;
+      stack.push_back(child);
+    }
+  }
+
+  if (!bvh.update(THRESHOLD))
+    LOGERR("local moves should rebuild a part of the bvh");
+  std::span<const BvhNode> after = bvh.get_nodes();
+  std::span<const Sphere> objects = bvh.get_objects();
+  if (std::ranges::count(rebuilt, false) == 0 || after.size() < before.size())
+    LOGERR("{} nodes kept out of {}, {} after the update",
+           std::ranges::count(rebuilt, false), before.size(), after.size());
+
+  // the other nodes kept their index and their objects, only refit
+  auto same_bbox = [](const BBox &a, const BBox &b) {
+    for (size_t axis = 0; axis < 3; axis++)
+      if (a.axis_interval(axis).min != b.axis_interval(axis).min ||
+          a.axis_interval(axis).max != b.axis_interval(axis).max)
+        return false;
+    return true;
+  };
+  size_t changed = 0;
+  for (size_t i = 0; i < before.size(); i++) {
+    if (rebuilt[i])
+      continue;
+    changed += after[i].first != before[i].first ||
+               after[i].count != before[i].count ||
+               !same_bbox(after[i].bbox, refit[i].bbox);
+    for (uint32_t k = before[i].first;
+         k < before[i].first + before[i].count; k++)
+      changed += objects[k].get_center() != before_centers[k];
+  }
+  if (changed != 0)
+    LOGERR("{} nodes or objects changed out of the rebuilt subtrees",
+           changed);
+
+  // every node is still in the tree, none is left unreferenced
+  size_t reachable = 0;
+  stack = {0};
+  while (!stack.empty()) {
+    const BvhNode &node = after[stack.back()];
+    stack.pop_back();
+    reachable++;
+    if (!node.is_leaf()) {
+      stack.push_back(node.first);
+      stack.push_back(node.first + 1);
+    }
+  }
+  if (reachable != after.size())
+    LOGERR("the partial rebuild left {} unreferenced nodes",
+           after.size() - reachable);
+  check("partial rebuild");
+
+  // objects thrown across the scene : the cost degrades and gets back
+  float built_cost = bvh.get_sah_cost();
+  for (uint32_t id = 0; id < 4000; id += 40)
+    move(id, glm::vec3(random_float(-15, 15), random_float(-15, 15), 0));
+  bvh.refit();
+  float refit_cost = bvh.get_sah_cost();
+  if (!bvh.update())
+    LOGERR("large moves should rebuild the bvh");
+  float rebuilt_cost = bvh.get_sah_cost();
+  if (refit_cost < 1.5f * built_cost || rebuilt_cost > 1.2f * built_cost)
+    LOGERR("sah costs : {} built, {} refit, {} rebuilt", built_cost,
+           refit_cost, rebuilt_cost);
+  check("full rebuild");
+
+  // two chains of spheres halving in size, built with 2 bins : one sphere
+  // per level, as deep as MAX_DEPTH allows. A sphere moved up a chain spoils
+  // a subtree a few levels down, which would not fit rebuilt from depth 0.
+  std::vector<Sphere> chains;
+  for (float y : {0.f, 10.f})
+    for (int i = 0; i < 120; i++)
+      chains.push_back(Sphere(glm::vec3(std::ldexp(1.f, -i), y, 0),
+                              std::ldexp(0.25f, -i)));
+  BvhBuildOptions two_bins = {.binCount = 2};
+  BvhAccStruct<Sphere> deep{std::vector<Sphere>(chains), two_bins};
+  Sphere &moved = deep.get_object(50);
+  moved = Sphere(glm::vec3(0.1f, 0, 0), 0.02f);
+  chains[50] = moved;
+  if (!deep.update(1.01f, two_bins))
+    LOGERR("the spoiled chain should be rebuilt");
+
+  std::span<const BvhNode> deep_nodes = deep.get_nodes();
+  std::vector<size_t> depths(deep_nodes.size(), 0);
+  for (size_t i = 0; i < deep_nodes.size(); i++) {
+    if (depths[i] >= BvhAccStruct<Sphere>::MAX_DEPTH)
+      LOGERR("node {} at depth {} after the update", i, depths[i]);
+    if (!deep_nodes[i].is_leaf())
+      for (uint32_t child : {deep_nodes[i].first, deep_nodes[i].first + 1})
+        depths[child] = depths[i] + 1;
+  }
+  HittableVector<Sphere> deep_brute{std::move(chains)};
+  for (uint i = 0; i < 1000; i++) {
+    Ray r(glm::vec3(random_float(0, 1), random_float(-0.5, 0.5), -1),
+          glm::vec3(0, 0, 1));
+    HitRecord expected, result;
+    bool expected_hit = deep_brute.hit(r, Interval(0, INFINITY), &expected) !=
+                        IAccStruct::MISS_INDEX;
+    bool result_hit = deep.hit(r, Interval(0, INFINITY), &result) !=
+                      IAccStruct::MISS_INDEX;
+    if (expected_hit != result_hit || (result_hit && expected.t != result.t))
+      LOGERR("the updated deep bvh misses a hit");
+  }
+
+  LOGOK("bvh refit");
+}
+
+void test_occlusion(VulkanContext &ctx) {
+  std::vector<Sphere> spheres;
+  for (uint i = 0; i < 1000; i++)
+    spheres.push_back(Sphere(glm::vec3(random_float(-10, 10),
+                                       random_float(-10, 10),
+                                       random_float(-10, 10)),
+                             random_float(0.1, 0.5)));
+
+  std::vector<glm::vec3> positions;
+  std::vector<TriangleMesh::Triangle> triangles;
+  for (uint32_t i = 0; i < 300; i++) {
+    glm::vec3 p(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1));
+    for (int k = 0; k < 3; k++)
+      positions.push_back(p + glm::vec3(random_float(-0.3, 0.3),
+                                        random_float(-0.3, 0.3),
+                                        random_float(-0.3, 0.3)));
+    triangles.push_back({3 * i, 3 * i + 1, 3 * i + 2});
+  }
+  auto mesh = std::make_shared<const TriangleMesh>(std::move(positions),
+                                                   std::move(triangles));
+  std::vector<MeshInstance> instances;
+  for (int i = 0; i < 100; i++)
+    instances.emplace_back(
+        mesh, glm::translate(glm::mat4(1.f),
+                             glm::vec3(random_float(-10, 10),
+                                       random_float(-10, 10),
+                                       random_float(-10, 10))));
+
+  std::vector<std::pair<const char *, std::unique_ptr<IAccStruct>>> structs;
+  structs.emplace_back("vector", std::make_unique<HittableVector<Sphere>>(
+                                     std::vector<Sphere>(spheres)));
+  structs.emplace_back("bvh", std::make_unique<BvhAccStruct<Sphere>>(
+                                  std::vector<Sphere>(spheres)));
+  structs.emplace_back("bvh4", std::make_unique<WideBvhAccStruct<Sphere>>(
+                                   std::vector<Sphere>(spheres), 4));
+  structs.emplace_back("bvh8", std::make_unique<WideBvhAccStruct<Sphere>>(
+                                   std::vector<Sphere>(spheres), 8));
+  structs.emplace_back("soa", std::make_unique<SphereSoA>(
+                                  std::vector<Sphere>(spheres)));
+  structs.emplace_back("instances",
+                       std::make_unique<InstanceBvh>(std::move(instances)));
+
+  // shadow segments between random points : occluded iff any hit
+  for (const auto &[name, acc_struct] : structs) {
+    size_t diffs = 0;
+    size_t occluded_count = 0;
+    for (uint i = 0; i < 2000; i++) {
+      glm::vec3 from(random_float(-12, 12), random_float(-12, 12),
+                     random_float(-12, 12));
+      glm::vec3 to(random_float(-12, 12), random_float(-12, 12),
+                   random_float(-12, 12));
+      Ray r(from, to - from);
+      Interval segment(1e-3f, 1.f);
+
+      HitRecord record;
+      bool expected = acc_struct->hit(r, segment, &record) !=
+                      IAccStruct::MISS_INDEX;
+      bool result = acc_struct->occluded(r, segment);
+      diffs += expected != result;
+      occluded_count += result;
+    }
+    if (diffs != 0 || occluded_count == 0)
+      LOGERR("{} : {} occlusion results differ from hit ({} occluded)", name,
+             diffs, occluded_count);
+  }
+
+  LOGOK("occlusion");
+}
+
+void test_path_tracing(VulkanContext &ctx) {
+  // white furnace : under a uniform background, a convex diffuse object
+  // reflects its albedo, and a glass one gives back all the light
+  auto furnace_mean = [](Material material) {
+    Scene scene{Camera(), std::make_unique<BvhAccStruct<Sphere>>(
+                              std::vector<Sphere>{Sphere({0, 0, 0}, 6)})};
+    scene.materials = {material};
+    scene.background = SolidBackground(WHITE);
+
+    PathTracingCPURenderer renderer(32, 32);
+    renderer.set_spp(64);
+    renderer.render(scene);
+
+    // pixels well inside the sphere silhouette
+    Color sum(0);
+    for (size_t y = 12; y < 20; y++)
+      for (size_t x = 12; x < 20; x++)
+        sum += renderer.get_accumulation().get_mean(x, y);
+    return sum / 64.f;
+  };
+
+  Color diffuse = furnace_mean(Material::diffuse({0.5f, 0.25f, 0.75f, 1}));
+  if (std::abs(diffuse.x - 0.5f) > 1e-4f ||
+      std::abs(diffuse.y - 0.25f) > 1e-4f ||
+      std::abs(diffuse.z - 0.75f) > 1e-4f)
+    LOGERR("diffuse furnace gives ({}, {}, {}) instead of the albedo",
+           diffuse.x, diffuse.y, diffuse.z);
+  Color glass = furnace_mean(Material::dielectric(1.5f));
+  if (std::abs(glass.x - 1) > 0.03f)
+    LOGERR("glass furnace gives {} instead of 1", glass.x);
+
+  // the sky over a black ground : the camera rays don't hit the ground
+  // behind the camera
+  Color sky = {0.25f, 0.5f, 0.75f, 1};
+  Scene ground{Camera(), std::make_unique<BvhAccStruct<Sphere>>(
+                             std::vector<Sphere>{Sphere({0, -1000, 0}, 995)})};
+  ground.materials = {Material::diffuse(BLACK)};
+  ground.background = SolidBackground(sky);
+  for (size_t wavefront_size : {0, 1000}) {
+    PathTracingCPURenderer renderer(32, 32);
+    renderer.set_spp(2);
+    renderer.set_wavefront_size(wavefront_size);
+    renderer.render(ground);
+    // the image rows go up from y = 0 : the last one looks at the sky
+    for (size_t x = 0; x < 32; x++) {
+      Color color = renderer.get_accumulation().get_mean(x, 31);
+      Color ground_color = renderer.get_accumulation().get_mean(x, 0);
+      if (glm::length(glm::vec3(color - sky)) > 1e-6f ||
+          glm::length(glm::vec3(ground_color)) != 0)
+        LOGERR("sky pixel {} of ({}, {}, {}) instead of the background", x,
+               color.x, color.y, color.z);
+    }
+  }
+
+  // the wavefront stages and the tiled paths trace the same rays
+  std::vector<Sphere> spheres = {Sphere({0, -1000, 0}, 995, 0)};
+  for (uint i = 0; i < 100; i++) {
+    glm::vec3 center(random_float(-8, 8), random_float(-5, 3),
+                     random_float(-4, 4));
+    spheres.push_back(Sphere(center, random_float(0.3, 1.5), i % 4));
+  }
+  Scene scene{Camera(),
+              std::make_unique<BvhAccStruct<Sphere>>(std::move(spheres))};
+  scene.materials = {Material::diffuse({0.8f, 0.8f, 0.2f, 1}),
+                     Material::metal({0.7f, 0.6f, 0.5f, 1}, 0.1f),
+                     Material::dielectric(1.5f),
+                     Material::light({4, 4, 4, 0})};
+  scene.background = GradientBackground(WHITE, {0.5f, 0.7f, 1, 1});
+
+  PathTracingCPURenderer tiled(160, 90);
+  tiled.set_spp(2);
+  tiled.set_thread_count(4);
+  tiled.render(scene);
+
+  PathTracingCPURenderer wavefront(160, 90);
+  wavefront.set_spp(2);
+  wavefront.set_wavefront_size(5000);
+  wavefront.set_thread_count(4);
+  wavefront.render(scene);
+
+  auto expected = tiled.get_img_buff().get_data();
+  auto result = wavefront.get_img_buff().get_data();
+  if (!std::equal(expected.begin(), expected.end(), result.begin(),
+                  result.end()))
+    LOGERR("wavefront path tracing differs from the tiled one");
+  if (tiled.get_ray_count() != wavefront.get_ray_count() ||
+      tiled.get_ray_count() <= 2 * 160 * 90)
+    LOGERR("{} rays traced in tiles, {} in wavefront", tiled.get_ray_count(),
+           wavefront.get_ray_count());
+
+  // a packet size doesn't turn the path tracer into an emission renderer
+  PathTracingCPURenderer packets(160, 90);
+  packets.set_spp(2);
+  packets.set_packet_size(4);
+  packets.set_thread_count(4);
+  packets.render(scene);
+  if (!std::ranges::equal(packets.get_img_buff().get_data(), expected))
+    LOGERR("path tracing with packets differs from the tiled one");
+
+  LOGOK("path_tracing");
+}
+
+// Path traced 48x27 image at 128 spp : its summed luminance, and the summed
+// relative error of its pixels
+static float render_luminance(const Scene &scene, bool next_event_estimation,
+                              float *error) {
+  PathTracingCPURenderer renderer(48, 27);
+  renderer.set_options({.nextEventEstimation = next_event_estimation});
+  renderer.set_spp(128);
+  renderer.set_thread_count(4);
+  renderer.render(scene);
+
+  const AccumulationBuffer &accumulation = renderer.get_accumulation();
+  float sum = 0;
+  *error = 0;
+  for (size_t y = 0; y < 27; y++)
+    for (size_t x = 0; x < 48; x++) {
+      sum += luminance(accumulation.get_mean(x, y));
+      *error += accumulation.get_error(x, y);
+    }
+  return sum;
+}
+
+void test_light_bvh(VulkanContext &ctx) {
+  // the picking probabilities of every light sum to 1, as seen by pick
+  std::vector<SphereLight> lights;
+  for (uint i = 0; i < 2000; i++)
+    lights.push_back({glm::vec3(random_float(-50, 50), random_float(-50, 50),
+                                random_float(-50, 50)),
+                      random_float(0.1, 1),
+                      Color(random_float(0, 10), random_float(0, 10),
+                            random_float(0, 10), 0)});
+  LightBvh light_bvh(std::move(lights));
+
+  for (uint i = 0; i < 20; i++) {
+    glm::vec3 p(random_float(-60, 60), random_float(-60, 60),
+                random_float(-60, 60));
+    glm::vec3 n = glm::normalize(glm::vec3(
+        random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+    double sum = 0;
+    for (uint32_t light = 0; light < light_bvh.size(); light++)
+      sum += light_bvh.pmf(p, n, light);
+    auto picked = light_bvh.pick(p, n, random_float());
+    if (std::abs(sum - 1) > 1e-3 || !picked ||
+        std::abs(picked->second - light_bvh.pmf(p, n, picked->first)) >
+            1e-6f * picked->second)
+      LOGERR("light pmf sum to {}, picked light pmf {} / {}", sum,
+             picked ? picked->second : 0,
+             picked ? light_bvh.pmf(p, n, picked->first) : 0);
+  }
+
+  // next event estimation converges to the same image, with less noise
+  std::vector<Sphere> spheres = {Sphere({0, -1005, 0}, 1000, 0)};
+  for (uint i = 0; i < 40; i++) {
+    glm::vec3 center(random_float(-8, 8), random_float(-4, 4),
+                     random_float(-4, 4));
+    spheres.push_back(Sphere(center, random_float(0.2, 0.6), i % 2));
+  }
+  Scene scene{Camera(), nullptr};
+  scene.materials = {Material::diffuse({0.7f, 0.7f, 0.7f, 1}),
+                     Material::light({6, 5, 4, 0})};
+  scene.lights = std::make_unique<LightBvh>(
+      LightBvh::from_spheres(spheres, scene.materials));
+  scene._accStruct =
+      std::make_unique<BvhAccStruct<Sphere>>(std::move(spheres));
+  if (scene.lights->size() != 20)
+    LOGERR("{} lights found instead of 20", scene.lights->size());
+
+  float nee_error, bsdf_error;
+  float nee = render_luminance(scene, true, &nee_error);
+  float bsdf = render_luminance(scene, false, &bsdf_error);
+  if (std::abs(nee - bsdf) > 0.03f * bsdf || nee_error >= bsdf_error)
+    LOGERR("next event estimation gives {} (error {}), bsdf sampling {} "
+           "(error {})",
+           nee, nee_error, bsdf, bsdf_error);
+
+  // an emissive mesh is not in the LightBvh : its emission is still counted
+  // by the diffuse bounces, next event estimation gives the same image
+  auto quad = [](float y, float size, uint32_t material) {
+    auto mesh = std::make_shared<TriangleMesh>(
+        std::vector<glm::vec3>{{-size, y, -size},
+                               {size, y, -size},
+                               {size, y, size},
+                               {-size, y, size}},
+        std::vector<TriangleMesh::Triangle>{{0, 1, 2}, {0, 2, 3}});
+    mesh->set_material(material);
+    return MeshInstance(mesh);
+  };
+  Scene mesh_scene{Camera(), nullptr};
+  mesh_scene.materials = scene.materials;
+  mesh_scene.lights = std::make_unique<LightBvh>(
+      LightBvh::from_spheres({}, mesh_scene.materials));
+  mesh_scene._accStruct = std::make_unique<InstanceBvh>(
+      std::vector<MeshInstance>{quad(-3, 20, 0), quad(4, 1.5f, 1)});
+
+  nee = render_luminance(mesh_scene, true, &nee_error);
+  bsdf = render_luminance(mesh_scene, false, &bsdf_error);
+  if (std::abs(nee - bsdf) > 0.03f * bsdf)
+    LOGERR("with an emissive mesh, next event estimation gives {}, bsdf "
+           "sampling {}",
+           nee, bsdf);
+
+  LOGOK("light_bvh");
+}
+
+void test_environment_map(VulkanContext &ctx) {
+  // alias table frequencies follow the weights
+  std::vector<float> weights = {1, 2, 3, 4, 0};
+  AliasTable table(weights);
+  std::array<size_t, 5> counts = {};
+  constexpr size_t DRAWS = 100000;
+  for (size_t i = 0; i < DRAWS; i++)
+    counts[table.sample((static_cast<float>(i) + 0.5f) / DRAWS)]++;
+  for (uint32_t i = 0; i < 5; i++)
+    if (std::abs(static_cast<float>(counts[i]) / DRAWS - table.pmf(i)) >
+        1e-3f)
+      LOGERR("alias table drew {} {} times for a pmf of {}", i, counts[i],
+             table.pmf(i));
+
+  // dim sky with a small and bright sun
+  constexpr size_t WIDTH = 64, HEIGHT = 32;
+  std::vector<Color> texels(WIDTH * HEIGHT);
+  for (size_t y = 0; y < HEIGHT; y++)
+    for (size_t x = 0; x < WIDTH; x++) {
+      bool sun = x >= 20 && x < 23 && y >= 8 && y < 10;
+      float sky = 0.1f + 0.3f * static_cast<float>(y) / HEIGHT;
+      texels[y * WIDTH + x] =
+          sun ? Color(80, 70, 60, 1) : Color(sky, sky, sky, 1);
+    }
+  EnvironmentMap environment(WIDTH, HEIGHT, std::vector<Color>(texels));
+
+  // bilinear : exact on the texel centers, continuous across the u seam
+  glm::vec2 center = {5.5f / WIDTH, 7.5f / HEIGHT};
+  glm::vec2 seam_left = {0, 0.4f}, seam_right = {1, 0.4f};
+  if (environment.lookup(center) != texels[7 * WIDTH + 5] ||
+      glm::length(environment.lookup(seam_left) -
+                  environment.lookup(seam_right)) > 1e-5f)
+    LOGERR("wrong bilinear environment lookup");
+
+  // sample pdf matches pdf(), which integrates to 1 over the sphere
+  for (uint i = 0; i < 1000; i++) {
+    auto sample = environment.sample(random_float(),
+                                     {random_float(), random_float()});
+    if (!sample ||
+        std::abs(sample->pdf - environment.pdf(sample->direction)) >
+            1e-3f * sample->pdf)
+      LOGERR("environment sample pdf {} differs from pdf() {}",
+             sample ? sample->pdf : 0,
+             sample ? environment.pdf(sample->direction) : 0);
+  }
+  double integral = 0;
+  constexpr size_t GRID = 1000;
+  for (size_t i = 0; i < GRID; i++)
+    for (size_t j = 0; j < GRID; j++)
+      integral += environment.pdf(
+          sample_unit_sphere({(i + 0.5f) / GRID, (j + 0.5f) / GRID}));
+  integral *= 4 * M_PI / (GRID * GRID);
+  if (std::abs(integral - 1) > 0.01)
+    LOGERR("environment pdf integrates to {}", integral);
+
+  // Half white, half black map : the bilinear blend spreads radiance over
+  // the black texels of the boundaries, they keep a non zero pdf. The
+  // importance sampled integral matches the uniform one (the furnace).
+  constexpr size_t EDGE_WIDTH = 16, EDGE_HEIGHT = 8;
+  std::vector<Color> edge_texels(EDGE_WIDTH * EDGE_HEIGHT);
+  for (size_t i = 0; i < edge_texels.size(); i++)
+    edge_texels[i] = i % EDGE_WIDTH < EDGE_WIDTH / 2 ? Color(1) : Color(0);
+  EnvironmentMap edge(EDGE_WIDTH, EDGE_HEIGHT, std::move(edge_texels));
+
+  constexpr size_t EDGE_SAMPLES = 1000000;
+  double uniform = 0, importance = 0;
+  for (size_t i = 0; i < EDGE_SAMPLES; i++) {
+    glm::vec3 direction =
+        sample_unit_sphere({random_float(), random_float()});
+    float radiance = luminance(edge.get_value({glm::vec3(0), direction}));
+    if (radiance > 0 && edge.pdf(direction) <= 0)
+      LOGERR("direction of radiance {} with a zero pdf", radiance);
+    uniform += radiance * 4 * M_PI;
+
+    auto sample = edge.sample(random_float(), {random_float(), random_float()});
+    if (sample)
+      importance += luminance(sample->radiance) / sample->pdf;
+  }
+  uniform /= EDGE_SAMPLES;
+  importance /= EDGE_SAMPLES;
+  if (std::abs(importance - uniform) > 0.01 * uniform)
+    LOGERR("environment integral of {} by importance, {} uniform",
+           importance, uniform);
+
+  // next event estimation on the map converges to the same image
+  std::vector<Sphere> spheres = {Sphere({0, -1004, 0}, 1000, 0),
+                                 Sphere({-3, 0, 0}, 2, 0),
+                                 Sphere({3, 0, 0}, 2, 1)};
+  Scene scene{Camera(),
+              std::make_unique<BvhAccStruct<Sphere>>(std::move(spheres))};
+  scene.materials = {Material::diffuse({0.7f, 0.7f, 0.7f, 1}),
+                     Material::metal({0.8f, 0.8f, 0.8f, 1}, 0.2f)};
+  scene.background = std::move(environment);
+
+  float nee_error, bsdf_error;
+  float nee = render_luminance(scene, true, &nee_error);
+  float bsdf = render_luminance(scene, false, &bsdf_error);
+  if (std::abs(nee - bsdf) > 0.03f * bsdf || nee_error >= bsdf_error)
+    LOGERR("environment sampling gives {} (error {}), bsdf sampling {} "
+           "(error {})",
+           nee, nee_error, bsdf, bsdf_error);
+
+  // an emissive sphere out of any LightBvh : only the map is sampled, the
+  // diffuse bounces still gather the sphere emission
+  spheres = {Sphere({0, -1004, 0}, 1000, 0), Sphere({0, 1, 2}, 1.5f, 1)};
+  Scene lit{Camera(),
+            std::make_unique<BvhAccStruct<Sphere>>(std::move(spheres))};
+  lit.materials = {Material::diffuse({0.7f, 0.7f, 0.7f, 1}),
+                   Material::light({20, 20, 20, 0})};
+  lit.background = EnvironmentMap(WIDTH, HEIGHT, std::move(texels));
+  nee = render_luminance(lit, true, &nee_error);
+  bsdf = render_luminance(lit, false, &bsdf_error);
+  if (std::abs(nee - bsdf) > 0.03f * bsdf)
+    LOGERR("environment sampling next to an unsampled light gives {}, bsdf "
+           "sampling {}",
+           nee, bsdf);
+
+  LOGOK("environment_map");
+}
+
+void test_hdr_image(VulkanContext &ctx) {
+  // half conversions : rounding, range limits, subnormals
+  std::vector<std::pair<float, uint16_t>> halves = {
+      {1, 0x3c00},     {-2, 0xc000},       {1.f / 3, 0x3555},
+      {65504, 0x7bff}, {65520, 0x7c00},    {0x1p-24f, 0x0001},
+      {0x1p-26f, 0},   {INFINITY, 0x7c00}, {0x1p-14f, 0x0400}};
+  for (auto [value, half] : halves)
+    if (float_to_half(value) != half)
+      LOGERR("{} converts to half {:#06x}, expected {:#06x}", value,
+             float_to_half(value), half);
+  for (float value : {1.f, -2.f, 65504.f, 0x1p-24f, 0x1p-14f, INFINITY})
+    if (half_to_float(float_to_half(value)) != value)
+      LOGERR("{} changed by the half round trip", value);
+  if (!std::isnan(half_to_float(float_to_half(NAN))))
+    LOGERR("NaN lost by the half conversion");
+
+  // float storages keep the values out of [0, 1]
+  constexpr size_t WIDTH = 13, HEIGHT = 7;
+  auto pixel = [](size_t x, size_t y) {
+    return Color(static_cast<float>(x) * 10.5f, -static_cast<float>(y),
+                 0.25f + static_cast<float>(x * y), 1);
+  };
+  ImageBuffer full(WIDTH, HEIGHT, RGBA32F);
+  ImageBuffer half(WIDTH, HEIGHT, RGBA16F);
+  for (size_t y = 0; y < HEIGHT; y++)
+    for (size_t x = 0; x < WIDTH; x++) {
+      full.write_pixel(x, y, pixel(x, y));
+      half.write_pixel(x, y, pixel(x, y));
+    }
+  for (size_t y = 0; y < HEIGHT; y++)
+    for (size_t x = 0; x < WIDTH; x++) {
+      Color expected = pixel(x, y);
+      Color half_error = glm::abs(half.read_pixel(x, y) - expected);
+      bool half_ok = true;
+      for (int c = 0; c < 4; c++)
+        half_ok &= half_error[c] <= std::abs(expected[c]) * 1e-3f;
+      if (full.read_pixel(x, y) != expected || !half_ok)
+        LOGERR("HDR storage changed the pixel {} {}", x, y);
+    }
+
+  // .pfm round trip : exact, rows written bottom first
+  TempDirectory directory("rtvk_test_hdr_image");
+  std::string pfm_path = directory.file("hdr_test.pfm");
+  if (!full.write_on_disk(pfm_path.c_str(), PFM))
+    LOGERR("could not write {}", pfm_path);
+  std::FILE *file = std::fopen(pfm_path.c_str(), "rb");
+  char header[3] = {};
+  size_t width = 0, height = 0;
+  float scale = 0;
+  if (!file ||
+      std::fscanf(file, "%2s %zu %zu %f", header, &width, &height, &scale) !=
+          4 ||
+      std::fgetc(file) != '\n' || std::string(header) != "PF" ||
+      width != WIDTH || height != HEIGHT || scale >= 0)
+    LOGERR("wrong pfm header");
+  std::vector<float> pfm(WIDTH * HEIGHT * 3);
+  if (std::fread(pfm.data(), sizeof(float), pfm.size(), file) != pfm.size())
+    LOGERR("truncated pfm data");
+  std::fclose(file);
+  for (size_t y = 0; y < HEIGHT; y++)
+    for (size_t x = 0; x < WIDTH; x++) {
+      const float *rgb = &pfm[((HEIGHT - 1 - y) * WIDTH + x) * 3];
+      if (glm::vec3(rgb[0], rgb[1], rgb[2]) != glm::vec3(pixel(x, y)))
+        LOGERR("pfm pixel {} {} differs", x, y);
+    }
+
+  // .hdr round trip : RGBE keeps 8 bits of mantissa, negatives clamp to 0
+  std::string hdr_path = directory.file("hdr_test.hdr");
+  if (!half.write_on_disk(hdr_path.c_str(), HDR))
+    LOGERR("could not write {}", hdr_path);
+  int iwidth, iheight, channels;
+  float *hdr =
+      stbi_loadf(hdr_path.c_str(), &iwidth, &iheight, &channels, 3);
+  if (!hdr || iwidth != WIDTH || iheight != HEIGHT)
+    LOGERR("could not read back {}", hdr_path);
+  for (size_t y = 0; y < HEIGHT; y++)
+    for (size_t x = 0; x < WIDTH; x++) {
+      glm::vec3 expected = glm::max(glm::vec3(pixel(x, y)), glm::vec3(0));
+      const float *rgb = &hdr[(y * WIDTH + x) * 3];
+      float max = std::max({expected.x, expected.y, expected.z});
+      if (glm::length(glm::vec3(rgb[0], rgb[1], rgb[2]) - expected) >
+          max * 2e-2f)
+        LOGERR("hdr pixel {} {} differs", x, y);
+    }
+  stbi_image_free(hdr);
+
+  // 8 bits writers take the clamped values
+  std::string png_path = directory.file("hdr_test.png");
+  if (!full.write_on_disk(png_path.c_str(), PNG))
+    LOGERR("could not write {} from float data", png_path);
+
+  LOGOK("hdr_image");
+}
+
+void test_bulk_write(VulkanContext &ctx) {
+  // odd sizes for the SIMD tails, special values in every channel
+  constexpr size_t WIDTH = 67, HEIGHT = 13;
+  std::vector<float> specials = {NAN, -INFINITY, INFINITY, -0.f, -1e-8f,
+                                 1.f,  1.0001f,   65520,    0x1p-20f};
+  std::vector<Color> colors(WIDTH * HEIGHT);
+  for (size_t i = 0; i < colors.size(); i++)
+    for (int c = 0; c < 4; c++)
+      colors[i][c] = i % 7 == 0 ? specials[(i / 7 + c) % specials.size()]
+                                : random_float(-0.5f, 1.5f);
+
+  for (ImgFormat format : {RGBA, RGB, R, RGBA16F, RGBA32F}) {
+    ImageBuffer pixels(WIDTH, HEIGHT, format);
+    ImageBuffer rows(WIDTH, HEIGHT, format);
+    ImageBuffer tiles(WIDTH, HEIGHT, format);
+    ImageBuffer frame(WIDTH, HEIGHT, format);
+    for (size_t y = 0; y < HEIGHT; y++) {
+      for (size_t x = 0; x < WIDTH; x++)
+        pixels.write_pixel(x, y, colors[y * WIDTH + x]);
+      rows.write_row(0, y, std::span(colors).subspan(y * WIDTH, WIDTH));
+    }
+    // 16x5 tiles, copied out of the frame
+    for (size_t y0 = 0; y0 < HEIGHT; y0 += 5)
+      for (size_t x0 = 0; x0 < WIDTH; x0 += 16) {
+        size_t tile_width = std::min<size_t>(16, WIDTH - x0);
+        std::vector<Color> tile;
+        for (size_t y = y0; y < std::min<size_t>(y0 + 5, HEIGHT); y++)
+          for (size_t x = x0; x < x0 + tile_width; x++)
+            tile.push_back(colors[y * WIDTH + x]);
+        tiles.write_tile(x0, y0, tile_width, tile);
+      }
+    frame.write_tile(0, 0, WIDTH, colors);
+
+    auto expected = pixels.get_data();
+    for (const ImageBuffer *image : {&rows, &tiles, &frame})
+      if (!std::ranges::equal(image->get_data(), expected))
+        LOGERR("bulk write differs from write_pixel in format {}",
+               static_cast<int>(format));
+  }
+
+  LOGOK("bulk_write");
+}
+
+void test_image_writer(VulkanContext &ctx) {
+  constexpr size_t FRAMES = 12, WIDTH = 97, HEIGHT = 61;
+  auto frame_color = [](size_t frame, size_t x, size_t y) {
+    return Color(static_cast<float>(frame) / FRAMES,
+                 static_cast<float>(x) / WIDTH,
+                 static_cast<float>(y) / HEIGHT, 1);
+  };
+  TempDirectory directory("rtvk_test_image_writer");
+  auto frame_path = [&](size_t frame) {
+    return directory.file(fmt::format("frame_{}.png", frame).c_str());
+  };
+  std::string last_path = directory.file("last.png");
+
+  std::vector<uint8_t> expected;
+  {
+    ImageWriter writer({.threadCount = 2, .maxQueued = 2});
+    for (size_t frame = 0; frame < FRAMES; frame++) {
+      ImageBuffer image(WIDTH, HEIGHT, RGBA);
+      for (size_t y = 0; y < HEIGHT; y++)
+        for (size_t x = 0; x < WIDTH; x++)
+          image.write_pixel(x, y, frame_color(frame, x, y));
+      if (frame == FRAMES - 1) {
+        auto data = image.get_data();
+        expected.assign(data.begin(), data.end());
+      }
+      writer.write(std::move(image), frame_path(frame), PNG);
+      if (writer.get_queued_count() > 2)
+        LOGERR("{} images queued past the limit of 2",
+               writer.get_queued_count());
+    }
+    writer.flush();
+    if (writer.get_written_count() != FRAMES || writer.get_queued_count() != 0)
+      LOGERR("{} images written out of {}", writer.get_written_count(),
+             FRAMES);
+
+    // a failed write is counted, the writer goes on
+    writer.write(ImageBuffer(4, 4), directory.file("missing/image.png"),
+                 PNG);
+    writer.flush();
+    if (writer.get_failed_count() != 1)
+      LOGERR("{} failed writes counted instead of 1",
+             writer.get_failed_count());
+    writer.write(ImageBuffer(4, 4), last_path, PNG);
+  } // the destructor writes the queued images
+  if (!std::filesystem::exists(last_path))
+    LOGERR("queued image lost on destruction");
+
+  int width, height, channels;
+  stbi_uc *data = stbi_load(frame_path(FRAMES - 1).c_str(), &width, &height,
+                            &channels, 4);
+  if (!data || width != WIDTH || height != HEIGHT ||
+      !std::equal(expected.begin(), expected.end(), data))
+    LOGERR("written image differs");
+  stbi_image_free(data);
+
+  LOGOK("image_writer");
+}
+
+// Chunks crc and zlib adler32 of a png, which stb_image doesn't check : the
+// IDAT data is inflated by stb and its adler32 compared to the stored one.
+// Empty if they are right, else the first wrong one.
+static std::string png_checksum_error(std::span<const uint8_t> png,
+                                      size_t raw_size) {
+  // big endian, as every png and zlib field
+  auto read_u32 = [](std::span<const uint8_t> data, size_t offset) {
+    return static_cast<uint32_t>(data[offset]) << 24 |
+           static_cast<uint32_t>(data[offset + 1]) << 16 |
+           static_cast<uint32_t>(data[offset + 2]) << 8 |
+           static_cast<uint32_t>(data[offset + 3]);
+  };
+
+  std::vector<uint8_t> zlib;
+  size_t offset = 8; // signature
+  while (offset + 12 <= png.size()) {
+    size_t length = read_u32(png, offset);
+    if (offset + 12 + length > png.size())
+      return "truncated chunk";
+    std::span<const uint8_t> type_and_data = png.subspan(offset + 4,
+                                                         4 + length);
+    std::string type(type_and_data.begin(), type_and_data.begin() + 4);
+    if (crc32(type_and_data) != read_u32(png, offset + 8 + length))
+      return "wrong " + type + " crc";
+    if (type == "IDAT")
+      zlib.insert(zlib.end(), type_and_data.begin() + 4, type_and_data.end());
+    offset += 12 + length;
+  }
+  if (offset != png.size() || zlib.size() < 6)
+    return "no IDAT or trailing bytes";
+
+  int raw_length = 0;
+  char *raw = stbi_zlib_decode_malloc_guesssize_headerflag(
+      reinterpret_cast<const char *>(zlib.data()),
+      static_cast<int>(zlib.size()), static_cast<int>(raw_size), &raw_length,
+      1);
+  if (!raw || static_cast<size_t>(raw_length) != raw_size) {
+    stbi_image_free(raw);
+    return "wrong zlib stream";
+  }
+  uint32_t adler = adler32(std::span(reinterpret_cast<const uint8_t *>(raw),
+                                     raw_size));
+  stbi_image_free(raw);
+  if (adler != read_u32(zlib, zlib.size() - 4))
+    return "wrong adler32";
+  return {};
+}
+
+void test_png_encoder(VulkanContext &ctx) {
+  // checksums, and the adler32 of stitched stripes
+  std::string check = "123456789";
+  std::span<const uint8_t> bytes(
+      reinterpret_cast<const uint8_t *>(check.data()), check.size());
+  std::string_view wikipedia = "Wikipedia";
+  if (crc32(bytes) != 0xcbf43926 ||
+      adler32(std::span(reinterpret_cast<const uint8_t *>(wikipedia.data()),
+                        wikipedia.size())) != 0x11e60398 ||
+      adler32_combine(adler32(bytes.first(4)), adler32(bytes.subspan(4)), 5) !=
+          adler32(bytes))
+    LOGERR("wrong png checksums");
+
+  // flat areas, gradients and noise, over several stripes for the biggest
+  ThreadPool pool(4);
+  std::vector<std::pair<size_t, size_t>> sizes = {
+      {1, 1}, {37, 19}, {1500, 900}};
+  for (auto [width, height] : sizes)
+    for (size_t channels = 1; channels <= 4; channels++) {
+      std::vector<uint8_t> pixels(width * height * channels);
+      for (size_t y = 0; y < height; y++)
+        for (size_t x = 0; x < width; x++)
+          for (size_t c = 0; c < channels; c++) {
+            uint8_t value = x < width / 3    ? 200
+                            : x < width / 2 ? static_cast<uint8_t>(x + y * c)
+                                            : pcg_hash(x ^ (y << 16)) >> 24;
+            pixels[(y * width + x) * channels + c] = value;
+          }
+
+      std::vector<uint8_t> serial = encode_png(pixels, width, height, channels);
+      std::vector<uint8_t> parallel =
+          encode_png(pixels, width, height, channels, &pool);
+      if (serial != parallel)
+        LOGERR("{}x{} png of {} channels depends on the pool", width, height,
+               channels);
+      std::string error =
+          png_checksum_error(parallel, height * (1 + width * channels));
+      if (!error.empty())
+        LOGERR("{}x{} png of {} channels : {}", width, height, channels,
+               error);
+
+      int iwidth, iheight, ichannels;
+      stbi_uc *decoded = stbi_load_from_memory(
+          parallel.data(), static_cast<int>(parallel.size()), &iwidth,
+          &iheight, &ichannels, static_cast<int>(channels));
+      if (!decoded || iwidth != static_cast<int>(width) ||
+          iheight != static_cast<int>(height) ||
+          ichannels != static_cast<int>(channels) ||
+          !std::equal(pixels.begin(), pixels.end(), decoded))
+        LOGERR("{}x{} png of {} channels decodes wrong", width, height,
+               channels);
+      stbi_image_free(decoded);
+    }
+
+  LOGOK("png_encoder");
+}
+
+void test_tiled_framebuffer(VulkanContext &ctx) {
+  // edge tiles clipped on both axes, tiles written out of order
+  constexpr size_t WIDTH = 301, HEIGHT = 203;
+  auto color = [](size_t x, size_t y) {
+    return Color(static_cast<float>(x) / WIDTH, static_cast<float>(y) / HEIGHT,
+                 (pcg_hash(static_cast<uint32_t>(x ^ (y << 16))) >> 8) *
+                     0x1p-24f * 4.f,
+                 1);
+  };
+
+  // the scratch file is anonymous, it leaves the directory empty
+  TempDirectory directory("rtvk_tiled_framebuffer");
+  TempDirectory scratch("rtvk_tiled_scratch");
+  for (ImgFormat format : {RGBA, RGBA16F}) {
+    std::optional<TiledFramebuffer> framebuffer =
+        TiledFramebuffer::create(scratch.path, WIDTH, HEIGHT, format, 100);
+    if (!framebuffer || framebuffer->get_tile_size() != 128 ||
+        framebuffer->get_tiles_x() != 3 || framebuffer->get_tiles_y() != 2)
+      LOGERR("tiled framebuffer not created as expected");
+    if (!std::filesystem::is_empty(scratch.path))
+      LOGERR("scratch file left in {}", scratch.path.string());
+
+    ImageBuffer expected(WIDTH, HEIGHT, format);
+    std::vector<std::pair<size_t, size_t>> tiles;
+    for (size_t ty = 0; ty < framebuffer->get_tiles_y(); ty++)
+      for (size_t tx = 0; tx < framebuffer->get_tiles_x(); tx++)
+        tiles.push_back({tx, ty});
+    std::swap(tiles.front(), tiles.back());
+    std::swap(tiles[1], tiles[3]);
+    for (auto [tx, ty] : tiles) {
+      size_t tile_width = framebuffer->get_tile_width(tx);
+      size_t tile_height = framebuffer->get_tile_height(ty);
+      size_t x0 = tx * framebuffer->get_tile_size();
+      size_t y0 = ty * framebuffer->get_tile_size();
+      std::vector<Color> colors;
+      for (size_t y = 0; y < tile_height; y++)
+        for (size_t x = 0; x < tile_width; x++)
+          colors.push_back(color(x0 + x, y0 + y));
+      framebuffer->write_tile(tx, ty, colors);
+      expected.write_tile(x0, y0, tile_width, colors);
+    }
+
+    size_t row_bytes = WIDTH * format_size(format);
+    size_t next_row = 0;
+    framebuffer->for_each_row([&](size_t y, std::span<const uint8_t> row) {
+      auto data = expected.get_data().subspan(y * row_bytes, row_bytes);
+      if (y != next_row++ || !std::equal(row.begin(), row.end(), data.begin(),
+                                         data.end()))
+        LOGERR("tiled framebuffer row {} differs", y);
+    });
+    if (next_row != HEIGHT)
+      LOGERR("{} rows streamed out of {}", next_row, HEIGHT);
+
+    // the streamed png is the one of the whole image
+    std::string tiled_png = directory.file("tiled.png");
+    std::string expected_png = directory.file("expected.png");
+    if (!framebuffer->write_png(tiled_png.c_str()) ||
+        expected.write_on_disk(expected_png.c_str(), PNG) == 0 ||
+        read_file(tiled_png) != read_file(expected_png))
+      LOGERR("streamed png of format {} differs", static_cast<int>(format));
+  }
+
+  // several stripes streamed by uneven batches of rows
+  constexpr size_t PNG_WIDTH = 1000, PNG_HEIGHT = 700;
+  std::vector<uint8_t> pixels(PNG_WIDTH * PNG_HEIGHT * 3);
+  for (size_t i = 0; i < pixels.size(); i++)
+    pixels[i] = i % 7 ? static_cast<uint8_t>(i / 3000)
+                      : pcg_hash(static_cast<uint32_t>(i)) >> 24;
+  std::string stream_png = directory.file("stream.png");
+  std::optional<PngStreamWriter> writer =
+      PngStreamWriter::open(stream_png.c_str(), PNG_WIDTH, PNG_HEIGHT, 3);
+  if (!writer)
+    LOGERR("png stream not opened");
+  for (size_t y = 0; y < PNG_HEIGHT;) {
+    size_t rows = std::min<size_t>(1 + y % 37, PNG_HEIGHT - y);
+    writer->write_rows(std::span<const uint8_t>(pixels).subspan(
+        y * PNG_WIDTH * 3, rows * PNG_WIDTH * 3));
+    y += rows;
+  }
+  if (!writer->close() ||
+      read_file(stream_png) != encode_png(pixels, PNG_WIDTH, PNG_HEIGHT, 3))
+    LOGERR("streamed png differs from encode_png");
+
+  LOGOK("tiled_framebuffer");
+}
+
+void test_pixel_layout(VulkanContext &ctx) {
+  // space filling curves
+  for (uint32_t y = 0; y < 64; y++)
+    for (uint32_t x = 0; x < 64; x++)
+      if (morton_decode(morton_encode(x, y)) != std::pair(x, y))
+        LOGERR("morton code of ({}, {}) doesn't decode back", x, y);
+  constexpr uint32_t CURVE_SIZE = 16;
+  std::vector<bool> visited(CURVE_SIZE * CURVE_SIZE);
+  for (uint32_t d = 0; d < CURVE_SIZE * CURVE_SIZE; d++) {
+    auto [x, y] = hilbert_decode(CURVE_SIZE, d);
+    auto [px, py] = hilbert_decode(CURVE_SIZE, d == 0 ? 0 : d - 1);
+    uint32_t step = (x > px ? x - px : px - x) + (y > py ? y - py : py - y);
+    if (visited[y * CURVE_SIZE + x] || (d != 0 && step != 1) ||
+        hilbert_encode(CURVE_SIZE, x, y) != d)
+      LOGERR("hilbert curve broken at {}", d);
+    visited[y * CURVE_SIZE + x] = true;
+  }
+
+  // every write path, with partial tiles on both axes
+  constexpr size_t WIDTH = 67, HEIGHT = 13;
+  std::vector<Color> colors(WIDTH * HEIGHT);
+  for (size_t i = 0; i < colors.size(); i++)
+    colors[i] = Color(random_float(0, 1), random_float(0, 1),
+                      random_float(0, 2), 1);
+  TempDirectory directory("rtvk_test_pixel_layout");
+  std::string linear_png = directory.file("linear.png");
+  std::string layout_png = directory.file("layout.png");
+  for (PixelLayout layout : {PixelLayout::Tiled, PixelLayout::Morton})
+    for (ImgFormat format : {RGBA, RGB, RGBA16F}) {
+      ImageBuffer linear(WIDTH, HEIGHT, format);
+      ImageBuffer pixels(WIDTH, HEIGHT, format, layout);
+      ImageBuffer rows(WIDTH, HEIGHT, format, layout);
+      ImageBuffer frame(WIDTH, HEIGHT, format, layout);
+      for (size_t y = 0; y < HEIGHT; y++) {
+        for (size_t x = 0; x < WIDTH; x++) {
+          linear.write_pixel(x, y, colors[y * WIDTH + x]);
+          pixels.write_pixel(x, y, colors[y * WIDTH + x]);
+        }
+        // unaligned runs
+        std::span<const Color> row = std::span(colors).subspan(y * WIDTH,
+                                                               WIDTH);
+        rows.write_row(0, y, row.first(5));
+        rows.write_row(5, y, row.subspan(5));
+      }
+      frame.write_tile(0, 0, WIDTH, colors);
+
+      auto expected = linear.get_data();
+      for (const ImageBuffer *image : {&pixels, &rows, &frame})
+        if (!std::ranges::equal(image->to_linear(), expected) ||
+            image->read_pixel(66, 12) != linear.read_pixel(66, 12))
+          LOGERR("layout {} differs from the linear one in format {}",
+                 static_cast<int>(layout), static_cast<int>(format));
+      if (!linear.write_on_disk(linear_png.c_str(), PNG) ||
+          !rows.write_on_disk(layout_png.c_str(), PNG) ||
+          read_file(linear_png) != read_file(layout_png))
+        LOGERR("png of layout {} differs", static_cast<int>(layout));
+    }
+
+  // every traversal on every layout renders the same image, render tiles
+  // on the storage tiles or not
+  std::vector<Sphere> spheres;
+  for (uint i = 0; i < 20; i++)
+    spheres.push_back(Sphere(glm::vec3(i * i, 0, 0), i + 1));
+  Scene scene{Camera(),
+              std::make_unique<HittableVector<Sphere>>(std::move(spheres))};
+  SimpleCPURenderer reference(301, 157);
+  reference.render(scene);
+  auto expected = reference.get_img_buff().get_data();
+
+  for (PixelLayout layout :
+       {PixelLayout::Linear, PixelLayout::Tiled, PixelLayout::Morton})
+    for (TraversalOrder order : {TraversalOrder::Scanline,
+                                 TraversalOrder::Tile, TraversalOrder::Hilbert})
+      for (size_t packet_size : {0, 2, 4}) {
+        SimpleCPURenderer renderer(ImageBuffer(301, 157, RGBA, layout));
+        renderer.set_traversal_order(order);
+        renderer.set_packet_size(packet_size);
+        renderer.set_thread_count(4);
+        renderer.set_tile_size(packet_size == 4 ? 20 : 16);
+        renderer.render(scene);
+        if (!std::ranges::equal(renderer.get_img_buff().to_linear(), expected))
+          LOGERR("layout {}, order {}, packets {} render differs",
+                 static_cast<int>(layout), static_cast<int>(order),
+                 packet_size);
+      }
+
+  LOGOK("pixel_layout");
+}
+
+#endif
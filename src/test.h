@@ -12,6 +12,32 @@ void test_pipeline_build(VulkanContext &ctx);
 void test_shader_loading(VulkanContext& ctx);
 void test_compute_pipeline_build(VulkanContext &ctx);
 void test_acceleration_struct(VulkanContext& ctx);
+void test_parallel_render(VulkanContext &ctx);
+void test_bvh(VulkanContext &ctx);
+void test_wide_bvh(VulkanContext &ctx);
+void test_sphere_soa(VulkanContext &ctx);
+void test_bvh_builder(VulkanContext &ctx);
+void test_packet_render(VulkanContext &ctx);
+void test_wavefront_render(VulkanContext &ctx);
+void test_static_render(VulkanContext &ctx);
+void test_accumulation(VulkanContext &ctx);
+void test_adaptive_sampling(VulkanContext &ctx);
+void test_samplers(VulkanContext &ctx);
+void test_triangle_mesh(VulkanContext &ctx);
+void test_gltf_loader(VulkanContext &ctx);
+void test_instancing(VulkanContext &ctx);
+void test_mesh_cache(VulkanContext &ctx);
+void test_bvh_refit(VulkanContext &ctx);
+void test_occlusion(VulkanContext &ctx);
+void test_path_tracing(VulkanContext &ctx);
+void test_light_bvh(VulkanContext &ctx);
+void test_environment_map(VulkanContext &ctx);
+void test_hdr_image(VulkanContext &ctx);
+void test_bulk_write(VulkanContext &ctx);
+void test_image_writer(VulkanContext &ctx);
+void test_png_encoder(VulkanContext &ctx);
+void test_tiled_framebuffer(VulkanContext &ctx);
+void test_pixel_layout(VulkanContext &ctx);
 
 inline void test(VulkanContext &ctx) {
   LOG(1, "Testing...");
@@ -19,6 +45,32 @@ inline void test(VulkanContext &ctx) {
   test_shader_loading(ctx);
   test_pipeline_build(ctx);
   test_acceleration_struct(ctx);
+  test_parallel_render(ctx);
+  test_bvh(ctx);
+  test_wide_bvh(ctx);
+  test_sphere_soa(ctx);
+  test_bvh_builder(ctx);
+  test_packet_render(ctx);
+  test_wavefront_render(ctx);
+  test_static_render(ctx);
+  test_accumulation(ctx);
+  test_adaptive_sampling(ctx);
+  test_samplers(ctx);
+  test_triangle_mesh(ctx);
+  test_gltf_loader(ctx);
+  test_instancing(ctx);
+  test_mesh_cache(ctx);
+  test_bvh_refit(ctx);
+  test_occlusion(ctx);
+  test_path_tracing(ctx);
+  test_light_bvh(ctx);
+  test_environment_map(ctx);
+  test_hdr_image(ctx);
+  test_bulk_write(ctx);
+  test_image_writer(ctx);
+  test_png_encoder(ctx);
+  test_tiled_framebuffer(ctx);
+  test_pixel_layout(ctx);
 
   LOGOK("All test OK !");
 
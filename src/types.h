@@ -23,6 +23,7 @@
 // other
 #include <fmt/core.h>
 #include <utils/ansi_code.h>
+#include <utils/random.h>
 
 #define NVERBOSE 4
 
@@ -114,6 +115,11 @@ struct Interval {
 
   bool contains(float t) const { return min <= t && t <= max; }
   bool contains_open(float t) const { return min < t && t < max; }
+
+  float size() const { return max - min; }
+  Interval merge(Interval other) const {
+    return {std::min(min, other.min), std::max(max, other.max)};
+  }
 };
 
 inline constexpr Interval INTERVAL_REELS = {-INFINITY, INFINITY};
@@ -174,7 +180,7 @@ struct BBox {
       t_min = std::max(t_min, t0);
       t_max = std::min(t_max, t1);
 
-      if (t_min <= t_max)
+      if (t_max < t_min)
         return false;
     }
 
@@ -183,6 +189,47 @@ struct BBox {
     return true;
   }
 
+  // Slab test with a precomputed 1/direction, meant for traversal loops.
+  // Divisions by zero give infinities, NaN are dropped by the min/max order.
+  // The exit distance is pushed by the float error bound (2 gamma(3), see
+  // pbrt) so rays through a face or a corner shared by boxes always enter
+  // one of them, which the watertight triangle test relies on.
+  bool hit(glm::vec3 origin, glm::vec3 inv_dir, Interval ray_t,
+           float *t = nullptr) const {
+    constexpr float GAMMA_3 = 3 * 0x1p-24f / (1 - 3 * 0x1p-24f);
+    constexpr float ROBUST_FAR = 1 + 2 * GAMMA_3;
+    float t_min = ray_t.min;
+    float t_max = ray_t.max;
+
+    for (int axis = 0; axis < 3; axis++) {
+      const Interval &ax = axis_interval(axis);
+      float t0 = (ax.min - origin[axis]) * inv_dir[axis];
+      float t1 = (ax.max - origin[axis]) * inv_dir[axis];
+
+      t_min = std::max(t_min, std::min(t0, t1));
+      t_max = std::min(t_max, std::max(t0, t1) * ROBUST_FAR);
+    }
+
+    if (t)
+      *t = t_min;
+    return t_min <= t_max;
+  }
+
+  BBox merge(const BBox &other) const {
+    return {x.merge(other.x), y.merge(other.y), z.merge(other.z)};
+  }
+
+  glm::vec3 get_min() const { return {x.min, y.min, z.min}; }
+  glm::vec3 get_max() const { return {x.max, y.max, z.max}; }
+  glm::vec3 center() const { return (get_min() + get_max()) * 0.5f; }
+
+  float surface_area() const {
+    float dx = x.size(), dy = y.size(), dz = z.size();
+    if (dx < 0 || dy < 0 || dz < 0) // empty
+      return 0;
+    return 2.f * (dx * dy + dy * dz + dz * dx);
+  }
+
   VkAabbPositionsKHR to_vk() const {
     return VkAabbPositionsKHR{.minX = x.min,
                               .minY = y.min,
@@ -198,6 +245,51 @@ inline constexpr BBox BBOX_UNIVERSE = {INTERVAL_REELS, INTERVAL_REELS,
 inline constexpr BBox BBOX_EMPTY = {INTERVAL_EMPTY, INTERVAL_EMPTY,
                                     INTERVAL_EMPTY};
 
+// Four planes through a common origin, bounding a packet of rays
+struct Frustum {
+  glm::vec3 origin;
+  std::array<glm::vec3, 4> normals; // pointing inside
+
+  // corners : directions of the 4 extreme rays, in order around the packet
+  static Frustum from_corners(glm::vec3 origin,
+                              const std::array<glm::vec3, 4> &corners) {
+    glm::vec3 center = corners[0] + corners[1] + corners[2] + corners[3];
+    Frustum result{origin, {}};
+    for (size_t i = 0; i < 4; i++) {
+      glm::vec3 normal =
+          glm::normalize(glm::cross(corners[i], corners[(i + 1) % 4]));
+      result.normals[i] = glm::dot(normal, center) < 0 ? -normal : normal;
+    }
+    return result;
+  }
+
+  // Conservative : false only if the box is fully outside one of the planes
+  bool intersects(const BBox &bbox) const {
+    for (const glm::vec3 &normal : normals) {
+      glm::vec3 p_vertex = {normal.x >= 0 ? bbox.x.max : bbox.x.min,
+                            normal.y >= 0 ? bbox.y.max : bbox.y.min,
+                            normal.z >= 0 ? bbox.z.max : bbox.z.min};
+      glm::vec3 to_box = p_vertex - origin;
+      float dist = glm::dot(normal, to_box);
+      // small margin so boxes only touched by a corner ray are kept
+      if (dist < 0 && dist * dist > 1e-10f * glm::dot(to_box, to_box))
+        return false;
+    }
+    return true;
+  }
+};
+
+// Coherent rays traced together, e.g. a 2x2 or 4x4 pixel block
+template <size_t N> struct RayPacket {
+  static_assert(N <= 32, "one mask bit per ray");
+
+  std::array<Ray, N> rays;
+  uint32_t mask = N == 32 ? ~0u : (1u << N) - 1; // active rays
+  std::optional<Frustum> frustum; // only when every ray share the origin
+
+  bool is_active(size_t k) const { return (mask >> k) & 1; }
+};
+
 // -- Common templates --
 
 template <typename D, typename T>
@@ -266,21 +358,20 @@ inline constexpr float lenght_sq(const glm::vec3 &v) {
   return v.x * v.x + v.y * v.y + v.z * v.z;
 }
 
+// Rec. 709 relative luminance
+inline constexpr float luminance(Color color) {
+  return 0.2126f * color[0] + 0.7152f * color[1] + 0.0722f * color[2];
+}
+
 // -- Randoms
+// Per thread sequence, for scene setup and tests. Rendering uses the
+// deterministic samplers of utils/Sampler.h.
 
 inline float random_float() {
-  thread_local std::uniform_real_distribution<float> distrib(0.f, 1.f);
-  thread_local std::mt19937 generator;
-  return distrib(generator);
+  thread_local Xoshiro128pp generator;
+  return generator.next_float();
 }
 
 inline float random_float(float min, float max) {
   return min + (max - min) * random_float();
 }
-
-inline glm::vec2 random_in_unit_disk() {
-  float theta = random_float(0, M_2_PI);
-  float ro = random_float();
-
-  return ro * glm::vec2(std::cos(theta), std::sin(theta));
-}
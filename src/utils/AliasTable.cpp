@@ -0,0 +1,40 @@
+#include "AliasTable.h"
+
+#include <numeric>
+
+AliasTable::AliasTable(std::span<const float> weights) {
+  double total = std::accumulate(weights.begin(), weights.end(), 0.);
+  if (weights.empty() || !(total > 0))
+    return;
+
+  size_t count = weights.size();
+  _bins.resize(count);
+
+  // probabilities scaled so the mean is 1 : bins under 1 are filled by one
+  // bin over 1, the alias
+  std::vector<double> scaled(count);
+  std::vector<uint32_t> small, large;
+  for (uint32_t i = 0; i < count; i++) {
+    _bins[i].pmf = static_cast<float>(weights[i] / total);
+    scaled[i] = weights[i] / total * static_cast<double>(count);
+    (scaled[i] < 1 ? small : large).push_back(i);
+  }
+
+  while (!small.empty() && !large.empty()) {
+    uint32_t less = small.back();
+    small.pop_back();
+    uint32_t more = large.back();
+    large.pop_back();
+
+    _bins[less].threshold = static_cast<float>(scaled[less]);
+    _bins[less].alias = more;
+    scaled[more] -= 1 - scaled[less];
+    (scaled[more] < 1 ? small : large).push_back(more);
+  }
+
+  // the leftovers are 1 up to rounding errors
+  for (uint32_t i : small)
+    _bins[i] = {1, i, _bins[i].pmf};
+  for (uint32_t i : large)
+    _bins[i] = {1, i, _bins[i].pmf};
+}
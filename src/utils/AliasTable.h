@@ -0,0 +1,50 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Walker's alias method, built with Vose's algorithm : a discrete
+// distribution sampled in O(1), with one uniform sample, one bin load and
+// one comparison.
+class AliasTable {
+public:
+  // -- Constructors
+  AliasTable() = default;
+  // weights >= 0, the table stays empty if they sum to 0
+  AliasTable(std::span<const float> weights);
+
+  // -- Methods
+  // index drawn with u in [0, 1), pmf : its probability
+  uint32_t sample(float u, float *pmf = nullptr) const {
+    float scaled = u * static_cast<float>(_bins.size());
+    uint32_t index = std::min(static_cast<uint32_t>(scaled),
+                              static_cast<uint32_t>(_bins.size() - 1));
+    const Bin &bin = _bins[index];
+    uint32_t result =
+        scaled - static_cast<float>(index) < bin.threshold ? index : bin.alias;
+    if (pmf)
+      *pmf = _bins[result].pmf;
+    return result;
+  }
+
+  float pmf(uint32_t index) const {
+    return index < _bins.size() ? _bins[index].pmf : 0;
+  }
+
+  // -- Getters
+  size_t size() const { return _bins.size(); }
+  bool empty() const { return _bins.empty(); }
+
+private:
+  struct Bin {
+    float threshold; // below it the bin itself is taken, above its alias
+    uint32_t alias;
+    float pmf;
+  };
+
+  // -- Members
+  std::vector<Bin> _bins;
+};
@@ -0,0 +1,99 @@
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::optional<MappedFile> MappedFile::open(const std::filesystem::path &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOGWARN("Could not open {} : {}", path.string(), std::strerror(errno));
+    return std::nullopt;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    LOGWARN("Could not map {} : empty or unreadable", path.string());
+    close(fd);
+    return std::nullopt;
+  }
+
+  size_t size = static_cast<size_t>(info.st_size);
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps its own reference on the file
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOGWARN("Could not map {} : {}", path.string(), std::strerror(errno));
+    return std::nullopt;
+  }
+
+  return MappedFile(static_cast<const std::byte *>(data), size);
+}
+
+std::optional<MappedFile>
+MappedFile::create_temporary(const std::filesystem::path &directory,
+                             size_t size) {
+  if (size == 0) {
+    LOGWARN("Could not create a temporary file in {} : empty mapping",
+            directory.string());
+    return std::nullopt;
+  }
+
+  // a file without a name when the file system allows it, else a new unique
+  // one, unlinked right away : no existing file is ever opened
+  int fd = -1;
+#ifdef O_TMPFILE
+  fd = ::open(directory.c_str(), O_TMPFILE | O_RDWR | O_EXCL, 0600);
+#endif
+  if (fd < 0) {
+    std::string name = (directory / "rtvk_XXXXXX").string();
+    fd = mkstemp(name.data());
+    if (fd >= 0)
+      unlink(name.c_str());
+  }
+  if (fd < 0) {
+    LOGWARN("Could not create a temporary file in {} : {}",
+            directory.string(), std::strerror(errno));
+    return std::nullopt;
+  }
+
+  // sparse : the blocks are allocated as the pages are written
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    LOGWARN("Could not resize a temporary file in {} : {}",
+            directory.string(), std::strerror(errno));
+    close(fd);
+    return std::nullopt;
+  }
+
+  void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // the mapping keeps the file alive
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOGWARN("Could not map a temporary file in {} : {}", directory.string(),
+            std::strerror(errno));
+    return std::nullopt;
+  }
+
+  return MappedFile(static_cast<const std::byte *>(data), size, true);
+}
+
+void MappedFile::evict(size_t offset, size_t size) const {
+  // whole pages, the neighbours of the range are simply reloaded
+  static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t begin = offset / page_size * page_size;
+  size_t end = std::min(offset + size, _size);
+  if (!_data || begin >= end)
+    return;
+  madvise(const_cast<std::byte *>(_data) + begin, end - begin, MADV_DONTNEED);
+}
+
+void MappedFile::unmap() {
+  if (_data)
+    munmap(const_cast<std::byte *>(_data), _size);
+  _data = nullptr;
+  _size = 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstddef>
+#include <filesystem>
+
+// Memory mapping of a whole file, pages are loaded on first access. Read
+// only, or shared and writable for the temporary files.
+class MappedFile {
+public:
+  // -- Constructors
+  // nullopt (and a warning) if the file can't be opened or mapped
+  static std::optional<MappedFile> open(const std::filesystem::path &path);
+  // Anonymous file of size bytes in directory, mapped read write : the
+  // writes go to the disk, and the file disappears with the mapping
+  static std::optional<MappedFile>
+  create_temporary(const std::filesystem::path &directory, size_t size);
+
+  NO_COPY(MappedFile);
+
+  MappedFile(MappedFile &&other)
+      : _data(std::exchange(other._data, nullptr)),
+        _size(std::exchange(other._size, 0)), _writable(other._writable) {}
+
+  MappedFile &operator=(MappedFile &&other) {
+    if (this != &other) {
+      unmap();
+      _data = std::exchange(other._data, nullptr);
+      _size = std::exchange(other._size, 0);
+      _writable = other._writable;
+    }
+    return *this;
+  }
+
+  ~MappedFile() { unmap(); }
+
+  // -- Methods
+  // Drops the pages of the range from memory, they are reloaded from the file
+  // on the next access. The writes are kept : the kernel writes the dirty
+  // pages back to the file.
+  void evict(size_t offset, size_t size) const;
+
+  // -- Getters
+  std::span<const std::byte> get_data() const { return {_data, _size}; }
+  // empty for the read only mappings
+  std::span<std::byte> get_writable_data() {
+    if (!_writable)
+      return {};
+    return {const_cast<std::byte *>(_data), _size};
+  }
+  size_t get_size() const { return _size; }
+
+private:
+  MappedFile(const std::byte *data, size_t size, bool writable = false)
+      : _data(data), _size(size), _writable(writable) {}
+
+  void unmap();
+
+  // -- Members
+private:
+  const std::byte *_data = nullptr;
+  size_t _size = 0;
+  bool _writable = false;
+};
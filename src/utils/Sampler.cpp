@@ -0,0 +1,95 @@
+#include "Sampler.h"
+
+#include <array>
+#include <bit>
+
+// -- Sobol direction numbers --
+
+namespace {
+
+constexpr size_t SOBOL_BITS = 32;
+
+using SobolMatrix = std::array<uint32_t, SOBOL_BITS>;
+
+// Joe & Kuo primitive polynomials (degree s, coefficients a, initial m)
+// for the dimensions 2 to 4, the first one is van der Corput
+struct SobolPolynomial {
+  uint32_t s;
+  uint32_t a;
+  std::array<uint32_t, 3> m;
+};
+
+constexpr std::array<SobolPolynomial, SobolSampler::SOBOL_DIMS - 1>
+    SOBOL_POLYNOMIALS = {{{1, 0, {1}}, {2, 1, {1, 3}}, {3, 1, {1, 3, 1}}}};
+
+constexpr SobolMatrix sobol_matrix(uint32_t dim) {
+  SobolMatrix v = {};
+  if (dim == 0) {
+    for (uint32_t i = 0; i < SOBOL_BITS; i++)
+      v[i] = 1u << (31 - i);
+    return v;
+  }
+
+  const SobolPolynomial &poly = SOBOL_POLYNOMIALS[dim - 1];
+  for (uint32_t i = 0; i < poly.s; i++)
+    v[i] = poly.m[i] << (31 - i);
+  for (uint32_t i = poly.s; i < SOBOL_BITS; i++) {
+    v[i] = v[i - poly.s] ^ (v[i - poly.s] >> poly.s);
+    for (uint32_t k = 1; k < poly.s; k++)
+      v[i] ^= ((poly.a >> (poly.s - 1 - k)) & 1) * v[i - k];
+  }
+  return v;
+}
+
+constexpr std::array<SobolMatrix, SobolSampler::SOBOL_DIMS> SOBOL_MATRICES = {
+    sobol_matrix(0), sobol_matrix(1), sobol_matrix(2), sobol_matrix(3)};
+
+uint32_t reverse_bits(uint32_t x) {
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+// Owen scrambling of the reversed bits (Burley's Laine-Karras variant)
+uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+  x ^= x * 0x3d20adeau;
+  x += seed;
+  x *= (seed >> 16) | 1;
+  x ^= x * 0x05526c56u;
+  x ^= x * 0x53a22864u;
+  return x;
+}
+
+uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+  return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+} // namespace
+
+// -- SobolSampler impl --
+
+uint32_t SobolSampler::sobol(uint32_t index, uint32_t dim) {
+  const SobolMatrix &matrix = SOBOL_MATRICES[dim];
+  uint32_t result = 0;
+  for (uint32_t bit = 0; index != 0; bit++, index >>= 1)
+    if (index & 1)
+      result ^= matrix[bit];
+  return result;
+}
+
+float SobolSampler::get_1d(uint32_t pixel, uint32_t sample,
+                           uint32_t dim) const {
+  uint32_t group_seed =
+      hash_combine(hash_combine(_seed, pixel), dim / SOBOL_DIMS);
+  uint32_t index = nested_uniform_scramble(sample, group_seed);
+  uint32_t x = sobol(index, dim % SOBOL_DIMS);
+  return u32_to_unit_float(
+      nested_uniform_scramble(x, hash_combine(group_seed, dim)));
+}
+
+glm::vec2 SobolSampler::get_2d(uint32_t pixel, uint32_t sample,
+                               uint32_t dim) const {
+  return {get_1d(pixel, sample, dim), get_1d(pixel, sample, dim + 1)};
+}
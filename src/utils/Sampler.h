@@ -0,0 +1,99 @@
+#pragma once
+
+#include "types.h"
+#include "utils/random.h"
+
+#include <cstdint>
+#include <glm/mat3x3.hpp>
+
+// Counter based samplers : a value only depends on (pixel, sample index,
+// dimension), never on the thread or on the calls order, so parallel
+// renders are deterministic. Values are in [0, 1).
+class ISampler {
+public:
+  virtual ~ISampler() = default;
+
+  virtual float get_1d(uint32_t pixel, uint32_t sample, uint32_t dim) const = 0;
+  // dimensions dim and dim + 1, use even dims to keep both in the same
+  // Sobol group
+  virtual glm::vec2 get_2d(uint32_t pixel, uint32_t sample,
+                           uint32_t dim) const = 0;
+};
+
+// Independent uniform samples, from a PCG hash of the counters
+class PcgSampler : public ISampler {
+public:
+  PcgSampler(uint32_t seed = 0) : _seed(seed) {}
+
+  float get_1d(uint32_t pixel, uint32_t sample, uint32_t dim) const override {
+    return u32_to_unit_float(hash(pixel, sample, dim));
+  }
+
+  glm::vec2 get_2d(uint32_t pixel, uint32_t sample,
+                   uint32_t dim) const override {
+    return {get_1d(pixel, sample, dim), get_1d(pixel, sample, dim + 1)};
+  }
+
+private:
+  uint32_t hash(uint32_t pixel, uint32_t sample, uint32_t dim) const {
+    return hash_combine(hash_combine(hash_combine(_seed, pixel), sample), dim);
+  }
+
+  uint32_t _seed;
+};
+
+// Owen scrambled Sobol (Burley 2020, "Practical Hash-based Owen
+// Scrambling") : the 4 first Sobol dimensions, padded to any dimension by
+// a shuffle and a scramble seeded per pixel and per group of 4 dimensions.
+// Converges faster than PcgSampler on smooth integrands.
+class SobolSampler : public ISampler {
+public:
+  static constexpr uint32_t SOBOL_DIMS = 4;
+
+  SobolSampler(uint32_t seed = 0) : _seed(seed) {}
+
+  float get_1d(uint32_t pixel, uint32_t sample, uint32_t dim) const override;
+  glm::vec2 get_2d(uint32_t pixel, uint32_t sample,
+                   uint32_t dim) const override;
+
+  // raw (unscrambled) Sobol point, dim < SOBOL_DIMS
+  static uint32_t sobol(uint32_t index, uint32_t dim);
+
+private:
+  uint32_t _seed;
+};
+
+// -- Warps of [0, 1)^2 samples
+
+// Uniform point in the unit disk
+inline glm::vec2 sample_unit_disk(glm::vec2 u) {
+  float theta = 2 * static_cast<float>(M_PI) * u.x;
+  float ro = std::sqrt(u.y);
+
+  return ro * glm::vec2(std::cos(theta), std::sin(theta));
+}
+
+// Uniform direction on the unit sphere
+inline glm::vec3 sample_unit_sphere(glm::vec2 u) {
+  float z = 1 - 2 * u.x;
+  float r = std::sqrt(std::max(0.f, 1 - z * z));
+  float phi = 2 * static_cast<float>(M_PI) * u.y;
+  return {r * std::cos(phi), r * std::sin(phi), z};
+}
+
+// Cosine weighted direction around +z (pdf cos(theta) / pi), from the disk
+// (Malley's method)
+inline glm::vec3 sample_cosine_hemisphere(glm::vec2 u) {
+  glm::vec2 p = sample_unit_disk(u);
+  return {p.x, p.y, std::sqrt(std::max(0.f, 1 - p.x * p.x - p.y * p.y))};
+}
+
+// Orthonormal frame with n (unit) as z axis, without branch on the sign of
+// n.z (Duff et al. 2017, "Building an Orthonormal Basis, Revisited")
+inline glm::mat3 orthonormal_basis(glm::vec3 n) {
+  float sign = std::copysign(1.f, n.z);
+  float a = -1.f / (sign + n.z);
+  float b = n.x * n.y * a;
+  return glm::mat3(glm::vec3(1 + sign * n.x * n.x * a, sign * b, -sign * n.x),
+                   glm::vec3(b, sign + n.y * n.y * a, -n.y), n);
+}
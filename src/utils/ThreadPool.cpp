@@ -0,0 +1,133 @@
+#include "ThreadPool.h"
+
+// -- ThreadPool impl --
+
+// -- Constructors
+
+ThreadPool::ThreadPool(size_t thread_count /* = default_thread_count() */) {
+  thread_count = std::max<size_t>(thread_count, 1);
+
+  _queues.reserve(thread_count);
+  for (size_t i = 0; i < thread_count; i++)
+    _queues.push_back(std::make_unique<WorkQueue>());
+
+  _workers.reserve(thread_count);
+  for (size_t i = 0; i < thread_count; i++)
+    _workers.emplace_back([this, i]() { worker_loop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(_sleepMutex);
+    _stop = true;
+  }
+  _sleepCv.notify_all();
+
+  for (auto &worker : _workers)
+    worker.join();
+}
+
+// -- Methods
+
+void ThreadPool::submit(Task &&task) {
+  size_t queue_index =
+      (t_pool == this)
+          ? t_index
+          : _nextQueue.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+
+  {
+    std::lock_guard lock(_queues[queue_index]->mutex);
+    _queues[queue_index]->tasks.push_back(std::move(task));
+  }
+
+  {
+    // under the sleep mutex so a worker can't miss the wake up
+    std::lock_guard lock(_sleepMutex);
+    _pendingCount.fetch_add(1, std::memory_order_release);
+  }
+  _sleepCv.notify_one();
+}
+
+bool ThreadPool::run_pending_task() {
+  size_t index = (t_pool == this) ? t_index : 0;
+
+  Task task;
+  if (!pop_task(index, &task) && !steal_task(index, &task))
+    return false;
+
+  task();
+  return true;
+}
+
+// -- private
+
+void ThreadPool::worker_loop(size_t index) {
+  t_pool = this;
+  t_index = index;
+
+  while (true) {
+    if (run_pending_task())
+      continue;
+
+    std::unique_lock lock(_sleepMutex);
+    _sleepCv.wait(lock, [this]() {
+      return _stop || _pendingCount.load(std::memory_order_acquire) != 0;
+    });
+    if (_stop)
+      return;
+  }
+}
+
+bool ThreadPool::pop_task(size_t index, Task *task) {
+  WorkQueue &queue = *_queues[index];
+  std::lock_guard lock(queue.mutex);
+  if (queue.tasks.empty())
+    return false;
+
+  *task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  _pendingCount.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool ThreadPool::steal_task(size_t index, Task *task) {
+  for (size_t offset = 1; offset < _queues.size() + 1; offset++) {
+    WorkQueue &queue = *_queues[(index + offset) % _queues.size()];
+    std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty())
+      continue;
+
+    *task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    _pendingCount.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+// -- TaskGroup impl --
+
+void TaskGroup::run(ThreadPool::Task &&task) {
+  _remaining.fetch_add(1, std::memory_order_relaxed);
+  _pool.submit([this, task = std::move(task)]() {
+    try {
+      task();
+    } catch (...) {
+      std::lock_guard lock(_errorMutex);
+      if (!_error)
+        _error = std::current_exception();
+    }
+    _remaining.fetch_sub(1, std::memory_order_acq_rel);
+  });
+}
+
+void TaskGroup::wait() {
+  while (_remaining.load(std::memory_order_acquire) != 0)
+    if (!_pool.run_pending_task())
+      std::this_thread::yield();
+
+  if (_error) {
+    std::exception_ptr error = std::exchange(_error, nullptr);
+    std::rethrow_exception(error);
+  }
+}
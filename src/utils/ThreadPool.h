@@ -0,0 +1,113 @@
+#pragma once
+
+#include "types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing thread pool : every worker owns a deque, it pops its own tasks
+// from the back (LIFO, cache friendly for nested tasks) and steals from the
+// front of the others (FIFO, oldest and usually biggest tasks first).
+class ThreadPool {
+public:
+  using Task = std::function<void()>;
+
+  // -- Constructors --
+  ThreadPool(size_t thread_count = default_thread_count());
+
+  NO_COPY(ThreadPool);
+
+  ~ThreadPool();
+
+  // -- Methods --
+
+  // Push a task, on the current worker queue when called from a worker,
+  // otherwise spread round robin over the workers queues.
+  void submit(Task &&task);
+
+  // Run one pending task on the calling thread (own queue first, then steal).
+  // Returns false if no task was found.
+  bool run_pending_task();
+
+  static size_t default_thread_count() {
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+
+  // -- Getters --
+  size_t get_thread_count() const { return _workers.size(); }
+
+private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void worker_loop(size_t index);
+  bool pop_task(size_t index, Task *task);
+  bool steal_task(size_t index, Task *task);
+
+  // -- Attributs --
+private:
+  std::vector<std::unique_ptr<WorkQueue>> _queues;
+  std::vector<std::thread> _workers;
+
+  std::mutex _sleepMutex;
+  std::condition_variable _sleepCv;
+  std::atomic<size_t> _pendingCount = 0;
+  std::atomic<size_t> _nextQueue = 0;
+  bool _stop = false;
+
+  // worker identity of the current thread
+  static inline thread_local const ThreadPool *t_pool = nullptr;
+  static inline thread_local size_t t_index = 0;
+};
+
+// Fork/join helper : tasks are run on the pool, and wait() helps executing
+// pending tasks instead of blocking, so groups can be nested from tasks.
+class TaskGroup {
+public:
+  TaskGroup(ThreadPool &pool) : _pool(pool) {}
+
+  NO_COPY(TaskGroup);
+
+  ~TaskGroup() {
+    // never leave tasks referencing a dead group, errors are lost here
+    while (_remaining.load(std::memory_order_acquire) != 0)
+      if (!_pool.run_pending_task())
+        std::this_thread::yield();
+  }
+
+  // -- Methods --
+  void run(ThreadPool::Task &&task);
+
+  // Wait for every task of the group, rethrow the first task exception.
+  void wait();
+
+  // -- Attributs --
+private:
+  ThreadPool &_pool;
+  std::atomic<size_t> _remaining = 0;
+
+  std::mutex _errorMutex;
+  std::exception_ptr _error;
+};
+
+// Split [begin, end) in chunks of `grain` and call func(chunk_begin,
+// chunk_end) on the pool.
+template <typename Func>
+void parallel_for(ThreadPool &pool, size_t begin, size_t end, size_t grain,
+                  Func &&func) {
+  grain = std::max<size_t>(grain, 1);
+  TaskGroup group(pool);
+  for (size_t chunk = begin; chunk < end; chunk += grain) {
+    size_t chunk_end = std::min(chunk + grain, end);
+    group.run([&func, chunk, chunk_end]() { func(chunk, chunk_end); });
+  }
+  group.wait();
+}
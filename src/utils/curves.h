@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+// -- Space filling curves --
+
+// Morton (Z order) code of (x, y) : their bits interleaved, x in the even
+// ones. Coordinates up to 16 bits.
+inline constexpr uint32_t morton_encode(uint32_t x, uint32_t y) {
+  auto spread = [](uint32_t v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+  };
+  return spread(x) | (spread(y) << 1);
+}
+
+inline constexpr std::pair<uint32_t, uint32_t> morton_decode(uint32_t code) {
+  auto compact = [](uint32_t v) {
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0f0f0f0f;
+    v = (v | (v >> 4)) & 0x00ff00ff;
+    v = (v | (v >> 8)) & 0x0000ffff;
+    return v;
+  };
+  return {compact(code), compact(code >> 1)};
+}
+
+// Hilbert curve over a size x size grid (size a power of two), every step
+// goes to a neighbour cell. From the iterative version of Wikipedia.
+inline constexpr void hilbert_rotate(uint32_t size, uint32_t *x, uint32_t *y,
+                                     uint32_t rx, uint32_t ry) {
+  if (ry != 0)
+    return;
+  if (rx == 1) {
+    *x = size - 1 - *x;
+    *y = size - 1 - *y;
+  }
+  std::swap(*x, *y);
+}
+
+// cell at the distance d along the curve
+inline constexpr std::pair<uint32_t, uint32_t> hilbert_decode(uint32_t size,
+                                                              uint32_t d) {
+  uint32_t x = 0, y = 0;
+  for (uint32_t s = 1; s < size; s *= 2) {
+    uint32_t rx = 1 & (d / 2);
+    uint32_t ry = 1 & (d ^ rx);
+    hilbert_rotate(s, &x, &y, rx, ry);
+    x += s * rx;
+    y += s * ry;
+    d /= 4;
+  }
+  return {x, y};
+}
+
+// distance of the cell (x, y) along the curve
+inline constexpr uint32_t hilbert_encode(uint32_t size, uint32_t x,
+                                         uint32_t y) {
+  uint32_t d = 0;
+  for (uint32_t s = size / 2; s > 0; s /= 2) {
+    uint32_t rx = (x & s) > 0;
+    uint32_t ry = (y & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+    hilbert_rotate(size, &x, &y, rx, ry);
+  }
+  return d;
+}
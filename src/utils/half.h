@@ -0,0 +1,46 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+// -- IEEE 754 binary16 conversions --
+
+// Rounded to the nearest even, the values past the half range become
+// infinities, NaN stays NaN. From Fabian Giesen's float_to_half_fast3_rtne.
+inline uint16_t float_to_half(float value) {
+  uint32_t bits = std::bit_cast<uint32_t>(value);
+  uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  uint32_t abs = bits & 0x7fffffff;
+
+  if (abs >= 0x7f800000) // inf, NaN (kept quiet)
+    return sign | (abs > 0x7f800000 ? 0x7e00 : 0x7c00);
+  if (abs >= 0x477ff000) // rounds past 65504
+    return sign | 0x7c00;
+  if (abs < 0x38800000) {
+    // subnormal half : adding 0.5 lines the half ulp (2^-24) up with the
+    // float one, the fpu does the rounding
+    float shifted = std::bit_cast<float>(abs) + 0.5f;
+    return sign |
+           static_cast<uint16_t>(std::bit_cast<uint32_t>(shifted) - 0x3f000000);
+  }
+
+  // exponent rebiased (127 -> 15), 13 mantissa bits rounded off
+  uint32_t odd = (abs >> 13) & 1;
+  abs += 0xc8000fff + odd;
+  return sign | static_cast<uint16_t>(abs >> 13);
+}
+
+inline float half_to_float(uint16_t half) {
+  uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1f;
+  uint32_t mantissa = half & 0x3ff;
+
+  if (exponent == 0x1f) // inf, NaN
+    return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+  if (exponent == 0) { // zero, subnormal
+    float value = static_cast<float>(mantissa) * 0x1p-24f;
+    return sign ? -value : value;
+  }
+  return std::bit_cast<float>(sign | ((exponent + 112) << 23) |
+                              (mantissa << 13));
+}
@@ -0,0 +1,593 @@
+#include "png.h"
+
+#include "ThreadPool.h"
+
+#include <array>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// raw (filtered) bytes per stripe : enough work per task, and the stripe
+// boundaries cost a few bytes and the matches across them
+constexpr size_t STRIPE_SIZE = 1 << 20;
+
+// -- Bit writer --
+
+// Deflate bit stream : values are packed from the least significant bit
+class BitWriter {
+public:
+  BitWriter(std::vector<uint8_t> *out) : _out(out) {}
+
+  // count <= 32
+  void put(uint32_t bits, uint32_t count) {
+    _bits |= static_cast<uint64_t>(bits) << _count;
+    _count += count;
+    if (_count >= 32) {
+      uint8_t bytes[4] = {
+          static_cast<uint8_t>(_bits), static_cast<uint8_t>(_bits >> 8),
+          static_cast<uint8_t>(_bits >> 16), static_cast<uint8_t>(_bits >> 24)};
+      _out->insert(_out->end(), bytes, bytes + 4);
+      _bits >>= 32;
+      _count -= 32;
+    }
+  }
+
+  // pads the last byte with zeros
+  void align() {
+    for (; _count > 0; _count -= std::min<uint32_t>(_count, 8)) {
+      _out->push_back(static_cast<uint8_t>(_bits));
+      _bits >>= 8;
+    }
+  }
+
+private:
+  std::vector<uint8_t> *_out;
+  uint64_t _bits = 0;
+  uint32_t _count = 0;
+};
+
+// -- Fixed Huffman codes (RFC 1951 3.2.6) --
+
+struct HuffmanCode {
+  uint16_t bits; // reversed, the stream is read from the least significant bit
+  uint8_t length;
+};
+
+constexpr uint16_t reverse_bits(uint16_t code, uint32_t length) {
+  uint16_t reversed = 0;
+  for (uint32_t i = 0; i < length; i++)
+    reversed |= ((code >> i) & 1) << (length - 1 - i);
+  return reversed;
+}
+
+constexpr std::array<HuffmanCode, 288> make_litlen_codes() {
+  std::array<HuffmanCode, 288> codes{};
+  for (uint16_t symbol = 0; symbol < 288; symbol++) {
+    uint16_t code;
+    uint8_t length;
+    if (symbol < 144) {
+      code = 0x30 + symbol;
+      length = 8;
+    } else if (symbol < 256) {
+      code = 0x190 + (symbol - 144);
+      length = 9;
+    } else if (symbol < 280) {
+      code = symbol - 256;
+      length = 7;
+    } else {
+      code = 0xc0 + (symbol - 280);
+      length = 8;
+    }
+    codes[symbol] = {reverse_bits(code, length), length};
+  }
+  return codes;
+}
+
+constexpr std::array<HuffmanCode, 288> LITLEN_CODES = make_litlen_codes();
+constexpr uint32_t END_OF_BLOCK = 256;
+
+constexpr std::array<uint16_t, 29> LENGTH_BASE = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr std::array<uint8_t, 29> LENGTH_EXTRA = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr std::array<uint16_t, 30> DISTANCE_BASE = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+
+constexpr size_t MIN_MATCH = 4; // the hash reads 4 bytes
+constexpr size_t MAX_MATCH = 258;
+constexpr size_t WINDOW_SIZE = 32768;
+
+// length code (0 to 28) of every match length
+constexpr std::array<uint8_t, MAX_MATCH + 1> make_length_symbols() {
+  std::array<uint8_t, MAX_MATCH + 1> symbols{};
+  uint8_t code = 0;
+  for (size_t length = 3; length <= MAX_MATCH; length++) {
+    while (code + 1 < LENGTH_BASE.size() && LENGTH_BASE[code + 1] <= length)
+      code++;
+    symbols[length] = code;
+  }
+  return symbols;
+}
+
+constexpr std::array<uint8_t, MAX_MATCH + 1> LENGTH_SYMBOLS =
+    make_length_symbols();
+
+// two codes per power of two past 4
+uint32_t distance_symbol(uint32_t distance) {
+  uint32_t d = distance - 1;
+  if (d < 4)
+    return d;
+  uint32_t log2 = std::bit_width(d) - 1;
+  return 2 * log2 + ((d >> (log2 - 1)) & 1);
+}
+
+// -- Deflate --
+
+uint32_t load32(const uint8_t *p) {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+size_t match_length(const uint8_t *a, const uint8_t *b, size_t max_length) {
+  size_t length = 0;
+  if constexpr (std::endian::native == std::endian::little) {
+    for (; length + 8 <= max_length; length += 8) {
+      uint64_t wa, wb;
+      std::memcpy(&wa, a + length, 8);
+      std::memcpy(&wb, b + length, 8);
+      if (wa != wb)
+        return length + std::countr_zero(wa ^ wb) / 8;
+    }
+  }
+  while (length < max_length && a[length] == b[length])
+    length++;
+  return length;
+}
+
+// One fixed Huffman block holding data, ended by an empty stored block (a
+// sync flush) : the output ends on a byte boundary, and the next stripe can
+// follow it. The matches stay inside data.
+void deflate_stripe(std::span<const uint8_t> data, std::vector<uint8_t> *out) {
+  constexpr uint32_t HASH_BITS = 15;
+  std::vector<int32_t> head(1 << HASH_BITS, -1);
+  auto hash = [](uint32_t word) {
+    return (word * 2654435761u) >> (32 - HASH_BITS);
+  };
+
+  BitWriter writer(out);
+  writer.put(0b010, 3); // not final, fixed Huffman codes
+
+  const uint8_t *p = data.data();
+  size_t size = data.size();
+  size_t i = 0;
+  while (i + MIN_MATCH <= size) {
+    uint32_t word = load32(p + i);
+    uint32_t h = hash(word);
+    int32_t candidate = head[h];
+    head[h] = static_cast<int32_t>(i);
+
+    if (candidate < 0 || i - candidate > WINDOW_SIZE ||
+        load32(p + candidate) != word) {
+      HuffmanCode literal = LITLEN_CODES[p[i]];
+      writer.put(literal.bits, literal.length);
+      i++;
+      continue;
+    }
+
+    size_t length =
+        MIN_MATCH + match_length(p + candidate + MIN_MATCH, p + i + MIN_MATCH,
+                                 std::min(MAX_MATCH, size - i) - MIN_MATCH);
+    uint32_t distance = static_cast<uint32_t>(i - candidate);
+
+    uint32_t length_symbol = LENGTH_SYMBOLS[length];
+    HuffmanCode length_code = LITLEN_CODES[257 + length_symbol];
+    writer.put(length_code.bits, length_code.length);
+    writer.put(static_cast<uint32_t>(length - LENGTH_BASE[length_symbol]),
+               LENGTH_EXTRA[length_symbol]);
+    uint32_t distance_code = distance_symbol(distance);
+    uint32_t distance_extra = distance_code < 4 ? 0 : distance_code / 2 - 1;
+    writer.put(reverse_bits(static_cast<uint16_t>(distance_code), 5), 5);
+    writer.put(distance - DISTANCE_BASE[distance_code], distance_extra);
+
+    // the covered positions can start the next matches
+    size_t end = std::min(i + length, size - MIN_MATCH + 1);
+    for (size_t j = i + 1; j < end; j++)
+      head[hash(load32(p + j))] = static_cast<int32_t>(j);
+    i += length;
+  }
+  for (; i < size; i++) {
+    HuffmanCode literal = LITLEN_CODES[p[i]];
+    writer.put(literal.bits, literal.length);
+  }
+  writer.put(LITLEN_CODES[END_OF_BLOCK].bits,
+             LITLEN_CODES[END_OF_BLOCK].length);
+
+  writer.put(0b000, 3); // not final, stored
+  writer.align();
+  out->insert(out->end(), {0x00, 0x00, 0xff, 0xff}); // 0 bytes, and ~0
+}
+
+// -- Filters --
+
+uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+  int pa = std::abs(b - c);
+  int pb = std::abs(a - c);
+  int pc = std::abs(a + b - 2 * c);
+  return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+}
+
+// Filter type byte then the filtered row, into out. The 5 filters are
+// computed in a single pass, the one with the smallest sum of residuals (as
+// signed bytes) is kept, as libpng does. prev is a row of zeros for the
+// first one.
+void filter_row(const uint8_t *row, const uint8_t *prev, size_t row_size,
+                size_t bpp, uint8_t *scratch, uint8_t *out) {
+  std::array<uint8_t *, 5> filtered;
+  for (size_t f = 0; f < 5; f++)
+    filtered[f] = scratch + f * row_size;
+  std::array<uint32_t, 5> sums = {};
+
+  for (size_t x = 0; x < row_size; x++) {
+    uint8_t a = x >= bpp ? row[x - bpp] : 0;
+    uint8_t b = prev[x];
+    uint8_t c = x >= bpp ? prev[x - bpp] : 0;
+    std::array<uint8_t, 5> residuals = {
+        row[x],
+        static_cast<uint8_t>(row[x] - a),
+        static_cast<uint8_t>(row[x] - b),
+        static_cast<uint8_t>(row[x] - ((a + b) >> 1)),
+        static_cast<uint8_t>(row[x] - paeth(a, b, c)),
+    };
+    for (size_t f = 0; f < 5; f++) {
+      filtered[f][x] = residuals[f];
+      sums[f] += std::abs(static_cast<int8_t>(residuals[f]));
+    }
+  }
+
+  size_t best = std::min_element(sums.begin(), sums.end()) - sums.begin();
+  out[0] = static_cast<uint8_t>(best);
+  std::memcpy(out + 1, filtered[best], row_size);
+}
+
+// -- Chunks --
+
+void append_u32(std::vector<uint8_t> *out, uint32_t value) {
+  out->insert(out->end(),
+              {static_cast<uint8_t>(value >> 24),
+               static_cast<uint8_t>(value >> 16),
+               static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value)});
+}
+
+// length, type and data are appended by the callers, crc over type and data
+void end_chunk(std::vector<uint8_t> *out, size_t chunk_begin) {
+  uint32_t length = static_cast<uint32_t>(out->size() - chunk_begin - 8);
+  for (int i = 0; i < 4; i++)
+    (*out)[chunk_begin + i] = static_cast<uint8_t>(length >> (24 - 8 * i));
+  append_u32(out, crc32(std::span(*out).subspan(chunk_begin + 4)));
+}
+
+size_t begin_chunk(std::vector<uint8_t> *out, const char *type) {
+  size_t chunk_begin = out->size();
+  append_u32(out, 0); // length, set by end_chunk
+  out->insert(out->end(), type, type + 4);
+  return chunk_begin;
+}
+
+size_t stripe_rows(size_t row_size) {
+  return std::max<size_t>(1, STRIPE_SIZE / (row_size + 1));
+}
+
+struct Stripe {
+  std::vector<uint8_t> chunk; // whole IDAT chunk
+  uint32_t adler;
+  size_t filteredSize;
+};
+
+// IDAT chunk of row_count rows, prev is the row above them (nullptr for the
+// first rows of the image, which also start the zlib stream)
+Stripe encode_stripe(const uint8_t *rows, const uint8_t *prev,
+                     size_t row_count, size_t row_size, size_t channels) {
+  std::vector<uint8_t> zeros;
+  if (!prev) {
+    zeros.resize(row_size, 0);
+    prev = zeros.data();
+  }
+  std::vector<uint8_t> scratch(row_size * 5);
+  std::vector<uint8_t> filtered(row_count * (row_size + 1));
+  for (size_t y = 0; y < row_count; y++) {
+    const uint8_t *row = rows + y * row_size;
+    filter_row(row, y == 0 ? prev : row - row_size, row_size, channels,
+               scratch.data(), filtered.data() + y * (row_size + 1));
+  }
+
+  Stripe stripe;
+  stripe.adler = adler32(filtered);
+  stripe.filteredSize = filtered.size();
+  stripe.chunk.reserve(filtered.size() / 2 + 64);
+  size_t chunk_begin = begin_chunk(&stripe.chunk, "IDAT");
+  if (!zeros.empty()) // zlib header : deflate, 32K window, fastest
+    stripe.chunk.insert(stripe.chunk.end(), {0x78, 0x01});
+  deflate_stripe(filtered, &stripe.chunk);
+  end_chunk(&stripe.chunk, chunk_begin);
+  return stripe;
+}
+
+// signature and IHDR
+std::vector<uint8_t> encode_header(size_t width, size_t height,
+                                   size_t channels) {
+  std::vector<uint8_t> header = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  size_t ihdr = begin_chunk(&header, "IHDR");
+  append_u32(&header, static_cast<uint32_t>(width));
+  append_u32(&header, static_cast<uint32_t>(height));
+  constexpr uint8_t COLOR_TYPES[] = {0, 4, 2, 6}; // by channel count
+  header.insert(header.end(), {8, COLOR_TYPES[channels - 1], 0, 0, 0});
+  end_chunk(&header, ihdr);
+  return header;
+}
+
+// end of the zlib stream, then IEND
+std::vector<uint8_t> encode_footer(uint32_t adler) {
+  std::vector<uint8_t> footer;
+  size_t idat = begin_chunk(&footer, "IDAT");
+  footer.insert(footer.end(), {0x03, 0x00}); // final empty fixed block
+  append_u32(&footer, adler);
+  end_chunk(&footer, idat);
+  end_chunk(&footer, begin_chunk(&footer, "IEND"));
+  return footer;
+}
+
+// Encoded file, in pieces : signature and header, one IDAT per stripe, and
+// the footer
+std::vector<std::vector<uint8_t>> encode_pieces(std::span<const uint8_t> pixels,
+                                                size_t width, size_t height,
+                                                size_t channels,
+                                                ThreadPool *pool) {
+  size_t row_size = width * channels;
+  size_t rows = stripe_rows(row_size);
+  size_t stripe_count = (height + rows - 1) / rows;
+  std::vector<Stripe> stripes(stripe_count);
+
+  auto encode_stripes = [&](size_t begin, size_t end) {
+    for (size_t s = begin; s < end; s++) {
+      size_t y0 = s * rows;
+      const uint8_t *first = pixels.data() + y0 * row_size;
+      stripes[s] = encode_stripe(first, y0 == 0 ? nullptr : first - row_size,
+                                 std::min(rows, height - y0), row_size,
+                                 channels);
+    }
+  };
+  if (pool && stripe_count > 1)
+    parallel_for(*pool, 0, stripe_count, 1, encode_stripes);
+  else
+    encode_stripes(0, stripe_count);
+
+  std::vector<std::vector<uint8_t>> pieces;
+  pieces.reserve(stripe_count + 2);
+  pieces.push_back(encode_header(width, height, channels));
+  uint32_t adler = 1;
+  for (Stripe &stripe : stripes) {
+    adler = adler32_combine(adler, stripe.adler, stripe.filteredSize);
+    pieces.push_back(std::move(stripe.chunk));
+  }
+  pieces.push_back(encode_footer(adler));
+  return pieces;
+}
+
+bool check_format(size_t width, size_t height, size_t channels) {
+  if (channels < 1 || channels > 4 || width == 0 || height == 0 ||
+      width > INT32_MAX || height > INT32_MAX) {
+    LOGWARN("Can't encode a {}x{} png of {} channels", width, height,
+            channels);
+    return false;
+  }
+  return true;
+}
+
+bool check_arguments(std::span<const uint8_t> pixels, size_t width,
+                     size_t height, size_t channels) {
+  if (!check_format(width, height, channels))
+    return false;
+  if (pixels.size() < width * height * channels) {
+    LOGWARN("Can't encode a {}x{} png of {} channels from {} bytes", width,
+            height, channels, pixels.size());
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+// -- PNG encoder --
+
+std::vector<uint8_t> encode_png(std::span<const uint8_t> pixels, size_t width,
+                                size_t height, size_t channels,
+                                ThreadPool *pool /* = nullptr */) {
+  if (!check_arguments(pixels, width, height, channels))
+    return {};
+
+  std::vector<std::vector<uint8_t>> pieces =
+      encode_pieces(pixels, width, height, channels, pool);
+  size_t size = 0;
+  for (const auto &piece : pieces)
+    size += piece.size();
+
+  std::vector<uint8_t> png;
+  png.reserve(size);
+  for (const auto &piece : pieces)
+    png.insert(png.end(), piece.begin(), piece.end());
+  return png;
+}
+
+bool write_png(const char *filename, std::span<const uint8_t> pixels,
+               size_t width, size_t height, size_t channels,
+               ThreadPool *pool /* = nullptr */) {
+  if (!check_arguments(pixels, width, height, channels))
+    return false;
+
+  std::vector<std::vector<uint8_t>> pieces =
+      encode_pieces(pixels, width, height, channels, pool);
+  std::FILE *file = std::fopen(filename, "wb");
+  if (!file)
+    return false;
+  bool ok = true;
+  for (const auto &piece : pieces)
+    ok = ok && std::fwrite(piece.data(), 1, piece.size(), file) == piece.size();
+  return std::fclose(file) == 0 && ok;
+}
+
+// -- PngStreamWriter impl --
+
+// -- Constructors
+
+std::optional<PngStreamWriter> PngStreamWriter::open(const char *filename,
+                                                     size_t width,
+                                                     size_t height,
+                                                     size_t channels) {
+  if (!check_format(width, height, channels))
+    return std::nullopt;
+
+  std::FILE *file = std::fopen(filename, "wb");
+  if (!file) {
+    LOGWARN("Could not create {}", filename);
+    return std::nullopt;
+  }
+  PngStreamWriter writer(file, width, height, channels);
+  writer.write(encode_header(width, height, channels));
+  return writer;
+}
+
+PngStreamWriter::PngStreamWriter(std::FILE *file, size_t width, size_t height,
+                                 size_t channels)
+    : _file(file), _height(height), _channels(channels),
+      _rowSize(width * channels), _stripeRows(stripe_rows(_rowSize)) {
+  _pending.reserve(_stripeRows * _rowSize);
+}
+
+PngStreamWriter::~PngStreamWriter() {
+  if (_file)
+    std::fclose(_file);
+}
+
+// -- Methods
+
+bool PngStreamWriter::write_rows(std::span<const uint8_t> rows) {
+  if (!_file || rows.size() % _rowSize != 0 ||
+      _rowsDone + (_pending.size() + rows.size()) / _rowSize > _height) {
+    LOGWARN("{} bytes of rows don't fit the png", rows.size());
+    return _ok = false;
+  }
+
+  // the stripes are cut at the same rows as encode_png
+  while (!rows.empty()) {
+    size_t stripe_size = _stripeRows * _rowSize;
+    size_t taken = std::min(rows.size(), stripe_size - _pending.size());
+    _pending.insert(_pending.end(), rows.begin(), rows.begin() + taken);
+    rows = rows.subspan(taken);
+    if (_pending.size() == stripe_size)
+      encode_pending();
+  }
+  return _ok;
+}
+
+bool PngStreamWriter::close() {
+  if (!_file)
+    return false;
+  if (!_pending.empty())
+    encode_pending();
+  if (_rowsDone != _height) {
+    LOGWARN("png closed after {} rows out of {}", _rowsDone, _height);
+    _ok = false;
+  }
+  write(encode_footer(_adler));
+
+  _ok &= std::fclose(std::exchange(_file, nullptr)) == 0;
+  return _ok;
+}
+
+// -- private
+
+void PngStreamWriter::encode_pending() {
+  size_t row_count = _pending.size() / _rowSize;
+  Stripe stripe =
+      encode_stripe(_pending.data(), _rowsDone == 0 ? nullptr : _prev.data(),
+                    row_count, _rowSize, _channels);
+  _adler = adler32_combine(_adler, stripe.adler, stripe.filteredSize);
+  write(stripe.chunk);
+
+  _prev.assign(_pending.end() - _rowSize, _pending.end());
+  _pending.clear();
+  _rowsDone += row_count;
+}
+
+void PngStreamWriter::write(std::span<const uint8_t> bytes) {
+  _ok &= std::fwrite(bytes.data(), 1, bytes.size(), _file) == bytes.size();
+}
+
+// -- Checksums --
+
+namespace {
+
+constexpr std::array<uint32_t, 256> make_crc_table() {
+  std::array<uint32_t, 256> table{};
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t c = n;
+    for (int k = 0; k < 8; k++)
+      c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    table[n] = c;
+  }
+  return table;
+}
+
+constexpr std::array<uint32_t, 256> CRC_TABLE = make_crc_table();
+constexpr uint32_t ADLER_BASE = 65521;
+
+} // namespace
+
+uint32_t crc32(std::span<const uint8_t> data, uint32_t crc /* = 0 */) {
+  crc = ~crc;
+  for (uint8_t byte : data)
+    crc = CRC_TABLE[(crc ^ byte) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+uint32_t adler32(std::span<const uint8_t> data, uint32_t adler /* = 1 */) {
+  uint32_t a = adler & 0xffff;
+  uint32_t b = adler >> 16;
+  // 5552 bytes at most before b can overflow
+  for (size_t i = 0; i < data.size();) {
+    size_t end = std::min(data.size(), i + 5552);
+    for (; i < end; i++) {
+      a += data[i];
+      b += a;
+    }
+    a %= ADLER_BASE;
+    b %= ADLER_BASE;
+  }
+  return a | (b << 16);
+}
+
+// as zlib's adler32_combine
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2) {
+  uint32_t remainder = static_cast<uint32_t>(size2 % ADLER_BASE);
+  uint32_t sum1 = adler1 & 0xffff;
+  uint32_t sum2 = (remainder * sum1) % ADLER_BASE;
+  sum1 += (adler2 & 0xffff) + ADLER_BASE - 1;
+  sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - remainder;
+  if (sum1 >= ADLER_BASE)
+    sum1 -= ADLER_BASE;
+  if (sum1 >= ADLER_BASE)
+    sum1 -= ADLER_BASE;
+  if (sum2 >= 2 * ADLER_BASE)
+    sum2 -= 2 * ADLER_BASE;
+  if (sum2 >= ADLER_BASE)
+    sum2 -= ADLER_BASE;
+  return sum1 | (sum2 << 16);
+}
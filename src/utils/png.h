@@ -0,0 +1,89 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <vector>
+
+class ThreadPool;
+
+// -- PNG encoder --
+
+// PNG file of 8 bits pixels, 1 to 4 channels (gray, gray alpha, RGB, RGBA),
+// tightly packed rows, top first.
+//
+// The rows are split in stripes of about 1 MB, filtered and deflated
+// independently (on the pool when one is given), then stitched in a single
+// zlib stream as pigz does : every stripe ends on a byte boundary with an
+// empty stored block, and the stripes adler32 are combined. Each stripe is
+// its own IDAT chunk, so the chunks crc are computed in parallel too. The
+// output is the same with or without a pool.
+//
+// The deflate is made for speed rather than size : greedy matches from a
+// single probe hash table, fixed Huffman codes.
+std::vector<uint8_t> encode_png(std::span<const uint8_t> pixels, size_t width,
+                                size_t height, size_t channels,
+                                ThreadPool *pool = nullptr);
+
+// encode_png to a file, the stripes are written as they are, without being
+// gathered first. False if the file can't be written.
+bool write_png(const char *filename, std::span<const uint8_t> pixels,
+               size_t width, size_t height, size_t channels,
+               ThreadPool *pool = nullptr);
+
+// Row by row PNG encoding, for the images that don't fit in memory : the
+// rows are gathered until they make a stripe, which is encoded and written
+// right away. The file is the one write_png gives.
+class PngStreamWriter {
+public:
+  // nullopt (and a warning) if the file can't be created
+  static std::optional<PngStreamWriter> open(const char *filename,
+                                             size_t width, size_t height,
+                                             size_t channels);
+
+  NO_COPY(PngStreamWriter);
+
+  PngStreamWriter(PngStreamWriter &&other)
+      : _file(std::exchange(other._file, nullptr)), _height(other._height),
+        _channels(other._channels), _rowSize(other._rowSize),
+        _stripeRows(other._stripeRows), _pending(std::move(other._pending)),
+        _prev(std::move(other._prev)), _rowsDone(other._rowsDone),
+        _adler(other._adler), _ok(other._ok) {}
+
+  // the file is left incomplete without close()
+  ~PngStreamWriter();
+
+  // -- Methods
+  // whole rows, following the last ones. False after any error.
+  bool write_rows(std::span<const uint8_t> rows);
+  // last stripe and end of the file, false on an error or missing rows
+  bool close();
+
+private:
+  PngStreamWriter(std::FILE *file, size_t width, size_t height,
+                  size_t channels);
+
+  void encode_pending();
+  void write(std::span<const uint8_t> bytes);
+
+  // -- Members
+private:
+  std::FILE *_file;
+  size_t _height, _channels, _rowSize, _stripeRows;
+  std::vector<uint8_t> _pending; // rows of the next stripe
+  std::vector<uint8_t> _prev;    // last row of the previous stripe
+  size_t _rowsDone = 0;
+  uint32_t _adler = 1;
+  bool _ok = true;
+};
+
+// -- Checksums --
+
+uint32_t crc32(std::span<const uint8_t> data, uint32_t crc = 0);
+uint32_t adler32(std::span<const uint8_t> data, uint32_t adler = 1);
+// adler32 of the concatenation of a data of adler1 and one of adler2 and
+// size2 bytes
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+// Small and fast random engines, without the state (2.5 KB) and the
+// distribution objects of std::mt19937.
+
+// PCG hash (Jarkzynski & Olano 2020) : one round of a pcg32 step followed by
+// its output permutation, a good 32 bits integer hash.
+inline constexpr uint32_t pcg_hash(uint32_t x) {
+  uint32_t state = x * 747796405u + 2891336453u;
+  uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+inline constexpr uint32_t hash_combine(uint32_t seed, uint32_t value) {
+  return pcg_hash(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+inline constexpr uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// [0, 1) float from the 24 high bits
+inline constexpr float u32_to_unit_float(uint32_t x) {
+  return static_cast<float>(x >> 8) * 0x1p-24f;
+}
+
+// xoshiro128++ (Blackman & Vigna), 16 bytes of state. Satisfies
+// UniformRandomBitGenerator so it can also feed the std distributions.
+class Xoshiro128pp {
+public:
+  using result_type = uint32_t;
+
+  constexpr Xoshiro128pp(uint64_t seed = 0) {
+    uint64_t a = splitmix64(&seed);
+    uint64_t b = splitmix64(&seed);
+    _s[0] = static_cast<uint32_t>(a);
+    _s[1] = static_cast<uint32_t>(a >> 32);
+    _s[2] = static_cast<uint32_t>(b);
+    _s[3] = static_cast<uint32_t>(b >> 32);
+  }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  constexpr result_type operator()() {
+    uint32_t result = rotl(_s[0] + _s[3], 7) + _s[0];
+    uint32_t t = _s[1] << 9;
+    _s[2] ^= _s[0];
+    _s[3] ^= _s[1];
+    _s[1] ^= _s[2];
+    _s[0] ^= _s[3];
+    _s[2] ^= t;
+    _s[3] = rotl(_s[3], 11);
+    return result;
+  }
+
+  constexpr float next_float() { return u32_to_unit_float((*this)()); }
+
+private:
+  static constexpr uint32_t rotl(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+  }
+
+  uint32_t _s[4];
+};
@@ -0,0 +1,58 @@
+#include "simd.h"
+
+#if defined(RTVK_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static SimdLevel detect_simd_level() {
+#if defined(RTVK_X86) && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+      __builtin_cpu_supports("avx512dq"))
+    return SimdLevel::Avx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return SimdLevel::Avx2;
+  if (__builtin_cpu_supports("sse4.1"))
+    return SimdLevel::Sse;
+  return SimdLevel::Scalar;
+#elif defined(RTVK_X86) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  bool sse41 = info[2] & (1 << 19);
+  bool fma = info[2] & (1 << 12);
+  bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)); // osxsave, avx
+  if (!sse41)
+    return SimdLevel::Scalar;
+  if (!os_avx || (_xgetbv(0) & 0x6) != 0x6) // xmm and ymm state saved
+    return SimdLevel::Sse;
+
+  __cpuidex(info, 7, 0);
+  bool avx2 = info[1] & (1 << 5);
+  bool avx512 = (info[1] & (1 << 16)) && (info[1] & (1 << 17)) &&
+                (info[1] & (1 << 31)); // f, dq, vl
+  if (avx512 && (_xgetbv(0) & 0xe6) == 0xe6) // opmask and zmm state saved
+    return SimdLevel::Avx512;
+  return avx2 && fma ? SimdLevel::Avx2 : SimdLevel::Sse;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel cpu_simd_level() {
+  static const SimdLevel level = detect_simd_level();
+  return level;
+}
+
+const char *simd_level_name(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::Avx512:
+    return "AVX-512";
+  case SimdLevel::Avx2:
+    return "AVX2";
+  case SimdLevel::Sse:
+    return "SSE4.1";
+  case SimdLevel::Scalar:
+  default:
+    return "scalar";
+  }
+}
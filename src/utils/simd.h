@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// -- Target macros --
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||            \
+    defined(_M_IX86)
+#define RTVK_X86 1
+#include <immintrin.h>
+#endif
+
+// Compile a single function for a given instruction set (e.g. "avx2,fma"),
+// the rest of the binary stays on the baseline. MSVC doesn't need it.
+#if defined(__GNUC__) || defined(__clang__)
+#define RTVK_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RTVK_TARGET(isa)
+#endif
+
+// -- Runtime detection --
+
+enum class SimdLevel {
+  Scalar = 0,
+  Sse = 1,    // SSE4.1, baseline on x86_64 for what is used here
+  Avx2 = 2,   // AVX2 + FMA
+  Avx512 = 3, // AVX-512 F/VL/DQ
+};
+
+// Best instruction set supported by the running cpu (and the OS), cached
+// after the first call.
+SimdLevel cpu_simd_level();
+
+inline bool cpu_supports(SimdLevel level) { return cpu_simd_level() >= level; }
+
+const char *simd_level_name(SimdLevel level);
+
+// -- Aligned storage --
+
+// Allocator for std::vector of SIMD loaded data (64 : one cache line, and
+// enough for aligned AVX-512 loads).
+template <typename T, size_t ALIGN = 64> struct AlignedAllocator {
+  static_assert(ALIGN >= alignof(T));
+
+  using value_type = T;
+
+  template <typename U> struct rebind {
+    using other = AlignedAllocator<U, ALIGN>;
+  };
+
+  AlignedAllocator() = default;
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, ALIGN> &) noexcept {}
+
+  T *allocate(size_t count) {
+    return static_cast<T *>(
+        ::operator new(count * sizeof(T), std::align_val_t(ALIGN)));
+  }
+  void deallocate(T *ptr, size_t) noexcept {
+    ::operator delete(ptr, std::align_val_t(ALIGN));
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, ALIGN> &) const {
+    return true;
+  }
+};
+
+template <typename T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;